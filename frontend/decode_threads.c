@@ -0,0 +1,461 @@
+/*
+ *	Frame parallel mp3 decoder source file
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * --decode-threads: the input file is cut into chunks of whole frames,
+ * and each chunk is decoded by a lame_decoder_t of its own, on one of
+ * decode_threads threads.  decode_threads_read() hands out the frames
+ * in order, so the output is exactly that of lame_decode_fromfile().
+ *
+ * A frame can not be decoded on its own: its main data may start up to
+ * 511 bytes back, in earlier frames, and the MDCT overlap and the
+ * synthesis filter carry over one granule.  So the decoder of a chunk
+ * starts at frame p and gets the frames up to g through
+ * lame_decoder_preroll().  From g on every frame gives its output, the
+ * ones before the first frame of the chunk, f, are dropped:
+ *
+ *      p ............ g ...... f ....................... next f
+ *      |   preroll    | dropped |          chunk          |
+ *
+ * g is one granule (one frame, or two at 576 samples per frame) before
+ * f.  p is far enough back to hold the main data of g and of all frames
+ * after it, and at least 194 bytes before g, which mpglib wants before
+ * it parses the first header.
+ *
+ * The first chunk starts where lame_decode_initfile() has found the
+ * stream, Xing frame and all, and the last one goes on to the end of the
+ * file, so whatever is left after the last frame is decoded as before.
+ * The chunks are only worth it for a clean stream: if the frame headers
+ * do not run on to the end of the file, or change the sample rate or
+ * channels on the way, decode_threads_open() leaves it all to the
+ * sequential decoder.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lame.h"
+#include "get_audio.h"
+#include "decode_threads.h"
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_PTHREAD_H) && defined(HAVE_MPGLIB)
+# include <pthread.h>
+# define DECODE_THREADS
+#endif
+
+#ifdef WITH_DMALLOC
+#include <dmalloc.h>
+#endif
+
+
+int     decode_threads = 0;
+
+
+#ifdef DECODE_THREADS
+
+/* bytes mpglib looks at for a Xing tag after a reset */
+#define DECODE_MIN_PREROLL  194
+
+/* the walk may stop this close to the end of the file, for an ID3v1
+   tag or a cut off frame */
+#define DECODE_MAX_TAIL     4096
+
+/* bytes fed to a decoder at a time */
+#define DECODE_FEED_BYTES   4096
+
+/* sync, version, layer and sample rate */
+#define DECODE_HEADER_MASK  0xfffe0c00UL
+
+#define DECODE_MAX_THREADS  64
+
+typedef struct {
+    int     n;                  /* samples per channel */
+    mp3data_struct mp3data;
+    short   pcm[2][1152];
+} dec_frame_t;
+
+typedef struct {
+    long    chunk;              /* the chunk in this slot */
+    int     done;               /* decoded, or given up */
+    int     error;              /* the decoder has failed in this chunk */
+    int     nframes, size, next;
+    dec_frame_t *frames;
+} dec_slot_t;
+
+typedef struct {
+    size_t  start;              /* first byte fed, frame p */
+    size_t  first;              /* frame g, the first one decoded */
+    size_t  end;                /* end of the chunk */
+    int     drop;               /* outputs before frame f */
+} dec_chunk_t;
+
+
+static unsigned char *dt_data;  /* the mapped file */
+static dec_chunk_t *dt_chunks;
+static long dt_nchunks;
+static int dt_downsample;       /* see lame_decode_downsample() */
+static dec_slot_t *dt_slots;
+static int dt_nslots;
+static long dt_next;            /* next chunk for a thread */
+static long dt_cur;             /* chunk being read, < dt_nchunks */
+static int dt_abort;
+static int dt_running;
+static int dt_nthreads;
+static pthread_t dt_threads[DECODE_MAX_THREADS];
+static pthread_mutex_t dt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dt_cond = PTHREAD_COND_INITIALIZER;
+
+
+static unsigned long
+header(const unsigned char *p)
+{
+    return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16)
+        | ((unsigned long) p[2] << 8) | p[3];
+}
+
+static int
+is_tag_frame(const unsigned char *p, int side)
+{
+    return 0 == memcmp(p + side, "Xing", 4) || 0 == memcmp(p + side, "Info", 4);
+}
+
+
+typedef struct {
+    size_t  offset;
+    long    data;               /* main data bytes before the frame */
+    int     mdb;                /* main_data_begin */
+} dec_walk_t;
+
+/*
+ * Walks the frame headers from sync_start and cuts the stream into
+ * chunks.  Returns the number of chunks, 0 if the stream is not clean
+ * or too short to be worth it.
+ */
+static long
+make_chunks(const unsigned char *buf, size_t len, size_t sync_start)
+{
+    dec_walk_t *w = NULL, *q;
+    long    nframes = 0, size = 0, nchunks = 0, f, g, p, j, m;
+    unsigned long head, head0 = 0;
+    size_t  pos = sync_start;
+    long    data = 0;
+    int     bytes, samples = 0, spf = 0, main_data_begin, side, gap;
+
+    /* the headers, until the first one that does not match */
+    while (pos + 8 <= len) {
+        bytes = lame_decode_frame_info(buf + pos, &samples, &main_data_begin, &side);
+        if (bytes == 0 || pos + bytes > len)
+            break;
+        head = header(buf + pos);
+        if (nframes == 0) {
+            head0 = head;
+            spf = samples;
+        }
+        else if ((head & DECODE_HEADER_MASK) != (head0 & DECODE_HEADER_MASK)
+                 || ((head >> 6 & 3) == 3) != ((head0 >> 6 & 3) == 3))
+            break;
+        if (nframes == size) {
+            size = size ? 2 * size : 4096;
+            if ((q = realloc(w, size * sizeof(*w))) == NULL) {
+                nframes = 0;
+                break;
+            }
+            w = q;
+        }
+        w[nframes].offset = pos;
+        w[nframes].data = data;
+        w[nframes].mdb = main_data_begin;
+        nframes++;
+        data += bytes - side;
+        pos += bytes;
+    }
+    if (nframes < 2 * DECODE_CHUNK_FRAMES || len - pos > DECODE_MAX_TAIL)
+        goto done;
+
+    dt_chunks = malloc((nframes / DECODE_CHUNK_FRAMES + 1) * sizeof(*dt_chunks));
+    if (dt_chunks == NULL)
+        goto done;
+    dt_chunks[0].start = dt_chunks[0].first = sync_start;
+    dt_chunks[0].drop = 0;
+    nchunks = 1;
+
+    gap = 1152 / spf;
+    for (f = DECODE_CHUNK_FRAMES; f + DECODE_CHUNK_FRAMES / 2 < nframes;
+         f += DECODE_CHUNK_FRAMES) {
+        /* the lowest main data byte used by g or any frame after it */
+        g = f - gap;
+        m = w[g].data - w[g].mdb;
+        for (j = g + 1; j < nframes && w[j].data - 511 < m; j++)
+            if (w[j].data - w[j].mdb < m)
+                m = w[j].data - w[j].mdb;
+        for (p = g; p > 0 && w[p].data > m; p--);
+        while (p > 0 && w[g].offset - w[p].offset < DECODE_MIN_PREROLL)
+            p--;
+        if (p > 0) {
+            lame_decode_frame_info(buf + w[p].offset, &samples, &main_data_begin, &side);
+            if (is_tag_frame(buf + w[p].offset, side))
+                p--;    /* would be skipped after the reset */
+        }
+        if (p <= 0 || w[p].data > m)
+            continue;   /* stays with the chunk before */
+        dt_chunks[nchunks - 1].end = w[f].offset;
+        dt_chunks[nchunks].start = w[p].offset;
+        dt_chunks[nchunks].first = w[g].offset;
+        dt_chunks[nchunks].drop = gap;
+        nchunks++;
+    }
+    dt_chunks[nchunks - 1].end = len;
+
+  done:
+    free(w);
+    return nchunks;
+}
+
+
+static void
+decode_chunk(const dec_chunk_t * c, dec_slot_t * s)
+{
+    lame_decoder_t *dec;
+    dec_frame_t *fr;
+    mp3data_struct mp3data;
+    short   pcm_l[1152], pcm_r[1152];
+    size_t  pos = c->first, n;
+    int     drop = c->drop, ret;
+
+    s->nframes = s->next = 0;
+    s->error = 0;
+    memset(&mp3data, 0, sizeof(mp3data));
+    if ((dec = lame_decoder_new()) == NULL) {
+        s->error = 1;
+        return;
+    }
+    lame_decoder_downsample(dec, dt_downsample);
+    if (c->first > c->start
+        && lame_decoder_preroll(dec, dt_data + c->start, c->first - c->start) < 0) {
+        lame_decoder_free(dec);
+        s->error = 1;
+        return;
+    }
+
+    /* what lame_decode_fromfile() does: the buffered frames first, then
+       more input, until there is neither */
+    for (;;) {
+        ret = lame_decoder_decode1_headers(dec, NULL, 0, pcm_l, pcm_r, &mp3data);
+        if (ret == 0) {
+            if (pos == c->end)
+                break;
+            n = c->end - pos < DECODE_FEED_BYTES ? c->end - pos : DECODE_FEED_BYTES;
+            ret = lame_decoder_decode1_headers(dec, dt_data + pos, (int) n,
+                                               pcm_l, pcm_r, &mp3data);
+            pos += n;
+        }
+        if (ret < 0) {
+            s->error = 1;
+            break;
+        }
+        if (ret == 0 || drop-- > 0)
+            continue;
+        if (s->nframes == s->size) {
+            fr = realloc(s->frames, (s->size + DECODE_CHUNK_FRAMES) * sizeof(*fr));
+            if (fr == NULL) {
+                s->error = 1;
+                break;
+            }
+            s->frames = fr;
+            s->size += DECODE_CHUNK_FRAMES;
+        }
+        fr = &s->frames[s->nframes++];
+        fr->n = ret;
+        fr->mp3data = mp3data;
+        memcpy(fr->pcm[0], pcm_l, ret * sizeof(short));
+        memcpy(fr->pcm[1], pcm_r, ret * sizeof(short));
+    }
+    lame_decoder_free(dec);
+}
+
+
+static void *
+decode_thread(void *arg)
+{
+    dec_slot_t *s;
+    long    k;
+
+    (void) arg;
+    pthread_mutex_lock(&dt_lock);
+    for (;;) {
+        /* the slot of chunk k is free once chunk k - dt_nslots is read */
+        while (!dt_abort && dt_next < dt_nchunks && dt_next - dt_cur >= dt_nslots)
+            pthread_cond_wait(&dt_cond, &dt_lock);
+        if (dt_abort || dt_next >= dt_nchunks)
+            break;
+        k = dt_next++;
+        s = &dt_slots[k % dt_nslots];
+        s->chunk = k;
+        s->done = 0;
+        pthread_mutex_unlock(&dt_lock);
+
+        decode_chunk(&dt_chunks[k], s);
+
+        pthread_mutex_lock(&dt_lock);
+        s->done = 1;
+        pthread_cond_broadcast(&dt_cond);
+    }
+    pthread_mutex_unlock(&dt_lock);
+    return NULL;
+}
+
+#endif /* DECODE_THREADS */
+
+
+
+/* starts decoding the file on decode_threads threads, from the first
+   header at byte sync_start.  returns 0 if it is left to the caller */
+int
+decode_threads_open(const char *inPath, long sync_start, int downsample)
+{
+#ifdef DECODE_THREADS
+    size_t  len;
+    int     i;
+
+    decode_threads_close();
+    if (decode_threads <= 1 || sync_start < 0 || strcmp(inPath, "-") == 0)
+        return 0;
+    dt_data = (unsigned char *) map_infile(inPath, &len);
+    if (dt_data == NULL)
+        return 0;
+    dt_nchunks = make_chunks(dt_data, len, (size_t) sync_start);
+    if (dt_nchunks < 2) {
+        decode_threads_close();
+        return 0;
+    }
+
+    dt_nthreads = decode_threads < DECODE_MAX_THREADS ? decode_threads : DECODE_MAX_THREADS;
+    dt_nslots = 2 * dt_nthreads;
+    dt_slots = calloc(dt_nslots, sizeof(*dt_slots));
+    if (dt_slots == NULL) {
+        decode_threads_close();
+        return 0;
+    }
+    for (i = 0; i < dt_nslots; i++)
+        dt_slots[i].chunk = -1;
+    dt_next = dt_cur = 0;
+    dt_abort = 0;
+    dt_downsample = downsample;
+    for (i = 0; i < dt_nthreads; i++)
+        if (pthread_create(&dt_threads[i], NULL, decode_thread, NULL) != 0)
+            break;
+    dt_nthreads = i;
+    if (dt_nthreads == 0) {
+        decode_threads_close();
+        return 0;
+    }
+    dt_running = 1;
+    return 1;
+#else
+    (void) inPath;
+    (void) sync_start;
+    return 0;
+#endif
+}
+
+
+/* same as lame_decode_fromfile():  -1 at the end, else the number of
+   samples output */
+int
+decode_threads_read(short pcm_l[], short pcm_r[], mp3data_struct * mp3data)
+{
+#ifdef DECODE_THREADS
+    dec_slot_t *s;
+    dec_frame_t *fr;
+
+    while (dt_running && dt_cur < dt_nchunks) {
+        s = &dt_slots[dt_cur % dt_nslots];
+        pthread_mutex_lock(&dt_lock);
+        while (s->chunk != dt_cur || !s->done)
+            pthread_cond_wait(&dt_cond, &dt_lock);
+        pthread_mutex_unlock(&dt_lock);
+
+        if (s->next < s->nframes) {
+            fr = &s->frames[s->next++];
+            memcpy(pcm_l, fr->pcm[0], fr->n * sizeof(short));
+            memcpy(pcm_r, fr->pcm[1], fr->n * sizeof(short));
+            mp3data->header_parsed = fr->mp3data.header_parsed;
+            mp3data->stereo = fr->mp3data.stereo;
+            mp3data->samplerate = fr->mp3data.samplerate;
+            mp3data->bitrate = fr->mp3data.bitrate;
+            mp3data->mode = fr->mp3data.mode;
+            mp3data->mode_ext = fr->mp3data.mode_ext;
+            mp3data->framesize = fr->mp3data.framesize;
+            return fr->n;
+        }
+        if (s->error)
+            break;      /* a sequential decoder would have stopped here */
+
+        pthread_mutex_lock(&dt_lock);
+        dt_cur++;
+        pthread_cond_broadcast(&dt_cond);
+        pthread_mutex_unlock(&dt_lock);
+    }
+    return -1;
+#else
+    (void) pcm_l;
+    (void) pcm_r;
+    (void) mp3data;
+    return -1;
+#endif
+}
+
+
+void
+decode_threads_close(void)
+{
+#ifdef DECODE_THREADS
+    int     i;
+
+    if (dt_running) {
+        pthread_mutex_lock(&dt_lock);
+        dt_abort = 1;
+        pthread_cond_broadcast(&dt_cond);
+        pthread_mutex_unlock(&dt_lock);
+        for (i = 0; i < dt_nthreads; i++)
+            pthread_join(dt_threads[i], NULL);
+        dt_running = 0;
+    }
+    if (dt_slots != NULL) {
+        for (i = 0; i < dt_nslots; i++)
+            free(dt_slots[i].frames);
+        free(dt_slots);
+        dt_slots = NULL;
+    }
+    free(dt_chunks);
+    dt_chunks = NULL;
+    dt_nchunks = 0;
+    if (dt_data != NULL) {
+        unmap_infile();
+        dt_data = NULL;
+    }
+#endif
+}
+
+/* end of decode_threads.c */
@@ -0,0 +1,37 @@
+/*
+ *	Frame parallel mp3 decoder include file
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_DECODE_THREADS_H
+#define LAME_DECODE_THREADS_H
+
+#include "lame.h"
+
+/* frames per chunk handed to a decoder thread */
+#define DECODE_CHUNK_FRAMES  256
+
+/* 0 or 1 decodes on the calling thread.  set by parse_args() */
+extern int decode_threads;
+
+extern int   decode_threads_open  ( const char* inPath, long sync_start,
+                                    int downsample );
+extern int   decode_threads_read  ( short pcm_l[], short pcm_r[],
+                                    mp3data_struct* mp3data );
+extern void  decode_threads_close ( void );
+
+#endif /* LAME_DECODE_THREADS_H */
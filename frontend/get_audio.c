@@ -56,6 +56,11 @@ char   *strchr(), *strrchr();
 #include <math.h>
 #include <sys/stat.h>
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+# include <sys/mman.h>
+# define PCM_MMAP
+#endif
+
 #ifdef __sun__
 /* woraround for SunOS 4.x, it has SEEK_* defined here */
 #include <unistd.h>
@@ -67,6 +72,7 @@ char   *strchr(), *strrchr();
 #include "portableio.h"
 #include "timestatus.h"
 #include "lametime.h"
+#include "decode_threads.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
@@ -92,6 +98,12 @@ int     lame_decode_initfile(FILE * fd, mp3data_struct * mp3data);
 int     lame_decode_fromfile(FILE * fd, short int pcm_l[], short int pcm_r[],
                              mp3data_struct * mp3data);
 
+#if defined(HAVE_MPGLIB)
+static long lame_decode_seekfile(FILE * fd, unsigned long sample);
+static long mp3_sync_start = -1;  /* file offset of the first header */
+static int mp3_threaded = 0;      /* decoded by decode_threads_read() */
+#endif
+
 
 static int read_samples_pcm(FILE * musicin, int sample_buffer[2304],
                             int frame_size, int samples_to_read);
@@ -185,9 +197,46 @@ init_infile(lame_global_flags * gfp, char *inPath)
 void
 close_infile(void)
 {
+#if defined(HAVE_MPGLIB)
+    if (mp3_threaded) {
+        decode_threads_close();
+        mp3_threaded = 0;
+    }
+#endif
     CloseSndFile(input_format, musicin);
 }
 
+/* positions an mp1/2/3 input so that the decoder output reaches sample
+ * number 'sample' soon.  returns how many of the samples decoded from
+ * there on come before it, or -1 if the input is not seekable, in which
+ * case decoding goes on from where it was */
+long
+seek_infile(unsigned long sample)
+{
+#if defined(HAVE_MPGLIB)
+    if (input_format == sf_mp1 || input_format == sf_mp2
+        || input_format == sf_mp3)
+        return lame_decode_seekfile(musicin, sample);
+#endif
+    return -1;
+}
+
+/* decodes an mp1/2/3 input on decode_threads threads, if it has not been
+ * read past the first frame yet.  returns 0 if it is decoded here */
+int
+thread_infile(const char *inPath)
+{
+#if defined(HAVE_MPGLIB)
+    if ((input_format == sf_mp1 || input_format == sf_mp2
+         || input_format == sf_mp3) && !mp3_threaded)
+        mp3_threaded = decode_threads_open(inPath, mp3_sync_start,
+                                           decode_downsample);
+    return mp3_threaded;
+#else
+    return 0;
+#endif
+}
+
 
 void
 SwapBytesInWords(short *ptr, int short_words)
@@ -350,9 +399,7 @@ get_audio_common( lame_global_flags * const gfp,
 		}
 	    } else if( num_channels == 1 ) {
 		memset( buffer[1], 0, samples_read * sizeof(int) );
-		for( i = samples_read; --i >= 0; ) {
- 		    buffer[0][i] = *--p;
-		}
+		memcpy( buffer[0], insamp, samples_read * sizeof(int) );
 	    } else
 		assert(0);
 	} else {		/* convert from int; output to 16-bit buffer */
@@ -406,9 +453,13 @@ read_samples_mp3(lame_global_flags * const gfp,
 #if defined(AMIGA_MPEGA)  ||  defined(HAVE_MPGLIB)
     static const char type_name[] = "MP3 file";
 
-    out =
-        lame_decode_fromfile(musicin, mpg123pcm[0], mpg123pcm[1],
-                             &mp3input_data);
+#if defined(HAVE_MPGLIB)
+    if (mp3_threaded)
+        out = decode_threads_read(mpg123pcm[0], mpg123pcm[1], &mp3input_data);
+    else
+#endif
+        out = lame_decode_fromfile(musicin, mpg123pcm[0], mpg123pcm[1],
+                                   &mp3input_data);
     /*
      * out < 0:  error, probably EOF
      * out = 0:  not possible with lame_decode_fromfile() ???
@@ -820,6 +871,96 @@ read_samples_pcm(FILE * const musicin, int sample_buffer[2304],
 
 
 
+/************************************************************************
+  PCM input buffer.  Regular files are mapped into memory if possible,
+  anything else (pipes, or when mmap fails) is read in large blocks.
+  The samples are unpacked from there, instead of one fread per frame.
+  The mapping covers the file as it was when it was opened.  Whatever
+  was appended since is read in blocks after the end of the mapping, but
+  truncating the file while it is read ends lame with SIGBUS.
+*/
+
+#define PCM_BLOCK_SIZE  (64*1024)
+
+static unsigned char pcm_block[PCM_BLOCK_SIZE];
+static const unsigned char *pcm_data; /* the mapped file or pcm_block */
+static size_t pcm_pos;                /* next byte to unpack */
+static size_t pcm_len;                /* end of the valid bytes */
+#ifdef PCM_MMAP
+static void  *pcm_map = NULL;
+static size_t pcm_map_len;
+#endif
+
+/* call with the file positioned at the first sample */
+static void
+pcm_input_init(FILE * pcm_in)
+{
+    pcm_data = pcm_block;
+    pcm_pos = pcm_len = 0;
+#ifdef PCM_MMAP
+    {
+        struct stat st;
+        long    start = ftell(pcm_in);
+        void   *p;
+
+        if (start < 0 || fstat(fileno(pcm_in), &st) != 0
+            || !S_ISREG(st.st_mode) || st.st_size <= start
+            || (off_t) (size_t) st.st_size != st.st_size)
+            return;
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(pcm_in), 0);
+        if (p == MAP_FAILED)
+            return;
+# ifdef MADV_SEQUENTIAL
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+# endif
+        pcm_map = p;
+        pcm_map_len = st.st_size;
+        pcm_data = p;
+        pcm_pos = start;
+        pcm_len = st.st_size;
+    }
+#endif
+}
+
+static void
+pcm_input_close(void)
+{
+#ifdef PCM_MMAP
+    if (pcm_map != NULL)
+        munmap(pcm_map, pcm_map_len);
+    pcm_map = NULL;
+#endif
+}
+
+/* returns the number of bytes available at pcm_data + pcm_pos,
+   at least n unless the input ends before */
+static size_t
+pcm_input_fill(FILE * pcm_in, size_t n)
+{
+    size_t  avail = pcm_len - pcm_pos;
+
+#ifdef PCM_MMAP
+    if (avail < n && pcm_data != pcm_block
+        && fseek(pcm_in, (long) pcm_len, SEEK_SET) == 0) {
+        /* end of the mapping, the file may have grown since */
+        memcpy(pcm_block, pcm_data + pcm_pos, avail);
+        pcm_input_close();
+        pcm_data = pcm_block;
+        pcm_pos = 0;
+        pcm_len = avail;
+    }
+#endif
+    if (avail < n && pcm_data == pcm_block) {
+        memmove(pcm_block, pcm_block + pcm_pos, avail);
+        pcm_pos = 0;
+        pcm_len = avail + fread(pcm_block + avail, 1, PCM_BLOCK_SIZE - avail,
+                                pcm_in);
+        avail = pcm_len;
+    }
+    return avail;
+}
+
+
 /************************************************************************
 unpack_read_samples - read and unpack signed low-to-high byte or unsigned
                       single byte input. (used for read_samples function)
@@ -838,36 +979,43 @@ unpack_read_samples( const int samples_to_read, const int bytes_per_sample,
 {
     int samples_read;
     int i;
-    int *op;			/* output pointer */
-    unsigned char *ip = (unsigned char *) sample_buffer; /* input pointer */
+    int *op = sample_buffer;	/* output pointer */
+    const unsigned char *ip;	/* input pointer */
     const int b = sizeof(int) * 8;
+    size_t avail;
 
+    /* forward loops from the input buffer to sample_buffer, which the
+       compiler can vectorize */
 #define GA_URS_IFLOOP( ga_urs_bps ) \
     if( bytes_per_sample == ga_urs_bps ) \
-	for( i = samples_read * bytes_per_sample; (i -= bytes_per_sample) >=0;)
-    
+	for( i = 0; i < samples_read; i++ )
+#define U(x)  ((unsigned int) (x))
 
-    samples_read = fread( sample_buffer, bytes_per_sample, 
-			  samples_to_read, pcm_in);
-    op = sample_buffer + samples_read;
+    avail = pcm_input_fill(pcm_in, (size_t) samples_to_read * bytes_per_sample);
+    samples_read = samples_to_read;
+    if (avail / bytes_per_sample < (size_t) samples_to_read)
+        samples_read = avail / bytes_per_sample;
+    ip = pcm_data + pcm_pos;
+    pcm_pos += (size_t) samples_read * bytes_per_sample;
 
     GA_URS_IFLOOP( 1 )
-	*--op = (ip[i] ^ 0x80)<<(b-8) | 0x7f<<(b-16);/* convert from unsigned*/
+	op[i] = U(ip[i] ^ 0x80)<<(b-8) | U(0x7f)<<(b-16);/* convert from unsigned*/
     if( swap_order == 0 ) {
 	GA_URS_IFLOOP( 2 )
-	    *--op = ip[i]<<(b-16) | ip[i+1]<<(b-8); 
+	    op[i] = U(ip[2*i])<<(b-16) | U(ip[2*i+1])<<(b-8);
 	GA_URS_IFLOOP( 3 )
-	    *--op = ip[i]<<(b-24) | ip[i+1]<<(b-16) | ip[i+2]<<(b-8);
+	    op[i] = U(ip[3*i])<<(b-24) | U(ip[3*i+1])<<(b-16) | U(ip[3*i+2])<<(b-8);
 	GA_URS_IFLOOP( 4 )
-	    *--op = ip[i]<<(b-32) | ip[i+1]<<(b-24) | ip[i+2]<<(b-16) | ip[i+3] << (b-8);
+	    op[i] = U(ip[4*i])<<(b-32) | U(ip[4*i+1])<<(b-24) | U(ip[4*i+2])<<(b-16) | U(ip[4*i+3])<<(b-8);
     } else {
 	GA_URS_IFLOOP( 2 )
-	    *--op = ip[i]<<(b-8) | ip[i+1]<<(b-16); 
+	    op[i] = U(ip[2*i])<<(b-8) | U(ip[2*i+1])<<(b-16);
 	GA_URS_IFLOOP( 3 )
-	    *--op = ip[i]<<(b-8) | ip[i+1]<<(b-16) | ip[i+2]<<(b-24);
+	    op[i] = U(ip[3*i])<<(b-8) | U(ip[3*i+1])<<(b-16) | U(ip[3*i+2])<<(b-24);
 	GA_URS_IFLOOP( 4 )
-	    *--op = ip[i]<<(b-8) | ip[i+1]<<(b-16) | ip[i+2]<<(b-24) | ip[i+3]<<(b-32);
+	    op[i] = U(ip[4*i])<<(b-8) | U(ip[4*i+1])<<(b-16) | U(ip[4*i+2])<<(b-24) | U(ip[4*i+3])<<(b-32);
     }
+#undef U
 #undef GA_URS_IFLOOP
     return( samples_read );
 }
@@ -1242,6 +1390,7 @@ parse_file_header(lame_global_flags * gfp, FILE * sf)
 void
 CloseSndFile(sound_file_format input, FILE * musicin)
 {
+    pcm_input_close();
     if (fclose(musicin) != 0) {
         fprintf(stderr, "Could not close audio input file\n");
         exit(2);
@@ -1314,6 +1463,7 @@ OpenSndFile(lame_global_flags * gfp, char *inPath)
                 fprintf(stderr, "\n");
             pcmswapbytes = swapbytes;
         }
+        pcm_input_init(musicin);
     }
 
 
@@ -1351,6 +1501,10 @@ OpenSndFile(lame_global_flags * gfp, char *inPath)
 
 
 #if defined(HAVE_MPGLIB)
+
+/* file offset of the first audio frame, -1 if unknown */
+static long mp3_first_frame = -1;
+
 static int
 check_aid(const unsigned char *header)
 {
@@ -1408,9 +1562,12 @@ lame_decode_initfile(FILE * fd, mp3data_struct * mp3data)
     int     len, aid_header;
     short int pcm_l[1152], pcm_r[1152];
     int freeformat = 0;
+    int     first_bytes, samples, mdb, side;
+    long    pos;
 
     memset(mp3data, 0, sizeof(mp3data_struct));
     lame_decode_init();
+    lame_decode_downsample(decode_downsample);
 
     len = 4;
     if (fread(buf, 1, len, fd) != len)
@@ -1459,6 +1616,10 @@ lame_decode_initfile(FILE * fd, mp3data_struct * mp3data)
 	fprintf(stderr,"Input file is freeformat.\n");
 	freeformat = 1;
     }
+    pos = ftell(fd);
+    mp3_first_frame = pos < 0 ? -1 : pos - len;
+    mp3_sync_start = mp3_first_frame;
+    first_bytes = lame_decode_frame_info(buf, &samples, &mdb, &side);
 
     /* now parse the current buffer looking for MP3 headers.    */
     /* (as of 11/00: mpglib modified so that for the first frame where  */
@@ -1488,6 +1649,8 @@ lame_decode_initfile(FILE * fd, mp3data_struct * mp3data)
 
     if (mp3data->totalframes > 0) {
         /* mpglib found a Xing VBR header and computed nsamp & totalframes */
+        if (mp3_first_frame >= 0)
+            mp3_first_frame += first_bytes; /* the tag frame is not audio */
     }
     else {
 	/* set as unknown.  Later, we will take a guess based on file size
@@ -1555,6 +1718,181 @@ lame_decode_fromfile(FILE * fd, short pcm_l[], short pcm_r[],
     }
     return ret;
 }
+
+
+/* frames kept for the walk back over main_data_begin.  A frame can carry
+   as little as 1 byte of main data (MPEG-2 8 kbps stereo with CRC), so
+   main_data_begin 255 reaches 255 frames back, then a few more frames
+   for SEEK_MIN_BYTES.  MPEG-1 frames carry at least 58 bytes, so its
+   511 bytes need fewer */
+#define SEEK_BACK_FRAMES 512
+
+/* after a reset, mpglib wants this many bytes before the first frame
+   is parsed, to look for a Xing tag */
+#define SEEK_MIN_BYTES 194
+
+/*
+ * Walks the frame headers from the first frame, no decoding, up to the
+ * frame two granules before 'sample', so the synthesis and the MDCT
+ * overlap are right when the decoder gets there.  Its main data starts
+ * main_data_begin bytes before the end of its side info, which may be
+ * several frames back.  The decoder is reset and gets the frames from
+ * there on through lame_decode_preroll(), so the output starts exactly
+ * at that frame, and is the same as that of a full decode.
+ *
+ * The Xing TOC only gives byte positions in 1/256 steps of the file,
+ * not frame numbers, so it is of no use here.
+ */
+static long
+lame_decode_seekfile(FILE * fd, unsigned long sample)
+{
+    unsigned char buf[1024];
+    long    offset[SEEK_BACK_FRAMES];
+    int     data[SEEK_BACK_FRAMES];
+    long    start, pos;
+    unsigned long frame, last = 0, p;
+    int     bytes, samples = 0, mdb, side, need, i, n;
+
+    start = ftell(fd);
+    if (mp3_first_frame < 0 || start < 0)
+        return -1;
+    if (fseek(fd, mp3_first_frame, SEEK_SET) != 0)
+        return -1;
+
+    pos = mp3_first_frame;
+    for (frame = 0; ; frame++) {
+        i = frame % SEEK_BACK_FRAMES;
+        if (fread(buf, 1, 8, fd) != 8)
+            break;
+        bytes = lame_decode_frame_info(buf, &samples, &mdb, &side);
+        if (bytes == 0)
+            break;      /* free format, or the stream ends */
+        if (frame == 0) {
+            if (sample < 1152 + (unsigned long) samples)
+                break;  /* nothing to skip */
+            last = (sample - 1152) / samples;
+        }
+        offset[i] = pos;
+        data[i] = bytes - side;
+        if (frame == last) {
+            /* back to the frame with the start of the main data */
+            need = mdb;
+            p = frame;
+            while ((need > 0 || pos - offset[p % SEEK_BACK_FRAMES] < SEEK_MIN_BYTES)
+                   && p > 0 && frame - p < SEEK_BACK_FRAMES - 1) {
+                --p;
+                need -= data[p % SEEK_BACK_FRAMES];
+            }
+            if (need > 0 || pos - offset[p % SEEK_BACK_FRAMES] < SEEK_MIN_BYTES
+                || fseek(fd, offset[p % SEEK_BACK_FRAMES], SEEK_SET) != 0)
+                break;
+            lame_decode_reset();
+            for (pos -= offset[p % SEEK_BACK_FRAMES]; pos > 0; pos -= n) {
+                n = pos < (long) sizeof(buf) ? pos : (long) sizeof(buf);
+                if (fread(buf, 1, n, fd) != n || lame_decode_preroll(buf, n) < 0)
+                    return -1;
+            }
+            return sample - frame * samples;
+        }
+        pos += bytes;
+        if (fseek(fd, pos, SEEK_SET) != 0)
+            break;
+    }
+
+    /* decode from where we were */
+    fseek(fd, start, SEEK_SET);
+    return -1;
+}
+
+
+/************************************************************************
+  The whole of an mp3 file, for lame_decode_scan().  Regular files are
+  mapped into memory, anything else is read.  Returns NULL if the file
+  cannot be opened or read.  The data ends where the file ended when it
+  was opened; truncating the file while it is mapped ends lame with
+  SIGBUS.
+*/
+
+#define MAP_BLOCK_SIZE  (1024*1024)
+
+static unsigned char *map_data = NULL;
+static size_t map_len;
+static int map_mapped;
+
+const unsigned char *
+map_infile(const char *inPath, size_t * len)
+{
+    FILE   *fd;
+    unsigned char *p;
+    size_t  size = 0, n;
+
+    unmap_infile();
+    fd = strcmp(inPath, "-") ? fopen(inPath, "rb") : stdin;
+    if (fd == NULL)
+        return NULL;
+    map_len = 0;
+#ifdef PCM_MMAP
+    {
+        struct stat st;
+        void   *m;
+
+        if (fstat(fileno(fd), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+            && (off_t) (size_t) st.st_size == st.st_size) {
+            m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fd), 0);
+            if (m != MAP_FAILED) {
+# ifdef MADV_SEQUENTIAL
+                madvise(m, st.st_size, MADV_SEQUENTIAL);
+# endif
+                map_data = m;
+                map_len = st.st_size;
+                map_mapped = 1;
+            }
+        }
+    }
+#endif
+    if (map_data == NULL) {
+        /* a pipe, or mmap failed */
+        for (;;) {
+            if (map_len == size) {
+                size = size ? 2 * size : MAP_BLOCK_SIZE;
+                if ((p = realloc(map_data, size)) == NULL)
+                    break;
+                map_data = p;
+            }
+            n = fread(map_data + map_len, 1, size - map_len, fd);
+            if (n == 0)
+                break;
+            map_len += n;
+        }
+        if (map_len == size || ferror(fd))
+            unmap_infile();
+    }
+    if (fd != stdin)
+        fclose(fd);
+    *len = map_len;
+    return map_data;
+}
+
+void
+unmap_infile(void)
+{
+#ifdef PCM_MMAP
+    if (map_mapped && map_data != NULL)
+        munmap(map_data, map_len);
+    else
+#endif
+        free(map_data);
+    map_data = NULL;
+    map_mapped = 0;
+}
+
+/* file offset of the first audio frame of the mp3 input, past a Xing or
+ * Info tag, -1 if unknown */
+long
+infile_first_frame(void)
+{
+    return mp3_first_frame;
+}
 #endif /* defined(HAVE_MPGLIB) */
 
 /* end of get_audio.c */
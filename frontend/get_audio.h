@@ -42,6 +42,11 @@ typedef enum sound_file_format_e {
 FILE *init_outfile ( char *outPath, int decode );
 void init_infile(lame_global_flags *, char *inPath);
 void close_infile(void);
+long seek_infile(unsigned long sample);
+int thread_infile(const char *inPath);
+const unsigned char *map_infile(const char *inPath, size_t *len);
+void unmap_infile(void);
+long infile_first_frame(void);
 int get_audio(lame_global_flags * const gfp, int buffer[2][1152]);
 int get_audio16(lame_global_flags * const gfp, short buffer[2][1152]);
 int WriteWaveHeader(FILE * const fp, const int pcmbytes,
@@ -61,6 +66,11 @@ int WriteWaveHeader(FILE * const fp, const int pcmbytes,
 */
 int lame_decoder(lame_global_flags *gfp,FILE *outf,int skip, char *inPath, char *outPath);
 
+/* --scan: checks the frame headers and CRCs of an mp3 file without
+ * decoding it, and prints its length and bitrates.  returns 0 if no
+ * errors were found */
+int lame_scanner(char *inPath);
+
 
 
 void SwapBytesInWords( short *loc, int words );
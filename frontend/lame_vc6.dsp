@@ -118,6 +118,10 @@ SOURCE=.\brhist.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\decode_threads.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\get_audio.c
 # End Source File
 # Begin Source File
@@ -134,6 +138,10 @@ SOURCE=.\parse.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\pipeline.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\portableio.c
 # End Source File
 # Begin Source File
@@ -150,6 +158,10 @@ SOURCE=.\brhist.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\decode_threads.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\get_audio.h
 # End Source File
 # Begin Source File
@@ -166,6 +178,10 @@ SOURCE=.\parse.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\pipeline.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\portableio.h
 # End Source File
 # Begin Source File
@@ -69,6 +69,7 @@ char   *strchr(), *strrchr();
 #include "parse.h"
 #include "main.h"
 #include "get_audio.h"
+#include "pipeline.h"
 #include "portableio.h"
 #include "timestatus.h"
 
@@ -174,11 +175,16 @@ int
 lame_decoder(lame_global_flags * gfp, FILE * outf, int skip, char *inPath,
              char *outPath)
 {
-    short int Buffer[2][1152];
+    short   (*Buffer)[1152];
     int     iread;
     double  wavsize;
-    int     i;
-    void    (*WriteFunction) (FILE * fp, char *p, int n);
+    int     i, n;
+    long    start, remaining;
+    int     framenum = 0;
+    mp3data_struct mp3data;
+    unsigned char *wav, *p;
+    size_t  size;
+    int     swap;
     int tmp_num_channels = lame_get_num_channels( gfp );
 
 
@@ -250,41 +256,75 @@ lame_decoder(lame_global_flags * gfp, FILE * outf, int skip, char *inPath,
 		    skip);
     }
 
+    /* --skip-to: let the input seek close to the start, and drop the
+       samples decoded before it.  --duration: stop after 'remaining' */
+    if (decode_skip_to > 0) {
+        start = skip + (long) (decode_skip_to * lame_get_in_samplerate(gfp) + .5)
+            * decode_downsample;
+        n = seek_infile(start);
+        skip = n < 0 ? start : n;
+    }
+    else
+        thread_infile(inPath);
+    /* the delays and the seek are in samples of the mp3 stream, at a
+       reduced rate every decode_downsample-th is output */
+    skip = (skip + decode_downsample / 2) / decode_downsample;
+    remaining = -1;
+    if (decode_duration > 0)
+        remaining = (long) (decode_duration * lame_get_in_samplerate(gfp) + .5);
+
     if ( 0 == disable_wav_header )
         WriteWaveHeader(outf, 0x7FFFFFFF, lame_get_in_samplerate( gfp ),
                         tmp_num_channels,
                         16);
     /* unknown size, so write maximum 32 bit signed value */
 
-    wavsize = -skip;
-    WriteFunction = swapbytes ? WriteBytesSwapped : WriteBytes;
+    wavsize = 0;
     mp3input_data.totalframes = mp3input_data.nsamp / mp3input_data.framesize;
 
+    /* the WAV data is little endian, raw output has the host byte order
+       unless swapbytes is set */
+    if ( disable_wav_header ) {
+        const short one = 1;
+        swap = (*(const char *) &one == 1) == (swapbytes != 0);
+    }
+    else
+        swap = 0;
+
     assert(tmp_num_channels >= 1 && tmp_num_channels <= 2);
 
+    pipeline_open(gfp, outf, 1);
     do {
-        iread = get_audio16(gfp, Buffer); /* read in 'iread' samples */
-        mp3input_data.framenum += iread / mp3input_data.framesize;
-        wavsize += iread;
+        iread = pipeline_read((void **) &Buffer, &mp3data); /* read in 'iread' samples */
+        framenum += iread / mp3data.framesize;
+        mp3data.framenum = framenum;
 
         if (silent <= 0)
-            decoder_progress(gfp, &mp3input_data);
+            decoder_progress(gfp, &mp3data);
 
         skip -= (i = skip < iread ? skip : iread); /* 'i' samples are to skip in this frame */
-
-        for (; i < iread; i++) {
-            if ( disable_wav_header ) {
-                WriteFunction(outf, (char *) &Buffer[0][i], sizeof(short));
-                if (tmp_num_channels == 2)
-                    WriteFunction(outf, (char *) &Buffer[1][i], sizeof(short));
-            }
-            else {
-                Write16BitsLowHigh(outf, Buffer[0][i]);
-                if (tmp_num_channels == 2)
-                    Write16BitsLowHigh(outf, Buffer[1][i]);
+        n = iread;
+        if (remaining >= 0) {
+            if (n - i > remaining)
+                n = i + remaining;
+            remaining -= n - i;
+        }
+        wavsize += n - i;
+
+        p = wav = pipeline_out(&size);
+        for (; i < n; i++) {
+            int     ch;
+            for (ch = 0; ch < tmp_num_channels; ch++) {
+                int     x = Buffer[ch][i];
+                p[swap]     = x & 0xff;
+                p[1 - swap] = (x >> 8) & 0xff;
+                p += 2;
             }
         }
-    } while (iread);
+        pipeline_write(p - wav);
+    } while (iread && remaining != 0);
+    pipeline_close();
+    close_infile();
 
     i = (16 / 8) * tmp_num_channels;
     assert(i > 0);
@@ -313,6 +353,84 @@ lame_decoder(lame_global_flags * gfp, FILE * outf, int skip, char *inPath,
 
 
 
+#ifdef HAVE_MPGLIB
+/* --scan: hops from frame to frame through the whole file, without
+ * decoding, and prints the length, the bitrates and every error found */
+int
+lame_scanner(char *inPath)
+{
+    const unsigned char *buf;
+    const char *name = strcmp(inPath, "-") ? inPath : "<stdin>";
+    size_t  len, pos = 0;
+    mp3scan_struct scan;
+    unsigned long bad = 0;
+    double  kbps = 0;
+    int     ret, errors = 0, i;
+
+    if ((buf = map_infile(inPath, &len)) == NULL) {
+        fprintf(stderr, "%s: can't read file\n", name);
+        return 1;
+    }
+    while ((ret = lame_decode_scan(buf, len, &pos, &scan)) != LAME_SCAN_END) {
+        errors++;
+        if (silent >= 10)
+            continue;
+        printf("%s: offset %lu: ", name, (unsigned long) scan.error_pos);
+        switch (ret) {
+        case LAME_SCAN_LOST_SYNC:
+            printf("lost sync, %lu bytes skipped\n", scan.bad_bytes - bad);
+            break;
+        case LAME_SCAN_CRC_ERROR:
+            printf("CRC error\n");
+            break;
+        case LAME_SCAN_TRUNCATED:
+            printf("truncated frame\n");
+            break;
+        }
+        bad = scan.bad_bytes;
+    }
+    unmap_infile();
+
+    if (scan.frames == 0) {
+        if (silent < 10)
+            printf("%s: no MPEG audio frames found\n", name);
+        return 1;
+    }
+    if (scan.tag_frames >= 0 && (unsigned long) scan.tag_frames != scan.frames) {
+        errors++;
+        if (silent < 10)
+            printf("%s: Xing/Info tag says %ld frames\n", name, scan.tag_frames);
+    }
+
+    for (i = 0; i < 16; i++)
+        kbps += (double) scan.bitrate_frames[i] * scan.bitrate_kbps[i];
+    kbps /= scan.frames;
+    if (silent < 10) {
+        printf("%s: MPEG-%u%s Layer %s, %g kHz, %d channel%s, %lu frames, "
+               "%lu samples, %.3f s, %.1f kbps",
+               name, 2 - (scan.version & 1), scan.version == 2 ? ".5" : "",
+               scan.layer == 1 ? "I" : scan.layer == 2 ? "II" : "III",
+               scan.samplerate / 1.e3, scan.stereo, scan.stereo != 1 ? "s" : "",
+               scan.frames, scan.nsamp, (double) scan.nsamp / scan.samplerate, kbps);
+        if (scan.enc_delay >= 0)
+            printf(", delay %d, padding %d", scan.enc_delay, scan.enc_padding);
+        printf("\n");
+    }
+    if (silent <= 0)
+        for (i = 0; i < 16; i++)
+            if (scan.bitrate_frames[i] > 0)
+                printf("%s: %3d kbps: %lu frames (%.1f%%)\n", name,
+                       scan.bitrate_kbps[i], scan.bitrate_frames[i],
+                       100. * scan.bitrate_frames[i] / scan.frames);
+    if (errors > 0 && silent < 10)
+        printf("%s: %d error%s, %lu bytes skipped, %lu CRC errors\n", name,
+               errors, errors != 1 ? "s" : "", scan.bad_bytes, scan.crc_errors);
+    return errors > 0;
+}
+#endif
+
+
+
 
 
 
@@ -330,8 +448,9 @@ int
 lame_encoder(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
              char *outPath)
 {
-    unsigned char mp3buffer[LAME_MAXMP3BUFFER];
-    int     Buffer[2][1152];
+    unsigned char *mp3buffer;
+    size_t  mp3buffer_size;
+    int     (*Buffer)[1152];
     int     iread, imp3;
     static const char *mode_names[2][4] = {
         {"stereo", "j-stereo", "dual-ch", "single-ch"},
@@ -385,9 +504,10 @@ lame_encoder(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
 
 
     /* encode until we hit eof */
+    pipeline_open(gf, outf, 0);
     do {
         /* read in 'iread' samples */
-        iread = get_audio(gf, Buffer);
+        iread = pipeline_read((void **) &Buffer, NULL);
         frames = lame_get_frameNum(gf);
 
 
@@ -414,8 +534,9 @@ lame_encoder(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
         }
 
         /* encode */
+        mp3buffer = pipeline_out(&mp3buffer_size);
         imp3 = lame_encode_buffer_int(gf, Buffer[0], Buffer[1], iread,
-                                      mp3buffer, sizeof(mp3buffer));
+                                      mp3buffer, mp3buffer_size);
 
         /* was our output buffer big enough? */
         if (imp3 < 0) {
@@ -423,26 +544,30 @@ lame_encoder(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
                 fprintf(stderr, "mp3 buffer is not big enough... \n");
             else
                 fprintf(stderr, "mp3 internal error:  error code=%i\n", imp3);
+            pipeline_close();
             return 1;
         }
 
-        if (fwrite(mp3buffer, 1, imp3, outf) != imp3) {
+        if (pipeline_write(imp3) != 0) {
             fprintf(stderr, "Error writing mp3 output \n");
+            pipeline_close();
             return 1;
         }
 
     } while (iread);
 
+    mp3buffer = pipeline_out(&mp3buffer_size);
     if (nogap) 
-        imp3 = lame_encode_flush_nogap(gf, mp3buffer, sizeof(mp3buffer)); /* may return one more mp3 frame */
+        imp3 = lame_encode_flush_nogap(gf, mp3buffer, mp3buffer_size); /* may return one more mp3 frame */
     else
-        imp3 = lame_encode_flush(gf, mp3buffer, sizeof(mp3buffer)); /* may return one more mp3 frame */
+        imp3 = lame_encode_flush(gf, mp3buffer, mp3buffer_size); /* may return one more mp3 frame */
 
     if (imp3 < 0) {
         if (imp3 == -1)
             fprintf(stderr, "mp3 buffer is not big enough... \n");
         else
             fprintf(stderr, "mp3 internal error:  error code=%i\n", imp3);
+        pipeline_close();
         return 1;
 
     }
@@ -462,7 +587,11 @@ lame_encoder(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
         timestatus_finish();
     }
 
-    fwrite(mp3buffer, 1, imp3, outf);
+    pipeline_write(imp3);
+    if (pipeline_close() != 0) {
+        fprintf(stderr, "Error writing mp3 output \n");
+        return 1;
+    }
 
     return 0;
 }
@@ -470,6 +599,93 @@ lame_encoder(lame_global_flags * gf, FILE * outf, int nogap, char *inPath,
 
 
 
+#ifdef HAVE_MPGLIB
+/* --transcode-fast: the mp3 input is decoded only as far as its MDCT
+ * coefficients, which are quantized again for the output.  Frame n of
+ * the output holds the samples of frame n of the input */
+int
+lame_transcoder(lame_global_flags * gf, FILE * outf, char *inPath)
+{
+    static unsigned char mp3buffer[LAME_MAXMP3BUFFER];
+    static mp3spectrum_struct spec;
+    const unsigned char *buf;
+    lame_decoder_t *dec;
+    size_t  len, pos;
+    long    start;
+    int     ret, imp3, frames = 0, err = 0;
+
+    start = infile_first_frame();
+    if (start < 0 || (buf = map_infile(inPath, &len)) == NULL) {
+        fprintf(stderr, "%s: can't read file\n", inPath);
+        return 1;
+    }
+    if ((dec = lame_decoder_new()) == NULL) {
+        fprintf(stderr, "fatal error during initialization\n");
+        unmap_infile();
+        return 1;
+    }
+    if (silent < 10) {
+        lame_print_config(gf);
+        fprintf(stderr, "Transcoding %s to %g kHz %d kbps MPEG-%u Layer III\n",
+                inPath, 1.e-3 * lame_get_out_samplerate(gf),
+                lame_get_VBR(gf) == vbr_off ? lame_get_brate(gf)
+                : lame_get_VBR_mean_bitrate_kbps(gf),
+                2 - lame_get_version(gf));
+    }
+
+    for (pos = start; pos < len && !err;) {
+        int     n = len - pos < 4096 ? len - pos : 4096;
+
+        /* -1 is a broken frame, mpglib finds the next one */
+        ret = lame_decoder_spectrum(dec, (unsigned char *) buf + pos, n, &spec);
+        pos += n;
+        while (ret > 0) {
+            imp3 = lame_encode_spectrum(gf, &spec, mp3buffer, sizeof(mp3buffer));
+            if (imp3 < 0) {
+                if (imp3 == -5)
+                    fprintf(stderr, "%s: the input changes its sample rate "
+                            "or channels\n", inPath);
+                else
+                    fprintf(stderr, "mp3 internal error:  error code=%i\n", imp3);
+                err = 1;
+                break;
+            }
+            if (fwrite(mp3buffer, 1, imp3, outf) != (size_t) imp3) {
+                fprintf(stderr, "Error writing mp3 output \n");
+                err = 1;
+                break;
+            }
+            if (silent <= 0 && ++frames % 50 == 0)
+                timestatus(lame_get_out_samplerate(gf), frames,
+                           lame_get_totalframes(gf), lame_get_framesize(gf));
+            ret = lame_decoder_spectrum(dec, NULL, 0, &spec);
+        }
+    }
+    lame_decoder_free(dec);
+    unmap_infile();
+    if (err)
+        return 1;
+
+    imp3 = lame_encode_flush(gf, mp3buffer, sizeof(mp3buffer));
+    if (imp3 < 0 || fwrite(mp3buffer, 1, imp3, outf) != (size_t) imp3) {
+        fprintf(stderr, "Error writing mp3 output \n");
+        return 1;
+    }
+    /* the LAME tag gets the timing of the input, if it had a tag */
+    if (enc_delay >= 0)
+        lame_set_encoder_delay_padding(gf, enc_delay, enc_padding);
+    else
+        lame_set_encoder_delay_padding(gf, lame_get_encoder_delay(gf), 0);
+    if (silent <= 0) {
+        timestatus(lame_get_out_samplerate(gf), frames,
+                   lame_get_totalframes(gf), lame_get_framesize(gf));
+        timestatus_finish();
+    }
+    return 0;
+}
+#endif
+
+
 
 
 void
@@ -578,6 +794,201 @@ void print_lame_tag_leading_info(lame_global_flags *gf) {
       printf("Writing LAME Tag...");
 }
 
+/* writes the index asked for with --seek-index next to the mp3 file */
+void write_seek_index(lame_global_flags *gf, const char *outPath)
+{
+    char    idxPath[PATH_MAX + 5];
+    unsigned char *buf;
+    size_t  n;
+    FILE   *fp;
+
+    n = lame_get_seek_index(gf, NULL, 0);
+    if (n == 0)
+        return;
+    if (strcmp(outPath, "-") == 0) {
+        if (silent < 10) fprintf(stderr, "Warning: no seek index when writing to stdout\n");
+        return;
+    }
+    buf = malloc(n);
+    if (buf == NULL) {
+        fprintf(stderr, "Error: can't allocate seek index buffer\n");
+        return;
+    }
+    lame_get_seek_index(gf, buf, n);
+    sprintf(idxPath, "%s.idx", outPath);
+    if ((fp = fopen(idxPath, "wb")) == NULL || fwrite(buf, 1, n, fp) != n)
+        fprintf(stderr, "Error writing seek index %s\n", idxPath);
+    if (fp != NULL)
+        fclose(fp);
+    free(buf);
+}
+
+/* lists the segments asked for with --segment next to the mp3 file:
+   segment, first frame (the Xing/Info tag frame not counted) and
+   the samples to drop after the decoder delay */
+void write_segment_list(lame_global_flags *gf, const char *outPath)
+{
+    char    segPath[PATH_MAX + 5];
+    unsigned long frame;
+    int     s, priming;
+    FILE   *fp;
+
+    if (lame_get_segment_interval(gf) <= 0)
+        return;
+    if (strcmp(outPath, "-") == 0) {
+        if (silent < 10) fprintf(stderr, "Warning: no segment list when writing to stdout\n");
+        return;
+    }
+    sprintf(segPath, "%s.seg", outPath);
+    if ((fp = fopen(segPath, "w")) == NULL) {
+        fprintf(stderr, "Error writing segment list %s\n", segPath);
+        return;
+    }
+    for (s = 0; lame_get_segment_start(gf, s, &frame, &priming) == 0; s++)
+        fprintf(fp, "%d %lu %d\n", s, frame, priming);
+    fclose(fp);
+}
+
+#ifdef HAVE_MPGLIB
+/* splits "file@from-to" at the last '@', seconds as from-to, from-, from
+ * or -to.  A name without a valid range is left alone */
+static int
+splice_range(char *arg, double *from, double *to)
+{
+    char   *at = strrchr(arg, '@'), *p, *q;
+
+    *from = *to = 0;
+    if (at == NULL || at[1] == '\0')
+        return 0;
+    p = at + 1;
+    if (*p != '-') {
+        *from = strtod(p, &q);
+        if (q == p || *from < 0)
+            return 0;
+        p = q;
+    }
+    if (*p == '-' && p[1] != '\0') {
+        *to = strtod(p + 1, &q);
+        if (q == p + 1 || *to <= 0)
+            return 0;
+        p = q;
+    }
+    else if (*p == '-')
+        p++;
+    if (*p != '\0')
+        return 0;
+    *at = '\0';
+    return 1;
+}
+
+/* --splice: the pieces of mp3 files named by inPath, joined in outPath.
+ * Only the frames around the cuts are encoded again, see lame_splice() */
+int
+lame_splicer(lame_global_flags * gf, char *outPath, char **inPath, int n)
+{
+    lame_splice_segment *seg;
+    mp3scan_struct scan;
+    const unsigned char *buf;
+    unsigned char *copy;
+    double  from, to;
+    size_t  len, pos;
+    FILE   *outf;
+    int     i, j, ret = 1;
+
+    if (n <= 0) {
+        fprintf(stderr, "--splice: no input files\n");
+        return 1;
+    }
+    if ((seg = calloc(n, sizeof(*seg))) == NULL) {
+        fprintf(stderr, "fatal error during initialization\n");
+        return 1;
+    }
+    for (i = 0; i < n; i++) {
+        splice_range(inPath[i], &from, &to);
+        for (j = 0; j < i; j++)
+            if (strcmp(inPath[i], inPath[j]) == 0)
+                break;
+        if (j < i) {
+            seg[i].mp3 = seg[j].mp3;
+            seg[i].size = seg[j].size;
+        }
+        else {
+            /* only one file can be mapped at a time */
+            if ((buf = map_infile(inPath[i], &len)) == NULL) {
+                fprintf(stderr, "%s: can't read file\n", inPath[i]);
+                goto done;
+            }
+            if ((copy = malloc(len > 0 ? len : 1)) == NULL) {
+                fprintf(stderr, "%s: file too large\n", inPath[i]);
+                unmap_infile();
+                goto done;
+            }
+            memcpy(copy, buf, len);
+            unmap_infile();
+            seg[i].mp3 = copy;
+            seg[i].size = len;
+        }
+        /* for the sample rate.  lame_splice() rejects broken files */
+        pos = 0;
+        while (lame_decode_scan(seg[i].mp3, seg[i].size, &pos, &scan) != LAME_SCAN_END)
+            continue;
+        if (scan.frames == 0) {
+            fprintf(stderr, "%s: no MPEG audio frames found\n", inPath[i]);
+            goto done;
+        }
+        seg[i].begin = (unsigned long) (from * scan.samplerate + .5);
+        seg[i].end = (unsigned long) (to * scan.samplerate + .5);
+    }
+
+    if ((outf = init_outfile(outPath, 0)) == NULL) {
+        fprintf(stderr, "Can't init outfile '%s'\n", outPath);
+        goto done;
+    }
+    if (strcmp(outPath, "-") == 0)
+        (void) lame_set_bWriteVbrTag(gf, 0);
+    j = lame_splice(gf, seg, n, outf);
+    switch (j) {
+    case -1:
+        fprintf(stderr, "--splice: a file is not a clean Layer III stream, "
+                "or a piece is empty\n");
+        break;
+    case -2:
+        fprintf(stderr, "--splice: out of memory\n");
+        break;
+    case -3:
+        fprintf(stderr, "fatal error during initialization\n");
+        break;
+    case -4:
+        fprintf(stderr, "Error writing mp3 output \n");
+        break;
+    case -5:
+        fprintf(stderr, "--splice: the files do not have the same sample rate "
+                "and channels\n");
+        break;
+    default:
+        lame_mp3_tags_fid(gf, outf);
+        write_seek_index(gf, outPath);
+        if (silent < 10)
+            fprintf(stderr, "%s: %d pieces, %d frames, %d of them encoded "
+                    "again\n", outPath, n, lame_get_frameNum(gf), j);
+        ret = 0;
+        break;
+    }
+    fclose(outf);
+
+  done:
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < i; j++)
+            if (seg[j].mp3 == seg[i].mp3)
+                break;
+        if (j == i)
+            free((void *) seg[i].mp3);
+    }
+    free(seg);
+    return ret;
+}
+#endif
+
 void print_trailing_info(lame_global_flags *gf)
 {
     if (lame_get_bWriteVbrTag(gf))
@@ -701,6 +1112,17 @@ main(int argc, char **argv)
     if (ret < 0)
         return ret == -2 ? 0 : 1;
 
+#ifdef HAVE_MPGLIB
+    if (scan_only) {
+        ret = inPath[0] != '\0' ? lame_scanner(inPath) : 0; /* stdin */
+        for (i = 0; i < max_nogap; ++i)
+            ret |= lame_scanner(nogap_inPath[i]);
+        return ret;
+    }
+    if (splice_mode)
+        return lame_splicer(gf, outPath, nogap_inPath, max_nogap);
+#endif
+
     if (update_interval < 0.)
         update_interval = 2.;
 
@@ -724,6 +1146,31 @@ main(int argc, char **argv)
         return -1;
     }
 
+    if (transcode_fast && lame_get_num_channels(gf) == 2
+        && lame_get_mode(gf) == MONO) {
+        /* the channels of a granule can only be added up in the MDCT
+         * domain if they use the same block type, decode instead */
+        if (silent < 10)
+            fprintf(stderr, "Note: --transcode-fast can't mix stereo to "
+                    "mono, decoding the input\n");
+        transcode_fast = 0;
+    }
+    if (transcode_fast) {
+        /* the spectrum is kept, so is the sample rate */
+        if (input_format != sf_mp3) {
+            fprintf(stderr, "--transcode-fast needs a Layer III input\n");
+            return -1;
+        }
+        if (lame_get_out_samplerate(gf) == 0)
+            lame_set_out_samplerate(gf, lame_get_in_samplerate(gf));
+        else if (lame_get_out_samplerate(gf) != lame_get_in_samplerate(gf)) {
+            fprintf(stderr, "--transcode-fast can't resample\n");
+            return -1;
+        }
+        /* there is no PCM to analyze */
+        lame_set_findReplayGain(gf, 0);
+    }
+
     /* Now that all the options are set, lame needs to analyze them and
      * set some more internal options and check for problems
      */
@@ -736,6 +1183,10 @@ main(int argc, char **argv)
         return i;
     }
 
+    if (segment_seconds > 0)
+        lame_set_segment_interval(gf, (int) (segment_seconds *
+                                             lame_get_out_samplerate(gf) + .5));
+
     if (silent > 0 || lame_get_VBR(gf) == vbr_off) {
         brhist = 0;     /* turn off VBR histogram */
     }
@@ -749,6 +1200,22 @@ main(int argc, char **argv)
             lame_decoder(gf, outf, 0, inPath, outPath);
 
     }
+#ifdef HAVE_MPGLIB
+    else if (transcode_fast) {
+        ret = lame_transcoder(gf, outf, inPath);
+
+        if (silent<=0) print_lame_tag_leading_info(gf);
+        lame_mp3_tags_fid(gf, outf); /* add VBR tags to mp3 file */
+        write_seek_index(gf, outPath);
+        write_segment_list(gf, outPath);
+
+        if (silent<=0) print_trailing_info(gf);
+
+        fclose(outf);
+        close_infile();
+        lame_close(gf);
+    }
+#endif
     else {
         if (max_nogap > 0) {
             /*
@@ -769,6 +1236,8 @@ main(int argc, char **argv)
                 
                 if (silent<=0) print_lame_tag_leading_info(gf);
                 lame_mp3_tags_fid(gf, outf); /* add VBR tags to mp3 file */
+                write_seek_index(gf, outPath);
+                write_segment_list(gf, outPath);
 		
                 if (silent<=0) print_trailing_info(gf);
                 
@@ -792,6 +1261,8 @@ main(int argc, char **argv)
             
             if (silent<=0) print_lame_tag_leading_info(gf);
             lame_mp3_tags_fid(gf, outf); /* add VBR tags to mp3 file */
+            write_seek_index(gf, outPath);
+            write_segment_list(gf, outPath);
 	    
             if (silent<=0) print_trailing_info(gf);
             
@@ -45,6 +45,13 @@ extern int enc_delay;             /* if decoder finds a Xing header */
 extern int enc_padding;           /* if decoder finds a Xing header */ 
 extern float update_interval;      /* to use Frank's time status display */
 extern int disable_wav_header;     /* for decoder only */
+extern double decode_skip_to;      /* for decoder only */
+extern double decode_duration;     /* for decoder only */
+extern int decode_downsample;      /* mp3 input at 1/n of its rate */
+extern int scan_only;              /* check mp3 files, see lame_scanner */
+extern int transcode_fast;         /* mp3 to mp3, see lame_transcoder */
+extern int splice_mode;            /* cut and join mp3 files, see lame_splicer */
+extern double segment_seconds;     /* see lame_set_segment_interval */
 extern mp3data_struct mp3input_data; /* used by MP3 */
 extern int print_clipping_info;      /* print info whether waveform clips */
 extern int in_signed;
@@ -62,6 +62,8 @@ char *strchr (), *strrchr ();
 #include "parse.h"
 #include "main.h"
 #include "get_audio.h"
+#include "pipeline.h"
+#include "decode_threads.h"
 #include "version.h"
 
 #ifdef WITH_DMALLOC
@@ -93,6 +95,13 @@ int mp3_delay_set;          /* user specified the value of the mp3 encoder
 int enc_delay;
 int enc_padding;
 int disable_wav_header;
+double decode_skip_to;      /* seconds to skip when decoding */
+double decode_duration;     /* seconds to decode, 0 = all */
+int decode_downsample = 1;  /* decode mp3 input at 1/1, 1/2 or 1/4 rate */
+int scan_only;              /* --scan: check the input files, no output */
+int transcode_fast;         /* --transcode-fast: mp3 in, MDCT domain */
+int splice_mode;            /* --splice: cut and join mp3 files */
+double segment_seconds;     /* --segment: reservoir emptied this often */
 mp3data_struct mp3input_data; /* used by MP3 */
 int print_clipping_info;      /* print info whether waveform clips */
 
@@ -451,7 +460,31 @@ int  long_help ( const lame_global_flags* gfp, FILE* const fp, const char* Progr
               "    --freeformat    produce a free format bitstream\n"
               "    --decode        input=mp3 file, output=wav\n"
               "    -t              disable writing wav header when using --decode\n"
+              "    --skip-to <s>   start decoding at s seconds\n"
+              "    --duration <s>  decode s seconds only\n"
+              "    --decode-downsample <n>  decode mp3 input at 1/n of its sample\n"
+              "                    rate (n = 2 or 4), much faster, for previews\n"
+              "    --scan <file1> <file2> <...>\n"
+              "                    check mp3 files without decoding: length, bitrates,\n"
+              "                    lost sync and CRC errors\n"
+              "    --splice <outfile> <file>[@from-to] <...>\n"
+              "                    cut mp3 files at from/to seconds and join them\n"
+              "                    into <outfile>, re-encoding only the cut points\n"
+              "    --seek-index <n> write the byte offset of every n-th frame\n"
+              "                    to <outfile>.idx, for exact seeking\n"
+              "    --segment <s>   make every s seconds a frame that decodes without\n"
+              "                    the ones before it, listed in <outfile>.seg\n"
+              "    --transcode-fast  mp3 input: quantize its MDCT coefficients again,\n"
+              "                    no decoding to PCM, same sample rate and timing\n"
               );
+#ifdef HAVE_PTHREAD
+    fprintf ( fp,
+              "    --pipeline <n>  read and write in separate threads, up to n frames\n"
+              "                    ahead of the encoder (default %d, 0 = no threads)\n"
+              "    --decode-threads <n>  decode mp3 input on n threads, in chunks of\n"
+              "                    %d frames\n",
+              PIPELINE_DEPTH, DECODE_CHUNK_FRAMES );
+#endif
     fprintf ( fp,
               "    --comp  <arg>   choose bitrate to achive a compression ratio of <arg>\n"
               "    --scale <arg>   scale input (multiply PCM data) by <arg>\n"
@@ -1279,7 +1312,46 @@ char* const inPath, char* const outPath, char **nogap_inPath, int *num_nogap)
                     mp3_delay = atoi( nextArg );
                     mp3_delay_set=1;
                     argUsed=1;
+
+                T_ELIF ("skip-to")
+                    decode_skip_to = atof( nextArg );
+                    argUsed=1;
+                    if (decode_skip_to < 0) {
+                        fprintf(stderr, "%s: invalid --skip-to time %s\n",
+                                ProgramName, nextArg);
+                        return -1;
+                    }
+
+                T_ELIF ("duration")
+                    decode_duration = atof( nextArg );
+                    argUsed=1;
+                    if (decode_duration < 0) {
+                        fprintf(stderr, "%s: invalid --duration time %s\n",
+                                ProgramName, nextArg);
+                        return -1;
+                    }
                 
+                T_ELIF ("decode-downsample")
+                    decode_downsample = atoi( nextArg );
+                    argUsed=1;
+                    if (decode_downsample != 1 && decode_downsample != 2
+                        && decode_downsample != 4) {
+                        fprintf(stderr, "%s: --decode-downsample must be 1, 2 or 4\n",
+                                ProgramName);
+                        return -1;
+                    }
+
+                T_ELIF ("scan")
+                    scan_only=1;
+
+                T_ELIF ("transcode-fast")
+                    transcode_fast=1;
+
+                T_ELIF ("splice")
+                    splice_mode=1;
+                    strncpy(outPath, nextArg, PATH_MAX + 1);
+                    argUsed=1;
+
                 T_ELIF ("noath")
                     (void) lame_set_noATH( gfp, 1 );
                 
@@ -1658,6 +1730,33 @@ char* const inPath, char* const outPath, char **nogap_inPath, int *num_nogap)
                     return -1;
                 }
 
+                T_ELIF ("pipeline")
+                    argUsed = 1;
+                    pipeline_depth = atoi (nextArg);
+                    if (pipeline_depth < 0)
+                        pipeline_depth = 0;
+
+                T_ELIF ("decode-threads")
+                    argUsed = 1;
+                    decode_threads = atoi (nextArg);
+
+                T_ELIF ("seek-index")
+                    argUsed = 1;
+                    if (lame_set_seek_index_interval(gfp, atoi(nextArg)) < 0) {
+                        fprintf(stderr, "%s: invalid --seek-index interval %s\n",
+                                ProgramName, nextArg);
+                        return -1;
+                    }
+
+                T_ELIF ("segment")
+                    argUsed = 1;
+                    segment_seconds = atof (nextArg);
+                    if (segment_seconds <= 0) {
+                        fprintf(stderr, "%s: invalid --segment length %s\n",
+                                ProgramName, nextArg);
+                        return -1;
+                    }
+
                 T_ELIF ("disptime")
                     argUsed = 1;
                     update_interval = atof (nextArg);
@@ -1852,7 +1951,7 @@ char* const inPath, char* const outPath, char **nogap_inPath, int *num_nogap)
                 }
             }   
         } else {
-            if (nogap) {
+            if (nogap || scan_only || splice_mode) {
                 if ((num_nogap != NULL) && (count_nogap < *num_nogap)) {
                     strncpy(nogap_inPath[count_nogap++], argv[i], PATH_MAX + 1);
                     input_file=1;
@@ -1884,6 +1983,15 @@ char* const inPath, char* const outPath, char **nogap_inPath, int *num_nogap)
         usage ( gfp, stderr, ProgramName );
         return -1;
     }
+
+    if (scan_only || splice_mode) {
+#ifndef HAVE_MPGLIB
+        fprintf(stderr,"Error: libmp3lame not compiled with mpg123 *decoding* support \n");
+        return -1;
+#endif
+        if (num_nogap!=NULL) *num_nogap=count_nogap;
+        return 0;
+    }
         
     if ( inPath[0] == '-' ) 
 	silent = (silent <= 1 ? 1 : silent);
@@ -1909,6 +2017,14 @@ char* const inPath, char* const outPath, char **nogap_inPath, int *num_nogap)
     /* RG is enabled by default */
     if (!noreplaygain) 
       lame_set_findReplayGain(gfp,1);
+
+    if (transcode_fast) {
+        if (lame_get_decode_only(gfp) || nogap || inPath[0] == '-') {
+            fprintf(stderr, "%s: --transcode-fast needs an mp3 input file, "
+                    "no --decode and no --nogap\n", ProgramName);
+            return -1;
+        }
+    }
     
     /* disable VBR tags with nogap unless the VBR tags are forced */
     if (nogap && lame_get_bWriteVbrTag(gfp) && nogap_tags==0) {
@@ -0,0 +1,408 @@
+/*
+ *	Threaded input/output pipeline source file
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The encoder (or decoder) loop in main.c gets its PCM frames from
+ * pipeline_read() and hands its output to pipeline_out()/pipeline_write().
+ *
+ * With threads, a reader thread calls get_audio() up to pipeline_depth
+ * frames ahead, and a writer thread does the fwrite()s, so a slow disk
+ * or network file system stalls the encoder only if a ring runs empty
+ * or full.  Each ring has one producer and one consumer, which only
+ * touch their own index.  A side sleeps on the ring's condition variable
+ * only if the ring is empty or full, and the other side takes the mutex
+ * only if it finds a sleeper counted.  A count and not a flag, because
+ * the producer may go to sleep before the consumer it just woke up has
+ * left ring_wait().
+ *
+ * Without threads, or with --pipeline 0, everything runs on the calling
+ * thread and does exactly what the loops in main.c used to do.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lame.h"
+#include "main.h"
+#include "get_audio.h"
+#include "pipeline.h"
+
+/* the rings need the gcc/clang atomic builtins */
+#if defined(HAVE_PTHREAD) && defined(HAVE_PTHREAD_H) && defined(__ATOMIC_ACQUIRE)
+# include <pthread.h>
+# define PIPELINE_THREADS
+#endif
+
+#ifdef WITH_DMALLOC
+#include <dmalloc.h>
+#endif
+
+
+int     pipeline_depth = PIPELINE_DEPTH;
+
+
+typedef struct {
+    int     n;                  /* samples per channel, 0 at the end */
+    mp3data_struct mp3data;     /* mp3input_data after this frame */
+    union {
+        int     i[2][1152];
+        short   s[2][1152];
+    } pcm;
+} pcm_frame_t;
+
+typedef struct {
+    size_t  n;
+    unsigned char buf[LAME_MAXMP3BUFFER];
+} out_block_t;
+
+
+static lame_global_flags *pl_gf;
+static FILE *pl_outf;
+static int pl_decode;
+static int pl_error;            /* a write has failed */
+static pcm_frame_t pl_frame;    /* used without threads */
+static out_block_t pl_block;
+
+
+static void
+read_frame(pcm_frame_t * f)
+{
+    if (pl_decode)
+        f->n = get_audio16(pl_gf, f->pcm.s);
+    else
+        f->n = get_audio(pl_gf, f->pcm.i);
+    f->mp3data = mp3input_data;
+}
+
+
+
+#ifdef PIPELINE_THREADS
+
+#define LOAD(x)      __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define FENCE()      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+typedef struct {
+    char   *slots;
+    size_t  size;               /* bytes per slot */
+    unsigned int depth;         /* number of slots */
+    unsigned int head;          /* slots filled, written by the producer */
+    unsigned int tail;          /* slots emptied, written by the consumer */
+    int     closed;             /* the producer has finished */
+    int     aborted;            /* the consumer wants no more slots */
+    int     sleeping;           /* threads waiting on cond */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} ring_t;
+
+static ring_t in_ring;          /* pcm_frame_t, reader -> encoder */
+static ring_t out_ring;         /* out_block_t, encoder -> writer */
+static pthread_t reader, writer;
+static int threaded;
+static pcm_frame_t *cur_frame;  /* held by the encoder until the next read */
+static out_block_t *cur_block;  /* being filled by the encoder */
+
+
+static int
+ring_init(ring_t * r, unsigned int depth, size_t size)
+{
+    r->slots = malloc(depth * size);
+    if (r->slots == NULL)
+        return -1;
+    r->size = size;
+    r->depth = depth;
+    r->head = r->tail = 0;
+    r->closed = r->aborted = r->sleeping = 0;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    return 0;
+}
+
+static void
+ring_free(ring_t * r)
+{
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    free(r->slots);
+    r->slots = NULL;
+}
+
+static int
+ring_can_put(ring_t * r)
+{
+    return r->head - LOAD(r->tail) < r->depth || LOAD(r->aborted);
+}
+
+static int
+ring_can_get(ring_t * r)
+{
+    return LOAD(r->head) != r->tail || LOAD(r->closed);
+}
+
+static void
+ring_wait(ring_t * r, int (*ready) (ring_t *))
+{
+    if (ready(r))
+        return;
+    pthread_mutex_lock(&r->lock);
+    STORE(r->sleeping, r->sleeping + 1);
+    FENCE();                    /* pairs with the one in ring_wake() */
+    while (!ready(r))
+        pthread_cond_wait(&r->cond, &r->lock);
+    STORE(r->sleeping, r->sleeping - 1);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void
+ring_wake(ring_t * r)
+{
+    FENCE();
+    if (LOAD(r->sleeping)) {
+        pthread_mutex_lock(&r->lock);
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+/* producer: next free slot, NULL if the consumer has aborted */
+static void *
+ring_put_slot(ring_t * r)
+{
+    ring_wait(r, ring_can_put);
+    if (LOAD(r->aborted))
+        return NULL;
+    return r->slots + (r->head % r->depth) * r->size;
+}
+
+static void
+ring_put(ring_t * r)
+{
+    STORE(r->head, r->head + 1);
+    ring_wake(r);
+}
+
+static void
+ring_close(ring_t * r)
+{
+    STORE(r->closed, 1);
+    ring_wake(r);
+}
+
+/* consumer: next filled slot, NULL if the producer has finished */
+static void *
+ring_get_slot(ring_t * r)
+{
+    ring_wait(r, ring_can_get);
+    if (LOAD(r->head) == r->tail)
+        return NULL;
+    return r->slots + (r->tail % r->depth) * r->size;
+}
+
+static void
+ring_get(ring_t * r)
+{
+    STORE(r->tail, r->tail + 1);
+    ring_wake(r);
+}
+
+static void
+ring_abort(ring_t * r)
+{
+    STORE(r->aborted, 1);
+    ring_wake(r);
+}
+
+
+static void *
+reader_thread(void *arg)
+{
+    pcm_frame_t *f;
+    int     n;
+
+    (void) arg;
+    do {
+        if ((f = ring_put_slot(&in_ring)) == NULL)
+            break;
+        read_frame(f);
+        n = f->n;
+        ring_put(&in_ring);
+    } while (n > 0);
+    ring_close(&in_ring);
+    return NULL;
+}
+
+/* after a failed write, keeps emptying the ring so the encoder cannot
+   block; pipeline_write() reports the error */
+static void *
+writer_thread(void *arg)
+{
+    out_block_t *b;
+
+    (void) arg;
+    while ((b = ring_get_slot(&out_ring)) != NULL) {
+        if (!LOAD(pl_error) && fwrite(b->buf, 1, b->n, pl_outf) != b->n)
+            STORE(pl_error, 1);
+        ring_get(&out_ring);
+    }
+    return NULL;
+}
+
+static int
+start_threads(void)
+{
+    cur_frame = NULL;
+    cur_block = NULL;
+    if (ring_init(&in_ring, pipeline_depth, sizeof(pcm_frame_t)) != 0)
+        return 0;
+    if (ring_init(&out_ring, pipeline_depth, sizeof(out_block_t)) != 0) {
+        ring_free(&in_ring);
+        return 0;
+    }
+    /* the writer first: if the reader cannot be started, no input
+       has been consumed yet and we can go on without threads */
+    if (pthread_create(&writer, NULL, writer_thread, NULL) != 0) {
+        ring_free(&out_ring);
+        ring_free(&in_ring);
+        return 0;
+    }
+    if (pthread_create(&reader, NULL, reader_thread, NULL) != 0) {
+        ring_close(&out_ring);
+        pthread_join(writer, NULL);
+        ring_free(&out_ring);
+        ring_free(&in_ring);
+        return 0;
+    }
+    return 1;
+}
+
+#endif /* PIPELINE_THREADS */
+
+
+
+void
+pipeline_open(lame_global_flags * gf, FILE * outf, int decode)
+{
+    pl_gf = gf;
+    pl_outf = outf;
+    pl_decode = decode;
+    pl_error = 0;
+#ifdef PIPELINE_THREADS
+    threaded = pipeline_depth > 0 && start_threads();
+#endif
+}
+
+
+/* returns the number of samples per channel, 0 at the end of the input.
+   *pcm points to int[2][1152], or short[2][1152] when decoding, and
+   stays valid until the next call. */
+int
+pipeline_read(void **pcm, mp3data_struct * mp3data)
+{
+    pcm_frame_t *f = &pl_frame;
+
+#ifdef PIPELINE_THREADS
+    if (threaded) {
+        if (cur_frame != NULL)
+            ring_get(&in_ring);
+        cur_frame = ring_get_slot(&in_ring);
+        if (cur_frame == NULL) {
+            /* read again after the end */
+            f->n = 0;
+            f->mp3data = mp3input_data;
+        }
+        else
+            f = cur_frame;
+    }
+    else
+#endif
+        read_frame(f);
+
+    *pcm = &f->pcm;
+    if (mp3data != NULL)
+        *mp3data = f->mp3data;
+    return f->n;
+}
+
+
+/* buffer for the next block of output */
+unsigned char *
+pipeline_out(size_t * size)
+{
+    out_block_t *b = &pl_block;
+
+#ifdef PIPELINE_THREADS
+    if (threaded) {
+        if (cur_block == NULL)
+            cur_block = ring_put_slot(&out_ring);
+        assert(cur_block != NULL);
+        b = cur_block;
+    }
+#endif
+    *size = sizeof(b->buf);
+    return b->buf;
+}
+
+
+/* writes the first n bytes of the pipeline_out() buffer.
+   returns -1 if this or an earlier write has failed */
+int
+pipeline_write(size_t n)
+{
+#ifdef PIPELINE_THREADS
+    if (threaded) {
+        if (n > 0) {
+            assert(cur_block != NULL && n <= sizeof(cur_block->buf));
+            cur_block->n = n;
+            ring_put(&out_ring);
+            cur_block = NULL;
+        }
+        return LOAD(pl_error) ? -1 : 0;
+    }
+#endif
+    if (fwrite(pl_block.buf, 1, n, pl_outf) != n)
+        pl_error = 1;
+    return pl_error ? -1 : 0;
+}
+
+
+/* stops the reader, waits until all output is written.
+   returns -1 if a write has failed */
+int
+pipeline_close(void)
+{
+#ifdef PIPELINE_THREADS
+    if (threaded) {
+        ring_abort(&in_ring);
+        pthread_join(reader, NULL);
+        ring_close(&out_ring);
+        pthread_join(writer, NULL);
+        ring_free(&out_ring);
+        ring_free(&in_ring);
+        threaded = 0;
+    }
+#endif
+    return pl_error ? -1 : 0;
+}
+
+/* end of pipeline.c */
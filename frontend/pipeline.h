@@ -0,0 +1,39 @@
+/*
+ *	Threaded input/output pipeline include file
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_PIPELINE_H
+#define LAME_PIPELINE_H
+
+#include <stdio.h>
+#include "lame.h"
+
+/* default number of frames the reader and the writer may run ahead */
+#define PIPELINE_DEPTH  32
+
+/* 0 runs everything on the calling thread.  set by parse_args() */
+extern int pipeline_depth;
+
+extern void  pipeline_open  ( lame_global_flags* gf, FILE* outf, int decode );
+extern int   pipeline_read  ( void** pcm, mp3data_struct* mp3data );
+extern unsigned char*
+             pipeline_out   ( size_t* size );
+extern int   pipeline_write ( size_t n );
+extern int   pipeline_close ( void );
+
+#endif /* LAME_PIPELINE_H */
@@ -224,6 +224,29 @@ int CDECL lame_get_analysis(const lame_global_flags *);
 int CDECL lame_set_bWriteVbrTag(lame_global_flags *, int);
 int CDECL lame_get_bWriteVbrTag(const lame_global_flags *);
 
+/*
+  n > 0 = keep a seek index entry for every n-th frame,
+  see lame_get_seek_index().  default = 0 (no index)
+*/
+int CDECL lame_set_seek_index_interval(lame_global_flags *, int);
+int CDECL lame_get_seek_index_interval(const lame_global_flags *);
+
+/*
+  1 = keep a lame_frame_info for every frame written,
+  see lame_take_frame_info().  default = 0
+*/
+int CDECL lame_set_frame_info(lame_global_flags *, int);
+int CDECL lame_get_frame_info(const lame_global_flags *);
+
+/*
+  n > 0 = cut the output into segments of n samples (at the output
+  sample rate) that decode without the frames before them,
+  see lame_get_segment_start().  May also be set after lame_init_params,
+  before the first encode call.  default = 0 (off)
+*/
+int CDECL lame_set_segment_interval(lame_global_flags *, int);
+int CDECL lame_get_segment_interval(const lame_global_flags *);
+
 /* 1=decode only.  use lame/mpglib to convert mp3/ogg to wav.  default=0 */
 int CDECL lame_set_decode_only(lame_global_flags *, int);
 int CDECL lame_get_decode_only(const lame_global_flags *);
@@ -317,6 +340,24 @@ int CDECL lame_set_debugf(lame_global_flags *,
 int CDECL lame_set_msgf  (lame_global_flags *,
                           void (*func)(const char *, va_list));
 
+/*
+ * OPTIONAL:
+ * Hand the mp3 data to func as it is produced, straight from the
+ * internal bitstream buffer, instead of copying it to the mp3buf of the
+ * encode and flush calls.  These then take mp3buf = NULL and size = 0,
+ * never fail with -1, and return the number of bytes given to func.
+ *   int my_output(void *user, const unsigned char *data, int len)
+ *   {
+ *       return fwrite(data, 1, len, (FILE *) user) != (size_t) len;
+ *   }
+ * data is only valid during the call.  If func returns nonzero, the
+ * encode or flush call fails with -7.  NULL (default) turns it off.
+ * Use lame_get_lametag_frame for the Xing/Info tag frame.
+ */
+typedef int (*lame_output_callback)(void *user, const unsigned char *data, int len);
+int CDECL lame_set_output_callback(lame_global_flags *,
+                                   lame_output_callback func, void *user);
+
 
 
 /* set one of brate compression ratio.  default is compression ratio of 11.  */
@@ -536,6 +577,14 @@ int CDECL lame_get_encoder_delay(const lame_global_flags *);
 */
 int CDECL lame_get_encoder_padding(const lame_global_flags *);
 
+/*
+  lame_encode_spectrum() keeps the frames of its source, so the delay and
+  padding for the LAME tag are those of the source.  Call it after
+  lame_encode_flush().
+*/
+int CDECL lame_set_encoder_delay_padding(lame_global_flags *,
+                                         int delay, int padding);
+
 /* size of MPEG frame */
 int CDECL lame_get_framesize(const lame_global_flags *);
 
@@ -652,6 +701,7 @@ void CDECL lame_print_internals( const lame_global_flags *gfp);
  *                 -2:  malloc() problem
  *                 -3:  lame_init_params() not called
  *                 -4:  psycho acoustic problems 
+ *                 -7:  the output callback failed
  *
  * The required mp3buf_size can be computed from num_samples, 
  * samplerate and encoding rate, but here is a worst case estimate:
@@ -863,13 +913,115 @@ void CDECL lame_bitrate_block_type_hist (
  * pointer fid.  These calls perform forward and backwards seeks, so make
  * sure fid is a real file.  Make sure lame_encode_flush has been called,
  * and all mp3 data has been written to the file before calling this
- * function.
+ * function.  fid may be reopened.  The tag goes into the all 0's frame
+ * LAME wrote; if data of your own (an ID3v2 tag, say) comes before LAME's
+ * output in the file, that frame is found behind it, provided fid is
+ * positioned at the end of the file or the data is an ID3v2 tag.
+ * Nothing is written if the frame is not found.
  * NOTE:
  * if VBR  tags are turned off by the user, or turned off by LAME because
  * the output is not a regular file, this call does nothing
 */
 void CDECL lame_mp3_tags_fid(lame_global_flags *,FILE* fid);
 
+/*
+ * OPTIONAL:
+ * lame_get_lametag_frame copies the final Xing VBR/INFO tag frame into
+ * buffer, for output that cannot be rewound (pipes, sockets, ...).
+ * It needs no access to the mp3 data: call it after lame_encode_flush
+ * and replace the all 0's frame LAME wrote after any ID3v2 tag with it.
+ * lame_mp3_tags_fid does exactly that on a seekable file.
+ * returns the size of the frame, the size needed if size is too small
+ * (nothing is copied then), or 0 if VBR tags are turned off.
+ */
+size_t CDECL lame_get_lametag_frame(
+        const lame_global_flags *  gfp,
+        unsigned char*             buffer,
+        size_t                     size );
+
+/*
+ * OPTIONAL:
+ * lame_get_seek_index copies the seek index enabled by
+ * lame_set_seek_index_interval into buffer, to be stored alongside the
+ * mp3 file.  Every entry has the exact byte offset of a frame,
+ * main_data_begin and where the main data of the frame starts.
+ * Call it after lame_encode_flush.
+ * returns the size of the index, the size needed if size is too small
+ * (nothing is copied then), or 0 if there is no index.
+ */
+size_t CDECL lame_get_seek_index(
+        const lame_global_flags *  gfp,
+        unsigned char*             buffer,
+        size_t                     size );
+
+/*
+ * lame_seek_index_lookup maps the time range [start,end) in seconds to the
+ * byte range [*begin_byte,*end_byte) of the mp3 file, using a seek index
+ * as returned by lame_get_seek_index.  end <= start means up to the last
+ * frame.  Reset the decoder, feed [*begin_byte,*frame_byte) through
+ * lame_decode_preroll, decode from *frame_byte on and drop the first
+ * *skip samples.  Assumes the delay of mpglib.
+ * returns 0, or -1 if index is not a valid seek index
+ */
+int CDECL lame_seek_index_lookup(
+        const unsigned char *      index,
+        size_t                     size,
+        double                     start,
+        double                     end,
+        unsigned long *            begin_byte,
+        unsigned long *            frame_byte,
+        unsigned long *            end_byte,
+        unsigned long *            skip );
+
+/* a frame of the output, see lame_take_frame_info() */
+typedef struct {
+  unsigned long offset;           /* of the header, in bytes from the start
+                                     of the output (ID3v2 tag included)   */
+  int           size;             /* bytes                                */
+  long          first_sample;     /* first sample it decodes to, counted
+                                     from the first sample of the input:
+                                     frame * framesize - encoder delay.
+                                     The decoder delay is not included    */
+  int           bitrate_index;
+  int           padding;          /* padding bit                          */
+  int           main_data_begin;  /* bytes of its main data in the frames
+                                     before it (bit reservoir)            */
+} lame_frame_info;
+
+/*
+ * OPTIONAL:
+ * with lame_set_frame_info(gfp,1), lame_take_frame_info moves the
+ * descriptors of the frames written so far, in order and up to max of
+ * them, from LAME to info.  A frame is written once its header is in
+ * the mp3 data the encode or flush call has returned; its main data may
+ * still end in the data of a later call.  Call it after each encode
+ * call, or at least before lame_close.  The Xing/Info tag frame is not
+ * included.
+ * returns the number of descriptors copied.
+ */
+int CDECL lame_take_frame_info(
+        lame_global_flags *        gfp,
+        lame_frame_info            info[],
+        int                        max );
+
+/*
+ * OPTIONAL:
+ * with lame_set_segment_interval(gfp,n), segment s covers the input
+ * samples from s*n on.  Its first frame is *frame (counted like
+ * lame_frame_info, without the Xing/Info tag frame), which takes nothing
+ * from the bit reservoir, so decoding can start there.  Drop the decoder
+ * delay and then *priming samples, at least 559 for s > 0 so the
+ * filterbank has settled.  Psychoacoustic and filterbank state run on
+ * across segments, only the reservoir is emptied.
+ * returns 0, or -1 if segment s has not started in the frames encoded so
+ * far or segments are off.
+ */
+int CDECL lame_get_segment_start(
+        const lame_global_flags *  gfp,
+        int                        s,
+        unsigned long *            frame,
+        int *                      priming );
+
 
 /*
  * REQUIRED:
@@ -988,6 +1140,260 @@ int CDECL lame_decode1_headersB(
 /* cleanup call to exit decoder  */
 int CDECL lame_decode_exit(void);
 
+/* drops all data buffered in the decoder, for example before feeding it
+ * from a new position in the same stream.  nsamp, totalframes and the
+ * delays read from a Xing/Info tag are kept */
+int CDECL lame_decode_reset(void);
+
+/* decodes the complete frames in mp3buf and drops the output.  After
+ * lame_decode_reset(), feed the frames before the one where the output
+ * should start through this: some of them can not be decoded in full
+ * without their bit reservoir, and give fewer samples.
+ * returns -1 on error, else 0 */
+int CDECL lame_decode_preroll(
+        unsigned char*  mp3buf,
+        int             len );
+
+/* decode at 1/factor of the sample rate, factor = 1, 2 or 4, for previews
+ * and analysis.  Only the lowest 32/factor subbands are decoded, and the
+ * output has everything above samplerate/(2*factor) cut off.  The
+ * samplerate and framesize in mp3data are those of the output, the
+ * encoder delay and padding are not scaled.  Call it after
+ * lame_decode_init(), before the first frame; lame_decode_reset() keeps it.
+ * returns -1 if factor is not 1, 2 or 4, else 0 */
+int CDECL lame_decode_downsample(int factor);
+
+/*********************************************************************
+ * decoders with a state of their own.  All the lame_decode functions
+ * above share one decoder; these can be used side by side, and on
+ * different threads at the same time.  (Without POSIX threads the
+ * library can't guard the tables all decoders share: there the very
+ * first decoder, of either kind, must not be set up while another
+ * thread sets up one.)
+ *
+ *  dec  = lame_decoder_new();
+ *  nout = lame_decoder_decode1_headers(dec,mp3buf,len,pcm_l,pcm_r,&mp3data);
+ *  ...
+ *  lame_decoder_free(dec);
+ *********************************************************************/
+typedef struct lame_decoder_struct lame_decoder_t;
+
+/* returns NULL if out of memory */
+lame_decoder_t* CDECL lame_decoder_new(void);
+
+void CDECL lame_decoder_free(lame_decoder_t* dec);
+
+/* same as lame_decode1_headers */
+int CDECL lame_decoder_decode1_headers(
+        lame_decoder_t*  dec,
+        unsigned char*   mp3buf,
+        int              len,
+        short            pcm_l[],
+        short            pcm_r[],
+        mp3data_struct*  mp3data );
+
+/* same as lame_decode_preroll, for a new decoder */
+int CDECL lame_decoder_preroll(
+        lame_decoder_t*  dec,
+        unsigned char*   mp3buf,
+        int              len );
+
+/* same as lame_decode_downsample, call it before feeding the decoder */
+int CDECL lame_decoder_downsample(
+        lame_decoder_t*  dec,
+        int              factor );
+
+/* one Layer III frame as the decoder sees it before the synthesis */
+typedef struct {
+  int granules;        /* 2 for MPEG-1, 1 for MPEG-2 and 2.5.  fewer if
+                          the frame could only be decoded in part         */
+  int channels;        /* 1 or 2                                          */
+  int samplerate;
+  int mode;
+  int mode_ext;
+  int main_data_begin;
+  struct {
+    int part2_3_length;
+    int big_values;
+    int global_gain;
+    int scalefac_compress;
+    int block_type;    /* 0 normal, 1 start, 2 short, 3 stop              */
+    int mixed_block_flag;
+    int subblock_gain[3];
+    int preflag;       /* 1 if pretab is added to the scalefactors        */
+    int scalefac_scale;
+    int count1table_select;
+    int scalefac[39];  /* as read: long blocks [sfb], short blocks
+                          [3*sfb+window], mixed blocks 8 long then short  */
+    float xr[576];     /* dequantized, after M/S and intensity stereo,
+                          [18*subband+line], line < 18, short blocks
+                          [18*subband+3*line+window], line < 6            */
+  } gr[2][2];          /* [granule][channel]                              */
+} mp3spectrum_struct;
+
+/*********************************************************************
+ * decodes Layer III frames up to the dequantized MDCT coefficients, for
+ * analysis.  No antialias butterflies, no IMDCT and no synthesis, so it
+ * is several times faster than decoding to PCM.  The values are on the
+ * scale of mpglib: a full scale sine peaks near 1.
+ *
+ * Use a decoder of its own for it, lame_decoder_downsample() does not
+ * apply.  Feed it like lame_decoder_decode1_headers(), call again with
+ * len = 0 while it returns 1.
+ *
+ * returns -1 on error or a Layer I/II frame, 0 if it needs more data,
+ * 1 if *spec holds the next frame.
+ *********************************************************************/
+int CDECL lame_decoder_spectrum(
+        lame_decoder_t*      dec,
+        unsigned char*       mp3buf,
+        int                  len,
+        mp3spectrum_struct*  spec );
+
+/*********************************************************************
+ * encodes one frame from the spectrum of a Layer III frame, as returned
+ * by lame_decoder_spectrum(), to transcode without the synthesis and
+ * the analysis filterbanks.  The coefficients are quantized again with
+ * the block types of the source, the masking is estimated from them.
+ *
+ * The sample rate set with lame_set_out_samplerate() must be the one of
+ * the source, a stereo source may be encoded as mono.  Every call gives
+ * one frame, missing granules are encoded as silence.  Finish with
+ * lame_encode_flush(), then lame_set_encoder_delay_padding().
+ *
+ * return code = number of bytes output in mp3buf, or
+ *                 -1:  mp3buf was too small
+ *                 -3:  lame_init_params() not called
+ *                 -4:  psycho acoustic problems
+ *                 -5:  spec does not fit the encoder settings
+ *                 -6:  mono output, but the channels of spec use
+ *                      different block types: encode this frame from
+ *                      PCM instead
+ *********************************************************************/
+int CDECL lame_encode_spectrum(
+        lame_global_flags*         gfp,
+        const mp3spectrum_struct*  spec,
+        unsigned char*             mp3buf,
+        int                        mp3buf_size );
+
+/*********************************************************************
+ * looks at the header and side info of the frame starting at buf[0],
+ * without decoding it.  buf must hold at least 8 bytes.
+ *
+ *  nbytes = lame_decode_frame_info(buf,&samples,&main_data_begin,&side);
+ *
+ * output:
+ *    nbytes          : frame size in bytes, 0 if buf does not start
+ *                      with a valid header or the stream is free format
+ *    samples         : samples per channel in this frame
+ *    main_data_begin : bytes of the frame's main data which are stored
+ *                      in previous frames (always 0 for Layer I and II)
+ *    side            : bytes of header, CRC and side info
+ *
+ * Decoding a Layer III frame needs the frames holding its first
+ * main_data_begin bytes, and the two granules before its output is
+ * final, for the synthesis and the MDCT overlap.
+ *********************************************************************/
+int CDECL lame_decode_frame_info(
+        const unsigned char* buf,
+        int*                 samples,
+        int*                 main_data_begin,
+        int*                 side );
+
+/* what lame_decode_scan() has found so far */
+typedef struct {
+  int version;         /* 0=MPEG-2  1=MPEG-1  (2=MPEG-2.5)                */
+  int layer;
+  int samplerate;
+  int stereo;          /* number of channels in the first frame           */
+  int framesize;       /* number of samples per frame                     */
+  unsigned long header; /* of the first frame, the others must match it   */
+
+  /* from a Xing/Info tag in the first frame, -1 if there was none */
+  int enc_delay;
+  int enc_padding;
+  long tag_frames;
+
+  unsigned long frames;    /* audio frames, the tag frame is not counted  */
+  unsigned long nsamp;     /* frames*framesize less enc_delay and
+                              enc_padding, set at the end of the scan     */
+  unsigned long bitrate_frames[16]; /* frames per bitrate index           */
+  int bitrate_kbps[16];             /* bitrate of each index              */
+  unsigned long crc_errors;
+  unsigned long bad_bytes; /* skipped to find the next frame              */
+  size_t error_pos;        /* where the last reported error was found     */
+} mp3scan_struct;
+
+#define LAME_SCAN_END        0  /* reached the end of buf */
+#define LAME_SCAN_LOST_SYNC  1  /* bytes from error_pos to *pos skipped */
+#define LAME_SCAN_CRC_ERROR  2  /* the frame at error_pos has a bad CRC */
+#define LAME_SCAN_TRUNCATED  3  /* the last frame ends after buf */
+
+/*********************************************************************
+ * walks the frame headers of a complete mp3 file in memory, without
+ * decoding anything, and checks the CRC of Layer III frames which have
+ * one.  Start with *pos = 0.  Returns when a problem is found, with
+ * *pos at the next frame, so call again until it returns LAME_SCAN_END.
+ *
+ *  while ((ret = lame_decode_scan(buf,len,&pos,&scan)) != LAME_SCAN_END)
+ *      report(ret, scan.error_pos);
+ *
+ * An ID3v2 tag at the start and an ID3v1 tag at the end are skipped.
+ * A frame is only accepted after lost sync if the next frame follows
+ * it.  Free format streams are not supported.
+ *********************************************************************/
+int CDECL lame_decode_scan(
+        const unsigned char* buf,
+        size_t               len,
+        size_t*              pos,
+        mp3scan_struct*      scan );
+
+/* a piece of an mp3 file in memory for lame_splice(): audio samples
+   [begin,end) of it, counted from the first sample a decoder outputs */
+typedef struct {
+  const unsigned char* mp3;
+  size_t               size;
+  unsigned long        begin;
+  unsigned long        end;     /* 0 = up to the last sample             */
+} lame_splice_segment;
+
+/*********************************************************************
+ * cuts pieces out of Layer III files and joins them, without decoding
+ * and encoding them again.  The frames are copied, with their main
+ * data moved where the bit reservoir of the output has room for it;
+ * only the few frames around a cut are decoded and encoded again, by
+ * an encoder which is given the PCM before them.
+ *
+ * The frames of a piece stay on the frame grid of its file, so a cut
+ * between two pieces moves the end of the first one by up to half a
+ * frame.  The start of the first piece and the end of the last one are
+ * exact: they go into the encoder delay and padding of the LAME tag.
+ * All files must have the same sample rate and number of channels.
+ *
+ * Set up gfp with lame_init() and the options for the tag, ID3 tags
+ * and the frames encoded again (quality, CRC), but do not call
+ * lame_init_params(): lame_splice() sets the sample rate, channels and
+ * bitrate from the files and calls it.  outf gets the ID3v2 tag, room
+ * for the Xing/Info tag, the frames and the ID3v1 tag.  Finish with
+ * lame_mp3_tags_fid(), as after encoding.  With an output callback set
+ * (lame_set_output_callback), it gets all of these and outf may be NULL.
+ *
+ * return code = number of frames encoded again, or
+ *                 -1:  a file is not a clean Layer III stream, or a
+ *                      piece is empty
+ *                 -2:  malloc() problem
+ *                 -3:  lame_init_params() failed
+ *                 -4:  error writing outf, or the output callback
+ *                      failed
+ *                 -5:  the files do not have the same sample rate
+ *                      and channels
+ *********************************************************************/
+int CDECL lame_splice(
+        lame_global_flags*         gfp,
+        const lame_splice_segment  seg[],
+        int                        nseg,
+        FILE*                      outf );
+
 
 
 /*********************************************************************
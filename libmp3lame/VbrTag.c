@@ -61,6 +61,12 @@
 
 #define LAMEHEADERSIZE (VBRHEADERSIZE + 9 + 1 + 1 + 8 + 1 + 1 + 3 + 1 + 1 + 2 + 4 + 2 + 2)
 
+/* the sidecar seek index: "LIDX", a header and one entry per indexed frame */
+#define SEEK_INDEX_HEADERSIZE 30
+#define SEEK_INDEX_ENTRYSIZE   9
+#define SEEK_INDEX_PREROLL   194    /* mpglib wants this much after a reset */
+#define SEEK_INDEX_UNKNOWN 0xFFFF   /* back distance of an unusable entry */
+
 /* the size of the Xing header (MPEG1 and MPEG2) in kbps */
 #define XING_BITRATE1 128
 #define XING_BITRATE2  64
@@ -196,12 +202,37 @@ void AddVbrFrame(lame_global_flags *gfp)
     int kbps = bitrate_table[gfp->version][gfc->bitrate_index];
     assert(gfc->VBR_seek_table.bag);
     addVbr(&gfc->VBR_seek_table, kbps);
+    if (gfp->nVbrNumFrames == 0) {
+        /* the header format_bitstream() has just made */
+        int h = (gfc->h_ptr - 1) & (MAX_HEADER_BUF - 1);
+        memcpy(gfc->VbrFirstHeader, gfc->header[h].buf, 4);
+    }
+    gfp->nVbrNumFrames++;
+}
+
+
+/****************************************************************************
+ * AddVbrFrameHeader: same as AddVbrFrame, for a frame format_bitstream()
+ * has not made, see lame_splice()
+ * Paramters:
+ *	header: the frame header
+ ****************************************************************************
+*/
+void AddVbrFrameHeader(lame_global_flags *gfp, const unsigned char *header)
+{
+    lame_internal_flags *gfc = gfp->internal_flags;
+
+    int kbps = bitrate_table[gfp->version][header[2] >> 4];
+    assert(gfc->VBR_seek_table.bag);
+    addVbr(&gfc->VBR_seek_table, kbps);
+    if (gfp->nVbrNumFrames == 0)
+        memcpy(gfc->VbrFirstHeader, header, 4);
     gfp->nVbrNumFrames++;
 }
 
 
 /*-------------------------------------------------------------*/
-static int ExtractI4(unsigned char *buf)
+static int ExtractI4(const unsigned char *buf)
 {
 	int x;
 	/* big endian extract */
@@ -215,6 +246,12 @@ static int ExtractI4(unsigned char *buf)
 	return x;
 }
 
+static int ExtractI2(const unsigned char *buf)
+{
+	/* big endian extract */
+	return (buf[0] << 8) | buf[1];
+}
+
 static void CreateI4(unsigned char *buf, int nValue)
 {
         /* big endian create */
@@ -234,6 +271,76 @@ static void CreateI2(unsigned char *buf, int nValue)
 }
 
 
+/****************************************************************************
+ * AddSeekIndexFrame: Add a frame to the sidecar seek index.  Called as
+ * the header goes into the bitstream, every seek_index_interval'th frame
+ * gets an entry:
+ *	4 bytes	offset of the frame header in the output
+ *	2 bytes	bytes from the first frame holding its main data to the header,
+ *		SEEK_INDEX_UNKNOWN if that frame is no longer known
+ *	2 bytes	main_data_begin
+ *	1 byte	frames from the first frame holding its main data, at most 255
+ * Paramters:
+ *	offset: where the header goes in the output, in bytes
+ *	header: header and side info of the frame
+ ****************************************************************************
+*/
+void AddSeekIndexFrame(lame_global_flags *gfp, unsigned long offset, const unsigned char *header)
+{
+    lame_internal_flags *gfc = gfp->internal_flags;
+    seek_index_t *v = &gfc->seek_index;
+    const unsigned char *si = header + (gfp->error_protection ? 6 : 4);
+    unsigned long k = v->frames++;
+    unsigned long j;
+    unsigned char *e;
+    int main_data_begin, back;
+
+    v->recent[k % SEEK_INDEX_RECENT] = offset;
+    if (k % gfp->seek_index_interval != 0)
+        return;
+
+    if (v->count == v->size) {
+        int size = v->size ? 2 * v->size : 1024;
+        unsigned char *bag = realloc(v->bag, size * SEEK_INDEX_ENTRYSIZE);
+        if (bag == NULL) {
+            ERRORF(gfc,"Error: can't allocate seek index buffer\n");
+            gfp->seek_index_interval = 0;
+            return;
+        }
+        v->bag = bag;
+        v->size = size;
+    }
+
+    /* main data of the frames before k fills all of their slots but
+       the header and side info.  walk back over main_data_begin bytes,
+       and on to SEEK_INDEX_PREROLL bytes before the header, if we can */
+    if (gfp->version == 1)
+        main_data_begin = (si[0] << 1) | (si[1] >> 7);
+    else
+        main_data_begin = si[0];
+    back = main_data_begin;
+    for (j = k; back > 0 && j > 0 && k - j < SEEK_INDEX_RECENT - 1; --j) {
+        back -= (int)(v->recent[j % SEEK_INDEX_RECENT]
+                      - v->recent[(j - 1) % SEEK_INDEX_RECENT])
+            - gfc->sideinfo_len;
+    }
+    while (j > 0 && k - j < SEEK_INDEX_RECENT - 1
+           && offset - v->recent[j % SEEK_INDEX_RECENT] < SEEK_INDEX_PREROLL)
+        --j;
+
+    e = v->bag + v->count * SEEK_INDEX_ENTRYSIZE;
+    CreateI4(e, offset);
+    if (back > 0)   /* ran out of recent frames, lookups skip this one */
+        CreateI2(e + 4, SEEK_INDEX_UNKNOWN);
+    else
+        CreateI2(e + 4, offset - v->recent[j % SEEK_INDEX_RECENT]);
+    CreateI2(e + 6, main_data_begin);
+    e[8] = k - j < 255 ? k - j : 255;
+    v->count++;
+}
+
+
+
 /*-------------------------------------------------------------*/
 /* Same as GetVbrTag below, but only checks for the Xing tag.
    requires buf to contain only 40 bytes */
@@ -455,6 +562,7 @@ int InitVbrTag(lame_global_flags *gfp)
         }
 
         /* write dummy VBR tag of all 0's into bitstream */ 
+	gfc->nVbrTagOffset = gfc->nBytesOutput + gfc->bs.buf_byte_idx + 1;
 	for (i=0; i<gfp->TotalFrameSize; ++i)
 	  add_dummy_byte(gfp,0);
 
@@ -491,10 +599,34 @@ int CRC_update_lookup(int value, int crc)
 	return crc;
 }
 
+/* crc16_lookup extended for slice-by-4: crc16_slice[k][v] is the CRC
+ * of byte v followed by k+1 zero bytes */
+static unsigned int crc16_slice[3][256];
+
+void InitMusicCRC(void)
+{
+    int i, k;
+    for (i=0; i<256; ++i) {
+        unsigned int crc = crc16_lookup[i];
+        for (k=0; k<3; ++k) {
+            crc = (crc>>8) ^ crc16_lookup[crc & 0xff];
+            crc16_slice[k][i] = crc;
+        }
+    }
+}
+
+/* the music CRC covers every output byte, so do four bytes per step */
 void UpdateMusicCRC(uint16_t *crc,unsigned char *buffer, int size){
-    int i;
-    for (i=0; i<size; ++i) 
-        *crc = CRC_update_lookup(buffer[i],*crc);
+    unsigned int c = *crc;
+    int i = 0;
+    for (; i+4<=size; i+=4) {
+        c ^= buffer[i] | (buffer[i+1] << 8);
+        c = crc16_slice[2][c & 0xff] ^ crc16_slice[1][c >> 8]
+          ^ crc16_slice[0][buffer[i+2]] ^ crc16_lookup[buffer[i+3]];
+    }
+    for (; i<size; ++i)
+        c = CRC_update_lookup(buffer[i],c);
+    *crc = c;
 }
 
 
@@ -507,18 +639,16 @@ void UpdateMusicCRC(uint16_t *crc,unsigned char *buffer, int size){
  * PutLameVBR: Write LAME info: mini version + info on various switches used
  * Paramters:
  *				pbtStreamBuffer	: pointer to output buffer  
- *				id3v2size		: size of id3v2 tag in bytes
  *				crc				: computation of crc-16 of Lame Tag so far (starting at frame sync)
  *				
  ****************************************************************************
 */
-int PutLameVBR(lame_global_flags *gfp, FILE *fpStream, uint8_t *pbtStreamBuffer, uint32_t id3v2size,  uint16_t crc)
+int PutLameVBR(lame_global_flags *gfp, uint8_t *pbtStreamBuffer, uint16_t crc)
 {
     lame_internal_flags *gfc = gfp->internal_flags;
 /*	FLOAT fVersion = LAME_MAJOR_VERSION + 0.01 * LAME_MINOR_VERSION; */
 
 	int nBytesWritten = 0;
-	int nFilesize	  = 0;		/*size of fpStream. Will be equal to size after process finishes. */
 	int i;
 
     int enc_delay=lame_get_encoder_delay(gfp);       /* encoder delay */
@@ -695,12 +825,8 @@ int PutLameVBR(lame_global_flags *gfp, FILE *fpStream, uint8_t *pbtStreamBuffer,
 
 
 	
-	/*get filesize */
-	fseek(fpStream, 0, SEEK_END);
-	nFilesize = ftell(fpStream);
-
-	
-	nMusicLength = nFilesize - id3v2size;		/*omit current frame */
+	/*everything LAME has output, less the ID3 tags */
+	nMusicLength = gfc->nBytesOutput - gfc->nVbrTagOffset;
 	if (bId3v1Present)
 		nMusicLength-=128;                     /*id3v1 present. */
         nMusicCRC = gfc->nMusicCRC;
@@ -770,82 +896,38 @@ int PutLameVBR(lame_global_flags *gfp, FILE *fpStream, uint8_t *pbtStreamBuffer,
 	return nBytesWritten;
 }
 
-/***********************************************************************
- * 
- * PutVbrTag: Write final VBR tag to the file
- * Paramters:
- *				lpszFileName: filename of MP3 bit stream
- *				nVbrScale	: encoder quality indicator (0..100)
- ****************************************************************************
-*/
-int PutVbrTag(lame_global_flags *gfp,FILE *fpStream,int nVbrScale)
+
+/* the tag frame of a file where prefix bytes of the caller's own come
+ * before LAME's output: they count in the Xing file size */
+static size_t MakeVbrTagFrame(const lame_global_flags *gfp, unsigned char *buffer, size_t size, unsigned long prefix)
 {
     lame_internal_flags * gfc = gfp->internal_flags;
 
-	long lFileSize;
 	int nStreamIndex;
 	char abyte,bbyte;
 	uint8_t		btToc[NUMTOCENTRIES];
-	uint8_t pbtStreamBuffer[MAXFRAMESIZE];
 	
 	int i;
 	uint16_t crc = 0x00;
-	
-    unsigned char id3v2Header[10];
-    size_t id3v2TagSize;
 
+    if (gfc == NULL || gfc->Class_ID != LAME_ID || !gfp->bWriteVbrTag)
+	return 0;
     if (gfc->VBR_seek_table.pos <= 0)
-	return -1;
-
+	return 0;
+    if (size < (size_t)gfp->TotalFrameSize)
+	return gfp->TotalFrameSize;
 
 	/* Clear stream buffer */
-	memset(pbtStreamBuffer,0x00,sizeof(pbtStreamBuffer));
-
-	/* Seek to end of file*/
-	fseek(fpStream,0,SEEK_END);
-
-	/* Get file size */
-	lFileSize=ftell(fpStream);
-
-	/* Abort if file has zero length. Yes, it can happen :) */
-	if (lFileSize==0)
-		return -1;
-
-        /*
-         * The VBR tag may NOT be located at the beginning of the stream.
-         * If an ID3 version 2 tag was added, then it must be skipped to write
-         * the VBR tag data.
-         */
-
-        /* seek to the beginning of the stream */
-	fseek(fpStream,0,SEEK_SET);
-        /* read 10 bytes in case there's an ID3 version 2 header here */
-        fread(id3v2Header,1,sizeof id3v2Header,fpStream);
-        /* does the stream begin with the ID3 version 2 file identifier? */
-        if (!strncmp((char *)id3v2Header,"ID3",3)) {
-          /* the tag size (minus the 10-byte header) is encoded into four
-           * bytes where the most significant bit is clear in each byte */
-          id3v2TagSize=(((id3v2Header[6] & 0x7f)<<21)
-            | ((id3v2Header[7] & 0x7f)<<14)
-            | ((id3v2Header[8] & 0x7f)<<7)
-            | (id3v2Header[9] & 0x7f))
-            + sizeof id3v2Header;
-        } else {
-          /* no ID3 version 2 tag in this stream */
-          id3v2TagSize=0;
-        }
+	memset(buffer,0x00,gfp->TotalFrameSize);
 
-	/* Seek to first real frame */
-	fseek(fpStream,id3v2TagSize+gfp->TotalFrameSize,SEEK_SET);
-
-	/* Read the header (first valid frame) */
-	fread(pbtStreamBuffer,4,1,fpStream);
+	/* the header of the first real frame */
+	memcpy(buffer,gfc->VbrFirstHeader,4);
 
 	/* the default VBR header. 48 kbps layer III, no padding, no crc */
 	/* but sampling freq, mode andy copyright/copy protection taken */
 	/* from first valid frame */
-	pbtStreamBuffer[0]=(uint8_t) 0xff;
-	abyte = (pbtStreamBuffer[1] & (char) 0xf1);
+	buffer[0]=(uint8_t) 0xff;
+	abyte = (buffer[1] & (char) 0xf1);
 	{	
 		int bitrate;
 		if (1==gfp->version) {
@@ -871,14 +953,14 @@ int PutVbrTag(lame_global_flags *gfp,FILE *fpStream,int nVbrScale)
 	 */ 
 	if (gfp->version==1) {
 	  /* MPEG1 */
-	  pbtStreamBuffer[1]=abyte | (char) 0x0a;     /* was 0x0b; */
-	  abyte = pbtStreamBuffer[2] & (char) 0x0d;   /* AF keep also private bit */
-	  pbtStreamBuffer[2]=(char) bbyte | abyte;     /* 64kbs MPEG1 frame */
+	  buffer[1]=abyte | (char) 0x0a;     /* was 0x0b; */
+	  abyte = buffer[2] & (char) 0x0d;   /* AF keep also private bit */
+	  buffer[2]=(char) bbyte | abyte;     /* 64kbs MPEG1 frame */
 	}else{
 	  /* MPEG2 */
-	  pbtStreamBuffer[1]=abyte | (char) 0x02;     /* was 0x03; */
-	  abyte = pbtStreamBuffer[2] & (char) 0x0d;   /* AF keep also private bit */
-	  pbtStreamBuffer[2]=(char) bbyte | abyte;     /* 64kbs MPEG2 frame */
+	  buffer[1]=abyte | (char) 0x02;     /* was 0x03; */
+	  abyte = buffer[2] & (char) 0x0d;   /* AF keep also private bit */
+	  buffer[2]=(char) bbyte | abyte;     /* 64kbs MPEG2 frame */
 	}
 
 	/* Clear all TOC entries */
@@ -905,63 +987,148 @@ int PutVbrTag(lame_global_flags *gfp,FILE *fpStream,int nVbrScale)
 	/* Put Vbr tag */
 	if (gfp->VBR == vbr_off)
 	{
-		pbtStreamBuffer[nStreamIndex++]=VBRTag2[0];
-		pbtStreamBuffer[nStreamIndex++]=VBRTag2[1];
-		pbtStreamBuffer[nStreamIndex++]=VBRTag2[2];
-		pbtStreamBuffer[nStreamIndex++]=VBRTag2[3];
+		buffer[nStreamIndex++]=VBRTag2[0];
+		buffer[nStreamIndex++]=VBRTag2[1];
+		buffer[nStreamIndex++]=VBRTag2[2];
+		buffer[nStreamIndex++]=VBRTag2[3];
 
 	}
 	else
 	{
-		pbtStreamBuffer[nStreamIndex++]=VBRTag[0];
-		pbtStreamBuffer[nStreamIndex++]=VBRTag[1];
-		pbtStreamBuffer[nStreamIndex++]=VBRTag[2];
-		pbtStreamBuffer[nStreamIndex++]=VBRTag[3];
+		buffer[nStreamIndex++]=VBRTag[0];
+		buffer[nStreamIndex++]=VBRTag[1];
+		buffer[nStreamIndex++]=VBRTag[2];
+		buffer[nStreamIndex++]=VBRTag[3];
 	}	
 
 	/* Put header flags */
-	CreateI4(&pbtStreamBuffer[nStreamIndex],FRAMES_FLAG+BYTES_FLAG+TOC_FLAG+VBR_SCALE_FLAG);
+	CreateI4(&buffer[nStreamIndex],FRAMES_FLAG+BYTES_FLAG+TOC_FLAG+VBR_SCALE_FLAG);
 	nStreamIndex+=4;
 
 	/* Put Total Number of frames */
-	CreateI4(&pbtStreamBuffer[nStreamIndex],gfp->nVbrNumFrames);
+	CreateI4(&buffer[nStreamIndex],gfp->nVbrNumFrames);
 	nStreamIndex+=4;
 
 	/* Put Total file size */
-	CreateI4(&pbtStreamBuffer[nStreamIndex],(int)lFileSize);
+	CreateI4(&buffer[nStreamIndex],(int)(gfc->nBytesOutput + prefix));
 	nStreamIndex+=4;
 
 	/* Put TOC */
-	memcpy(&pbtStreamBuffer[nStreamIndex],btToc,sizeof(btToc));
+	memcpy(&buffer[nStreamIndex],btToc,sizeof(btToc));
 	nStreamIndex+=sizeof(btToc);
 
 
 	if (gfp->error_protection) {
 	  /* (jo) error_protection: add crc16 information to header */
-	  CRC_writeheader(gfc, (char*)pbtStreamBuffer);
+	  CRC_writeheader(gfc, (char*)buffer);
 	}
 
 
 
 	/*work out CRC so far: initially crc = 0 */
 	for (i = 0;i< nStreamIndex ;i++)
-		crc = CRC_update_lookup(pbtStreamBuffer[i], crc);
+		crc = CRC_update_lookup(buffer[i], crc);
 
 	/*Put LAME VBR info*/
-	nStreamIndex+=PutLameVBR(gfp, fpStream, pbtStreamBuffer + nStreamIndex, id3v2TagSize,crc);
+	nStreamIndex+=PutLameVBR((lame_global_flags *)gfp, buffer + nStreamIndex, crc);
 
 #ifdef DEBUG_VBRTAG
 	{
 	  VBRTAGDATA TestHeader;
-	  GetVbrTag(&TestHeader,pbtStreamBuffer);
+	  GetVbrTag(&TestHeader,buffer);
 	}
 #endif
 
-	/*Seek to the beginning of the stream */
-	fseek(fpStream,id3v2TagSize,SEEK_SET);
+	return gfp->TotalFrameSize;
+}
+
+/***********************************************************************
+ * 
+ * lame_get_lametag_frame: Build the final VBR tag frame in memory
+ * Paramters:
+ *				buffer	: receives the frame
+ *				size	: size of buffer
+ * Returns the frame size, or the size needed if buffer is too small,
+ * or 0 if there is no tag to write.  Needs no access to the output:
+ * the TOC, the music CRC and the byte counts are kept up to date while
+ * the frames are made.
+ ****************************************************************************
+*/
+size_t lame_get_lametag_frame(const lame_global_flags *gfp, unsigned char *buffer, size_t size)
+{
+    return MakeVbrTagFrame(gfp, buffer, size, 0);
+}
+
+/* is there an all 0's frame of n bytes at offset? */
+static int IsDummyFrame(FILE *fpStream, long offset, size_t n)
+{
+	uint8_t buf[MAXFRAMESIZE];
+	size_t i;
+
+	if (offset < 0 || fseek(fpStream, offset, SEEK_SET) != 0
+	    || fread(buf, 1, n, fpStream) != n)
+		return 0;
+	for (i = 0; i < n; i++)
+		if (buf[i] != 0)
+			return 0;
+	return 1;
+}
+
+/***********************************************************************
+ * 
+ * PutVbrTag: Write final VBR tag to the file
+ * Paramters:
+ *				fpStream: the file LAME's output was written to
+ * Overwrites the dummy frame in place, where LAME put it.  If it is not
+ * there, the caller wrote something of its own first: the dummy frame is
+ * looked for that far behind, if fpStream is positioned at the end of
+ * the file, then behind an ID3v2 tag at the start of the file.  Nothing
+ * is written if it is not found.
+ ****************************************************************************
+*/
+int PutVbrTag(lame_global_flags *gfp,FILE *fpStream)
+{
+    lame_internal_flags * gfc = gfp->internal_flags;
+	uint8_t pbtStreamBuffer[MAXFRAMESIZE];
+	uint8_t id3v2Header[10];
+	size_t n;
+	long offset, pos;
+
+	n = MakeVbrTagFrame(gfp, pbtStreamBuffer, sizeof(pbtStreamBuffer), 0);
+	if (n == 0 || n > sizeof(pbtStreamBuffer))
+		return -1;
+
+	pos = ftell(fpStream);
+	offset = (long)gfc->nVbrTagOffset;
+	if (!IsDummyFrame(fpStream, offset, n)) {
+		offset += pos - (long)gfc->nBytesOutput;
+		if (pos < (long)gfc->nBytesOutput
+		    || fseek(fpStream, 0, SEEK_END) != 0
+		    || ftell(fpStream) != pos
+		    || !IsDummyFrame(fpStream, offset, n)) {
+			/* 10 byte ID3v2 header, the size as 4 bytes of 7 bits */
+			if (fseek(fpStream, 0, SEEK_SET) != 0
+			    || fread(id3v2Header, 1, sizeof id3v2Header, fpStream)
+			       != sizeof id3v2Header
+			    || strncmp((char *)id3v2Header, "ID3", 3) != 0)
+				return -1;
+			offset = (((id3v2Header[6] & 0x7f) << 21)
+			          | ((id3v2Header[7] & 0x7f) << 14)
+			          | ((id3v2Header[8] & 0x7f) << 7)
+			          | (id3v2Header[9] & 0x7f))
+			    + sizeof id3v2Header + (long)gfc->nVbrTagOffset;
+			if (!IsDummyFrame(fpStream, offset, n))
+				return -1;
+		}
+		MakeVbrTagFrame(gfp, pbtStreamBuffer, sizeof(pbtStreamBuffer),
+				offset - (long)gfc->nVbrTagOffset);
+	}
+
+	if (fseek(fpStream, offset, SEEK_SET) != 0)
+		return -1;
 
         /* Put it all to disk again */
-	if (fwrite(pbtStreamBuffer,(unsigned int)gfp->TotalFrameSize,1,fpStream)!=1)
+	if (fwrite(pbtStreamBuffer,n,1,fpStream)!=1)
 	{
 		return -1;
 	}
@@ -971,3 +1138,126 @@ int PutVbrTag(lame_global_flags *gfp,FILE *fpStream,int nVbrScale)
 }
 
 
+/***********************************************************************
+ * 
+ * lame_get_seek_index: Copy the sidecar seek index into buffer
+ * big endian:
+ *	 0	"LIDX"
+ *	 4	2 bytes	version (1)
+ *	 6	2 bytes	frames per entry
+ *	 8	4 bytes	sample rate
+ *	12	2 bytes	samples per frame
+ *	14	2 bytes	encoder delay
+ *	16	2 bytes	encoder padding
+ *	18	4 bytes	number of frames
+ *	22	4 bytes	end of the last frame, in bytes
+ *	26	4 bytes	number of entries, followed by the entries
+ *			(see AddSeekIndexFrame)
+ * Returns the index size, or the size needed if buffer is too small,
+ * or 0 if there is no index.
+ ****************************************************************************
+*/
+size_t lame_get_seek_index(const lame_global_flags *gfp, unsigned char *buffer, size_t size)
+{
+    lame_internal_flags *gfc = gfp->internal_flags;
+    seek_index_t *v;
+    size_t n;
+    unsigned long end;
+
+    if (gfc == NULL || gfc->Class_ID != LAME_ID || gfp->seek_index_interval <= 0)
+        return 0;
+    v = &gfc->seek_index;
+    n = SEEK_INDEX_HEADERSIZE + (size_t)v->count * SEEK_INDEX_ENTRYSIZE;
+    if (size < n)
+        return n;
+
+    /* everything LAME has output, less an ID3v1 tag */
+    end = gfc->nBytesOutput;
+    if ((gfc->tag_spec.flags & CHANGED_FLAG)
+        && !(gfc->tag_spec.flags & V2_ONLY_FLAG))
+        end -= 128;
+
+    memcpy(buffer, "LIDX", 4);
+    CreateI2(buffer + 4, 1);
+    CreateI2(buffer + 6, gfp->seek_index_interval);
+    CreateI4(buffer + 8, gfp->out_samplerate);
+    CreateI2(buffer + 12, gfp->framesize);
+    CreateI2(buffer + 14, lame_get_encoder_delay(gfp));
+    CreateI2(buffer + 16, lame_get_encoder_padding(gfp));
+    CreateI4(buffer + 18, v->frames);
+    CreateI4(buffer + 22, end);
+    CreateI4(buffer + 26, v->count);
+    memcpy(buffer + SEEK_INDEX_HEADERSIZE, v->bag,
+           (size_t)v->count * SEEK_INDEX_ENTRYSIZE);
+    return n;
+}
+
+/***********************************************************************
+ * 
+ * lame_seek_index_lookup: Map start and end time to a byte range
+ * Paramters:
+ *				index, size	: a seek index, as from lame_get_seek_index
+ *				start, end	: seconds, end <= start means to the end
+ *				begin_byte, end_byte	: range to fetch and decode
+ *				frame_byte	: the indexed frame, decoding before it
+ *							  only fills the bit reservoir
+ *				skip		: samples to drop, counted from frame_byte
+ * Decoding restarts at an indexed frame two granules ahead of start, for
+ * the IMDCT overlap and the synthesis filter.  The frames holding its
+ * main data are prerolled: mpglib drops granules whose reservoir it has
+ * not seen, so the output can only be counted from the indexed frame.
+ * Assumes the decoder delay of mpglib, 528+1 samples.
+ * Returns 0, or -1 if index is not a valid seek index.
+ ****************************************************************************
+*/
+int lame_seek_index_lookup(const unsigned char *index, size_t size,
+                           double start, double end,
+                           unsigned long *begin_byte, unsigned long *frame_byte,
+                           unsigned long *end_byte, unsigned long *skip)
+{
+    unsigned long interval, samplerate, framesize, delay, last, count;
+    unsigned long s, k, i;
+    const unsigned char *e;
+
+    if (size < SEEK_INDEX_HEADERSIZE || memcmp(index, "LIDX", 4) != 0
+        || ExtractI2(index + 4) != 1)
+        return -1;
+    interval   = ExtractI2(index + 6);
+    samplerate = (unsigned long)ExtractI4(index + 8);
+    framesize  = ExtractI2(index + 12);
+    delay      = ExtractI2(index + 14) + 528 + 1;
+    last       = (unsigned long)ExtractI4(index + 22);
+    count      = (unsigned long)ExtractI4(index + 26);
+    if (interval == 0 || samplerate == 0 || framesize == 0 || count == 0
+        || (size - SEEK_INDEX_HEADERSIZE) / SEEK_INDEX_ENTRYSIZE < count)
+        return -1;
+    e = index + SEEK_INDEX_HEADERSIZE;
+
+    /* start: the last entry at least two granules ahead */
+    s = (start > 0 ? (unsigned long)(start * samplerate + .5) : 0) + delay;
+    k = s >= 2 * 576 ? (s - 2 * 576) / framesize : 0;
+    i = k / interval;
+    if (i >= count)
+        i = count - 1;
+    while (i > 0 && ExtractI2(e + i * SEEK_INDEX_ENTRYSIZE + 4)
+                    == SEEK_INDEX_UNKNOWN)
+        --i;
+    if (ExtractI2(e + i * SEEK_INDEX_ENTRYSIZE + 4) < SEEK_INDEX_PREROLL)
+        i = 0;  /* too close to the first frame, decode from there */
+    e += i * SEEK_INDEX_ENTRYSIZE;
+    *frame_byte = (unsigned long)ExtractI4(e);
+    *begin_byte = *frame_byte - ExtractI2(e + 4);
+    *skip = s - i * interval * framesize;
+
+    /* end: the first entry after the frame holding end */
+    *end_byte = last;
+    if (end > start) {
+        s = (unsigned long)(end * samplerate + .5) + delay;
+        k = (s - 1) / framesize + 1;
+        i = (k + interval - 1) / interval;
+        if (i < count)
+            *end_byte = (unsigned long)ExtractI4(index + SEEK_INDEX_HEADERSIZE
+                                                 + i * SEEK_INDEX_ENTRYSIZE);
+    }
+    return 0;
+}
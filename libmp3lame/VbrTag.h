@@ -81,9 +81,12 @@ int GetVbrTag(VBRTAGDATA *pTagData,  unsigned char *buf);
 
 int SeekPoint(unsigned char TOC[NUMTOCENTRIES], int file_bytes, float percent);
 int InitVbrTag(lame_global_flags *gfp);
-int PutVbrTag(lame_global_flags *gfp,FILE *fid,int nVbrScale);
-int PutLameVBR(lame_global_flags *gfp, FILE *fpStream, uint8_t *pbtStreamBuffer, uint32_t id3v2size,  uint16_t crc);
+int PutVbrTag(lame_global_flags *gfp,FILE *fid);
+int PutLameVBR(lame_global_flags *gfp, uint8_t *pbtStreamBuffer, uint16_t crc);
 void AddVbrFrame(lame_global_flags *gfp);
+void AddVbrFrameHeader(lame_global_flags *gfp, const unsigned char *header);
+void AddSeekIndexFrame(lame_global_flags *gfp, unsigned long offset, const unsigned char *header);
+void InitMusicCRC(void);
 void UpdateMusicCRC(uint16_t *crc,unsigned char *buffer, int size);
 
 #endif
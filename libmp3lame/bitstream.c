@@ -43,8 +43,7 @@
 #endif
 
 /* unsigned int is at least this large:  */
-/* we work with ints, so when doing bit manipulation, we limit
- * ourselves to MAX_LENGTH-2 just to be on the safe side */
+/* maximum number of bits written by one putbits2() call */
 #define MAX_LENGTH      32  
 
 
@@ -89,7 +88,15 @@ void putheader_bits(lame_internal_flags *gfc,int w_ptr)
     hoge += gfc->sideinfo_len * 8;
     hogege += gfc->sideinfo_len * 8;
 #endif
-    memcpy(&bs->buf[bs->buf_byte_idx], gfc->header[gfc->w_ptr].buf,
+    assert(bs->cache_bits == 0);
+    assert(bs->buf_byte_idx + gfc->sideinfo_len < BUFFER_SIZE);
+    if (gfc->gfp->seek_index_interval > 0)
+        AddSeekIndexFrame(gfc->gfp, gfc->nBytesOutput + bs->buf_byte_idx + 1,
+                          (unsigned char *)gfc->header[gfc->w_ptr].buf);
+    if (gfc->gfp->frame_info)
+        add_frame_info(gfc, gfc->nBytesOutput + bs->buf_byte_idx + 1,
+                       (unsigned char *)gfc->header[gfc->w_ptr].buf);
+    memcpy(&bs->buf[bs->buf_byte_idx + 1], gfc->header[gfc->w_ptr].buf,
 	   gfc->sideinfo_len);
     bs->buf_byte_idx += gfc->sideinfo_len;
     bs->totbit += gfc->sideinfo_len * 8;
@@ -98,71 +105,81 @@ void putheader_bits(lame_internal_flags *gfc,int w_ptr)
 
 
 
+/* Bits are collected right aligned in the 64 bit bs->cache and stored
+ * into bs->buf four bytes at a time, so a put is a shift, an or and
+ * a compare.  j may be up to 32.  */
+inline static void
+putbits_cache(Bit_stream_struc *bs, unsigned int val, int j)
+{
+    assert(j <= MAX_LENGTH);
+    assert(j == MAX_LENGTH || (val >> j) == 0);
+    assert(bs->cache_bits < 32);
+
+    bs->cache = (bs->cache << j) | val;
+    bs->cache_bits += j;
+    bs->totbit += j;
+
+    if (bs->cache_bits >= 32) {
+	unsigned char *p = &bs->buf[bs->buf_byte_idx + 1];
+	uint32_t w;
+	bs->cache_bits -= 32;
+	w = (uint32_t) (bs->cache >> bs->cache_bits);
+	assert(bs->buf_byte_idx + 4 < BUFFER_SIZE);
+	p[0] = (unsigned char) (w >> 24);
+	p[1] = (unsigned char) (w >> 16);
+	p[2] = (unsigned char) (w >> 8);
+	p[3] = (unsigned char) w;
+	bs->buf_byte_idx += 4;
+    }
+}
+
+/* store the remaining cached bits, only possible on a byte boundary */
+inline static void
+putbits_flush(Bit_stream_struc *bs)
+{
+    assert((bs->cache_bits & 7) == 0);
+    while (bs->cache_bits > 0) {
+	bs->cache_bits -= 8;
+	assert(bs->buf_byte_idx + 1 < BUFFER_SIZE);
+	bs->buf[++bs->buf_byte_idx] = (unsigned char) (bs->cache >> bs->cache_bits);
+    }
+}
 
 /*write j bits into the bit stream */
+/* The side info of a pending frame is inserted as soon as the bit
+ * counter reaches its write_timing.  This is checked once per call
+ * instead of once per byte.  */
 inline static void
-putbits2(lame_internal_flags *gfc, int val, int j)
+putbits2(lame_internal_flags *gfc, unsigned int val, int j)
 {
     Bit_stream_struc *bs;
+    int room;
     bs = &gfc->bs;
 
-    assert(j < MAX_LENGTH-2);
+    if (j == 0)
+	return;
+    room = gfc->header[gfc->w_ptr].write_timing - bs->totbit;
+    assert(room >= 0);
 
-    while (j > 0) {
-	int k;
-	if (bs->buf_bit_idx == 0) {
-	    bs->buf_bit_idx = 8;
-	    bs->buf_byte_idx++;
-	    assert(bs->buf_byte_idx < BUFFER_SIZE);
-	    assert(gfc->header[gfc->w_ptr].write_timing >= bs->totbit);
-	    if (gfc->header[gfc->w_ptr].write_timing == bs->totbit) {
-	      putheader_bits(gfc,gfc->w_ptr);
-	    }
-	    bs->buf[bs->buf_byte_idx] = 0;
+    while (j > room) {
+	int k = j - room;
+	if (room > 0) {
+	    putbits_cache(bs, val >> k, room);
+	    val &= (1U << k) - 1;
 	}
-
-	k = Min(j, bs->buf_bit_idx);
-	j -= k;
-        
-	bs->buf_bit_idx -= k;
-        
-	assert (j < MAX_LENGTH); /* 32 too large on 32 bit machines */
-        assert (bs->buf_bit_idx < MAX_LENGTH); 
-	
-        bs->buf[bs->buf_byte_idx] |= ((val >> j) << bs->buf_bit_idx);
-	bs->totbit += k;
+	j = k;
+	putbits_flush(bs);
+	putheader_bits(gfc,gfc->w_ptr);
+	room = gfc->header[gfc->w_ptr].write_timing - bs->totbit;
     }
+    putbits_cache(bs, val, j);
 }
 
 /*write j bits into the bit stream, ignoring frame headers */
 inline static void
 putbits_noheaders(lame_internal_flags *gfc, int val, int j)
 {
-    Bit_stream_struc *bs;
-    bs = &gfc->bs;
-
-    assert(j < MAX_LENGTH-2);
-
-    while (j > 0) {
-	int k;
-	if (bs->buf_bit_idx == 0) {
-	    bs->buf_bit_idx = 8;
-	    bs->buf_byte_idx++;
-	    assert(bs->buf_byte_idx < BUFFER_SIZE);
-	    bs->buf[bs->buf_byte_idx] = 0;
-	}
-
-	k = Min(j, bs->buf_bit_idx);
-	j -= k;
-        
-	bs->buf_bit_idx -= k;
-        
-	assert (j < MAX_LENGTH); /* 32 too large on 32 bit machines */
-        assert (bs->buf_bit_idx < MAX_LENGTH); 
-	
-        bs->buf[bs->buf_byte_idx] |= ((val >> j) << bs->buf_bit_idx);
-	bs->totbit += k;
-    }
+    putbits_cache(&gfc->bs, val, j);
 }
 
 
@@ -206,9 +223,19 @@ drain_into_ancillary(lame_global_flags *gfp, int remainingBits)
 	}
     }
 
-    for (; remainingBits >= 1; remainingBits -= 1 ) {
-        putbits2(gfc, gfc->ancillary_flag, 1 );
-	gfc->ancillary_flag ^= !gfp->disable_reservoir;
+    /* the ancillary flag toggles with every bit unless the reservoir
+     * is disabled, write up to 32 of these bits at once */
+    while (remainingBits > 0) {
+	int k = Min(remainingBits, MAX_LENGTH);
+	unsigned int pattern;
+	if (!gfp->disable_reservoir)
+	    pattern = gfc->ancillary_flag ? 0xAAAAAAAAU : 0x55555555U;
+	else
+	    pattern = gfc->ancillary_flag ? 0xFFFFFFFFU : 0U;
+	putbits2(gfc, pattern >> (MAX_LENGTH - k), k);
+	if (!gfp->disable_reservoir)
+	    gfc->ancillary_flag ^= k & 1;
+	remainingBits -= k;
     }
 
     assert (remainingBits == 0);
@@ -233,26 +260,36 @@ writeheader(lame_internal_flags *gfc,int val, int j)
 }
 
 
-static int
-CRC_update(int value, int crc)
-{
-    int i;
-    value <<= 8;
-    for (i = 0; i < 8; i++) {
-	value <<= 1;
-	crc <<= 1;
+/* CRC-16 (x^16+x^15+x^2+1, MSB first) of every byte value,
+ * see init_crc16_table() */
+static unsigned int crc16_table[256];
 
-	if (((crc ^ value) & 0x10000))
-	    crc ^= CRC16_POLYNOMIAL;
+static void
+init_crc16_table(void)
+{
+    int i, j;
+    for (i = 0; i < 256; i++) {
+	unsigned int crc = i << 8;
+	for (j = 0; j < 8; j++) {
+	    crc <<= 1;
+	    if (crc & 0x10000)
+		crc ^= CRC16_POLYNOMIAL;
+	}
+	crc16_table[i] = crc & 0xffff;
     }
-    return crc;
+}
+
+inline static unsigned int
+CRC_update(int value, unsigned int crc)
+{
+    return ((crc << 8) ^ crc16_table[((crc >> 8) ^ value) & 0xff]) & 0xffff;
 }
 
 
 void
 CRC_writeheader(lame_internal_flags *gfc, char *header)
 {
-    int crc = 0xffff; /* (jo) init crc16 for error_protection */
+    unsigned int crc = 0xffff; /* (jo) init crc16 for error_protection */
     int i;
 
     crc = CRC_update(((unsigned char*)header)[2], crc);
@@ -564,8 +601,14 @@ Huffmancode( lame_internal_flags* const gfc, const int tableindex,
 	assert ( cbits <= MAX_LENGTH );
 	assert ( xbits <= MAX_LENGTH );
 
-	putbits2(gfc, h->table [x1], cbits );
-	putbits2(gfc, ext,  xbits );
+	/* codeword, sign and linbits go out in one write if they fit */
+	if (cbits + xbits <= MAX_LENGTH) {
+	    putbits2(gfc, ((unsigned int) h->table [x1] << xbits) | ext,
+		     cbits + xbits );
+	} else {
+	    putbits2(gfc, h->table [x1], cbits );
+	    putbits2(gfc, ext,  xbits );
+	}
 	bits += cbits + xbits;
     }
     return bits;
@@ -810,6 +853,7 @@ flush_bitstream(lame_global_flags *gfp)
 
   if ((flushbits = compute_flushbits(gfp,&nbytes)) < 0) return;  
   drain_into_ancillary(gfp, flushbits);
+  putbits_flush(&gfc->bs);
 
   /* check that the 100% of the last frame has been written to bitstream */
   assert (gfc->header[last_ptr].write_timing + getframebits(gfp)
@@ -856,6 +900,7 @@ void  add_dummy_byte ( lame_global_flags* const gfp, unsigned char val )
   int i;
 
   putbits_noheaders(gfc, val, 8);   
+  putbits_flush(&gfc->bs);
 
   for (i=0 ; i< MAX_HEADER_BUF ; ++i) 
     gfc->header[i].write_timing += 8;
@@ -889,6 +934,7 @@ format_bitstream(lame_global_flags *gfp)
     bits+=writeMainData(gfp);
     drain_into_ancillary(gfp, l3_side->resvDrain_post);
     bits += l3_side->resvDrain_post;
+    putbits_flush(&gfc->bs);
 
     l3_side->main_data_begin += (bitsPerFrame-bits)/8;
 
@@ -948,7 +994,7 @@ format_bitstream(lame_global_flags *gfp)
 
 
 /* copy data out of the internal MP3 bit buffer into a user supplied
-   unsigned char buffer.
+   unsigned char buffer, or hand it to the output callback in place.
 
    mp3data=0      indicates data in buffer is an id3tags and VBR tags
    mp3data=1      data is real mp3 frame data. 
@@ -958,12 +1004,18 @@ format_bitstream(lame_global_flags *gfp)
 int copy_buffer(lame_internal_flags *gfc,unsigned char *buffer,int size,int mp3data) 
 {
     Bit_stream_struc *bs=&gfc->bs;
+    lame_global_flags *gfp = gfc->gfp;
     int minimum = bs->buf_byte_idx + 1;
     if (minimum <= 0) return 0;
-    if (size!=0 && minimum>size) return -1; /* buffer is too small */
-    memcpy(buffer,bs->buf,minimum);
+    assert(bs->cache_bits == 0);
+    if (gfp->output.func != NULL)
+        buffer = bs->buf;
+    else {
+        if (size!=0 && minimum>size) return -1; /* buffer is too small */
+        memcpy(buffer,bs->buf,minimum);
+    }
     bs->buf_byte_idx = -1;
-    bs->buf_bit_idx = 0;
+    gfc->nBytesOutput += minimum;
     
     if (mp3data) {
         UpdateMusicCRC(&gfc->nMusicCRC,buffer,minimum);
@@ -1026,10 +1078,67 @@ int copy_buffer(lame_internal_flags *gfc,unsigned char *buffer,int size,int mp3d
 #endif
   
     } /* if (mp3data) */
+
+    if (gfp->output.func != NULL
+        && gfp->output.func(gfp->output.user, buffer, minimum) != 0)
+        return -7;
     return minimum;
 }
 
 
+/* records a frame for lame_take_frame_info() as its header goes into the
+   bitstream.  offset is where, header the header and side info */
+void add_frame_info(lame_internal_flags *gfc, unsigned long offset,
+                    const unsigned char *header)
+{
+    lame_global_flags *gfp = gfc->gfp;
+    frame_info_t *v = &gfc->frame_info;
+    const unsigned char *si = header + (gfp->error_protection ? 6 : 4);
+    lame_frame_info *f;
+    int kbps;
+
+    if (v->count == v->size) {
+        int size = v->size ? 2 * v->size : 64;
+        lame_frame_info *bag = realloc(v->bag, size * sizeof(*bag));
+        if (bag == NULL) {
+            ERRORF(gfc,"Error: can't allocate frame info buffer\n");
+            gfp->frame_info = 0;
+            return;
+        }
+        v->bag = bag;
+        v->size = size;
+    }
+    f = &v->bag[v->count++];
+    f->offset = offset;
+    f->bitrate_index = header[2] >> 4;
+    f->padding = (header[2] >> 1) & 1;
+    kbps = f->bitrate_index ? bitrate_table[gfp->version][f->bitrate_index]
+        : gfp->brate;
+    f->size = (gfp->version+1)*72000*kbps / gfp->out_samplerate + f->padding;
+    f->first_sample = (long) (v->frames++ * gfp->framesize) - gfp->encoder_delay;
+    if (gfp->version == 1)
+        f->main_data_begin = (si[0] << 1) | (si[1] >> 7);
+    else
+        f->main_data_begin = si[0];
+}
+
+int lame_take_frame_info(lame_global_flags *gfp, lame_frame_info info[], int max)
+{
+    lame_internal_flags *gfc = gfp->internal_flags;
+    frame_info_t *v;
+    int n;
+
+    if (gfc == NULL || gfc->Class_ID != LAME_ID || max <= 0)
+        return 0;
+    v = &gfc->frame_info;
+    n = v->count < max ? v->count : max;
+    memcpy(info, v->bag, n * sizeof(*info));
+    memmove(v->bag, v->bag + n, (v->count - n) * sizeof(*info));
+    v->count -= n;
+    return n;
+}
+
+
 void init_bit_stream_w(lame_internal_flags *gfc)
 {
    gfc->bs.buf = (unsigned char *)       malloc(BUFFER_SIZE);
@@ -1038,8 +1147,12 @@ void init_bit_stream_w(lame_internal_flags *gfc)
    gfc->h_ptr = gfc->w_ptr = 0;
    gfc->header[gfc->h_ptr].write_timing = 0;
    gfc->bs.buf_byte_idx = -1;
-   gfc->bs.buf_bit_idx = 0;
+   gfc->bs.cache = 0;
+   gfc->bs.cache_bits = 0;
    gfc->bs.totbit = 0;
+
+   init_crc16_table();
+   InitMusicCRC();
 }
 
 /* end of bitstream.c */
@@ -31,6 +31,7 @@ void flush_bitstream(lame_global_flags *gfp);
 void add_dummy_byte ( lame_global_flags* const gfp, unsigned char val );
 
 int  copy_buffer(lame_internal_flags *gfc,unsigned char *buffer,int buffer_size,int update_crc);
+void add_frame_info(lame_internal_flags *gfc, unsigned long offset, const unsigned char *header);
 void init_bit_stream_w(lame_internal_flags *gfc);
 void CRC_writeheader (lame_internal_flags *gfc, char *buffer);
 int compute_flushbits(const lame_global_flags *gfp, int *nbytes);
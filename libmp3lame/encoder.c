@@ -192,6 +192,33 @@ adjust_ATH( lame_global_flags* const  gfp,
     }   /* switch */
 }
 
+/*
+ * input energy below which a granule is inaudible, for the fast paths of
+ * digital silence in the filterbank and the psymodel
+ *
+ * The MDCT of a granule has at most 1e-11 times the energy of the samples
+ * that the filterbank reads for it and for the granule before (8.8e-12
+ * with impulses, sines and noise).  Less than half the lowest ATH in each
+ * of the two puts every sfb below the ATH.  adjust_ATH() runs later in
+ * the frame and lowers the ATH by no more than 0.925 or the decay.
+ */
+static void
+inaudible_ATH( lame_global_flags* const  gfp )
+{
+    lame_internal_flags* const  gfc = gfp->internal_flags;
+    ATH_t* const  ATH = gfc->ATH;
+    FLOAT adjust = 1.0;
+    FLOAT ath;
+
+    if (ATH->use_adjust != 0 && gfp->athaa_loudapprox != 0)
+        adjust = ATH->adjust * Min( 0.925, ATH->decay );
+    if (gfp->VBR == vbr_rh || gfp->VBR == vbr_mtrh)
+        ath = athAdjust( adjust, ATH->lowest, ATH->floor );
+    else
+        ath = adjust * ATH->lowest;
+    ATH->inaudible = ath * 0.5 / 1e-11;
+}
+
 /***********************************************************************
  *
  *  some simple statistics
@@ -301,6 +328,15 @@ FFT's                    <---------1024---------->
 
     FFT starts at 576-224-MDCTDELAY (304)  = 576-FFTOFFSET
 
+    inbuf_l = NULL: lame_encode_spectrum() has put the MDCT coefficients
+    and the block types of a decoded frame into l3_side, the filterbank
+    and the FFT psymodel are skipped.
+
+    There are no instances of this pipeline per configuration: mode_gr,
+    channels_out, the stereo mode and the quantization are tested per
+    granule or channel, not per spectral line.  Builds with them turned
+    into constants (MPEG-1 joint stereo, MPEG-2 mono) were not faster.
+
 */
 
 typedef FLOAT chgrdata[2][2];
@@ -333,7 +369,9 @@ int  lame_encode_mp3_frame (				/* Output */
   inbuf[0]=inbuf_l;
   inbuf[1]=inbuf_r;
 
-  if (gfc->lame_encode_frame_init==0 ) {
+  inaudible_ATH( gfp );
+
+  if (gfc->lame_encode_frame_init==0 && inbuf_l != NULL) {
       /* prime the MDCT/polyphase filterbank with a short block */
       int i,j;
       sample_t primebuff0[286+1152+576];
@@ -386,7 +424,7 @@ int  lame_encode_mp3_frame (				/* Output */
   }
 
 
-  if (gfc->psymodel) {
+  if (gfc->psymodel || inbuf_l == NULL) {
     /* psychoacoustic model
      * psy model has a 1 granule (576) delay that we must compensate for
      * (mt 6/99).
@@ -398,19 +436,26 @@ int  lame_encode_mp3_frame (				/* Output */
     ms_ratio_prev=gfc->ms_ratio[gfc->mode_gr-1];
     for (gr=0; gr < gfc->mode_gr ; gr++) {
 
-    for ( ch = 0; ch < gfc->channels_out; ch++ )
+    if (inbuf_l == NULL) {
+        ret=L3psycho_anal_xr( gfp, gr, &gfc->ms_ratio[gr],
+                            masking_LR, masking_MS,
+                            pe[gr],pe_MS[gr],tot_ener[gr]);
+        ms_ratio_next=gfc->ms_ratio[gr];
+    } else {
+      for ( ch = 0; ch < gfc->channels_out; ch++ )
         bufp[ch] = &inbuf[ch][576 + gr*576-FFTOFFSET];
 
-    if (gfp->psymodel == PSY_NSPSYTUNE) {
+      if (gfp->psymodel == PSY_NSPSYTUNE) {
         ret=L3psycho_anal_ns( gfp, bufp, gr, 
                             &gfc->ms_ratio[gr],&ms_ratio_next,
                             masking_LR, masking_MS,
                             pe[gr],pe_MS[gr],tot_ener[gr],blocktype);
-    } else {
+      } else {
         ret=L3psycho_anal( gfp, bufp, gr, 
                             &gfc->ms_ratio[gr],&ms_ratio_next,
                             masking_LR, masking_MS,
                             pe[gr],pe_MS[gr],tot_ener[gr],blocktype);
+      }
     }
     if (ret!=0) return -4;
 
@@ -420,7 +465,8 @@ int  lame_encode_mp3_frame (				/* Output */
 	      ms_ener_ratio[gr] = tot_ener[gr][3]/ms_ener_ratio[gr];
       }
 
-      /* block type flags */
+      /* block type flags, the spectrum came with its own */
+      if (inbuf_l != NULL)
       for ( ch = 0; ch < gfc->channels_out; ch++ ) {
 	  gr_info *cod_info = &gfc->l3_side.tt[gr][ch];
 	  cod_info->block_type=blocktype[ch];
@@ -446,7 +492,8 @@ int  lame_encode_mp3_frame (				/* Output */
 
 
   /* polyphase filtering / mdct */
-  mdct_sub48(gfc, inbuf[0], inbuf[1]);
+  if (inbuf_l != NULL)
+      mdct_sub48(gfc, inbuf[0], inbuf[1]);
 
   /* Here will be selected MS or LR coding of the 2 stereo channels */
   gfc->mode_ext = MPG_MD_LR_LR;
@@ -486,6 +533,9 @@ int  lame_encode_mp3_frame (				/* Output */
       if (ms_ratio_ave1 >= threshold1 || ms_ratio_ave2 >= threshold2)
 	check_ms_stereo = 0;
     }
+    /* the psymodel skipped the M/S analysis, L/R coding was certain */
+    if (gfp->psymodel == PSY_NSPSYTUNE && gfc->nsPsy.ms_missing)
+      check_ms_stereo = 0;
     if (check_ms_stereo) {
       FLOAT8 sum_pe_MS = 0;
       FLOAT8 sum_pe_LR = 0;
@@ -532,7 +582,7 @@ change the following to
 	gfc->pinfo->ms_ener_ratio[gr]=ms_ener_ratio[gr];
 	gfc->pinfo->blocktype[gr][ch]=gfc->l3_side.tt[gr][ch].block_type;
 	gfc->pinfo->pe[gr][ch]=(*pe_use)[gr][ch];
-	memcpy(gfc->pinfo->xr[gr][ch], &gfc->l3_side.tt[gr][ch].xr,
+	memcpy(gfc->pinfo->xr[gr][ch], gfc->l3_side.tt[gr][ch].xr,
 	       sizeof(FLOAT8)*576);
 	/* in psymodel, LR and MS data was stored in pinfo.  
 	   switch to MS data: */
@@ -606,7 +656,7 @@ change the following to
 
 
 #if defined(HAVE_GTK)
-  if (gfp->analysis && gfc->pinfo != NULL) {
+  if (gfp->analysis && gfc->pinfo != NULL && inbuf_l != NULL) {
     for ( ch = 0; ch < gfc->channels_out; ch++ ) {
       int j;
       for ( j = 0; j < FFTOFFSET; j++ )
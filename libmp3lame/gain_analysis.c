@@ -144,7 +144,10 @@ filterYule (const Float_t* input, Float_t* output, size_t nSamples, const Float_
     /*register double  y;*/
 
     while (nSamples--) {
-        *output =  input [0]  * kernel[0]
+        /* 1e-10 keeps the recursion out of denormals on digital silence,
+         * the following highpass removes it again */
+        *output =  1e-10
+         + input [0]  * kernel[0]
          - output[-1] * kernel[1]
          + input [-1] * kernel[2]
          - output[-2] * kernel[3]
@@ -303,20 +306,16 @@ AnalyzeSamples (replaygain_t* rgData, const Float_t* left_samples, const Float_t
             curright = right_samples + cursamplepos;
         }
 
+        /* mono: the right channel would be a copy of the left one, so only
+           the left one is filtered and its sum counts twice below */
         YULE_FILTER ( curleft , rgData->lstep + rgData->totsamp, cursamples, ABYule[rgData->freqindex]);
-        YULE_FILTER ( curright, rgData->rstep + rgData->totsamp, cursamples, ABYule[rgData->freqindex]);
-
         BUTTER_FILTER ( rgData->lstep + rgData->totsamp, rgData->lout + rgData->totsamp, cursamples, ABButter[rgData->freqindex]);
-        BUTTER_FILTER ( rgData->rstep + rgData->totsamp, rgData->rout + rgData->totsamp, cursamples, ABButter[rgData->freqindex]);
 
         curleft = rgData->lout + rgData->totsamp;                   /* Get the squared values */
-        curright = rgData->rout + rgData->totsamp;
 
         i = cursamples % 8;
         while (i--)
-        {   rgData->lsum += fsqr(*curleft++);
-            rgData->rsum += fsqr(*curright++);
-        }
+            rgData->lsum += fsqr(*curleft++);
         i = cursamples / 8;
         while (i--)
         {   rgData->lsum += fsqr(curleft[0])
@@ -328,17 +327,33 @@ AnalyzeSamples (replaygain_t* rgData, const Float_t* left_samples, const Float_t
                   + fsqr(curleft[6])
                   + fsqr(curleft[7]);
             curleft += 8;
-            rgData->rsum += fsqr(curright[0])
-                  + fsqr(curright[1])
-                  + fsqr(curright[2])
-                  + fsqr(curright[3])
-                  + fsqr(curright[4])
-                  + fsqr(curright[5])
-                  + fsqr(curright[6])
-                  + fsqr(curright[7]);
-            curright += 8;
         }
 
+        if ( num_channels == 2 ) {
+            YULE_FILTER ( curright, rgData->rstep + rgData->totsamp, cursamples, ABYule[rgData->freqindex]);
+            BUTTER_FILTER ( rgData->rstep + rgData->totsamp, rgData->rout + rgData->totsamp, cursamples, ABButter[rgData->freqindex]);
+
+            curright = rgData->rout + rgData->totsamp;
+
+            i = cursamples % 8;
+            while (i--)
+                rgData->rsum += fsqr(*curright++);
+            i = cursamples / 8;
+            while (i--)
+            {   rgData->rsum += fsqr(curright[0])
+                      + fsqr(curright[1])
+                      + fsqr(curright[2])
+                      + fsqr(curright[3])
+                      + fsqr(curright[4])
+                      + fsqr(curright[5])
+                      + fsqr(curright[6])
+                      + fsqr(curright[7]);
+                curright += 8;
+            }
+        }
+        else
+            rgData->rsum = rgData->lsum;
+
         batchsamples -= cursamples;
         cursamplepos += cursamples;
         rgData->totsamp      += cursamples;
@@ -48,9 +48,14 @@ typedef struct {
     III_psy_xmin en;
 } III_psy_ratio;
 
+/* The spectrum and its quantization are kept out of gr_info, in
+ * III_side_info_t, so that the trial copies made by the quantization
+ * loops only copy the small control fields.  Copies share xr and l3_enc;
+ * a copy that quantizes on its own needs its own l3_enc buffer.
+ */
 typedef struct {
-    FLOAT8 xr[576];
-    int l3_enc[576];
+    FLOAT8 *xr;
+    int *l3_enc;
     int scalefac[SFBMAX];
     FLOAT8 xrpow_max;
 
@@ -93,6 +98,9 @@ typedef struct {
 	int resvDrain_pre;
 	int resvDrain_post;
 	int scfsi[2][4];
+
+	FLOAT8 xr[2][2][576];      /* tt[gr][ch].xr points here */
+	int l3_enc[2][2][576];     /* tt[gr][ch].l3_enc points here */
 } III_side_info_t;
 
 #endif
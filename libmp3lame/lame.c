@@ -148,6 +148,12 @@ lame_init_params_ppflt(lame_global_flags * gfp)
 	    * filter_coef((freq - gfc->lowpass1)
 			  / (gfc->lowpass2 - gfc->lowpass1 - 1e-37));
     }
+
+    /* everything above the last passed subband is known to be silent,
+     * mdct_sub48() and the quantization loops skip it */
+    for (gfc->sblimit = 32; gfc->sblimit > 0; gfc->sblimit--)
+	if (gfc->amp_filter[gfc->sblimit - 1] != 0.0)
+	    break;
 }
 
 
@@ -292,7 +298,7 @@ lame_init_qval(lame_global_flags * gfp)
         gfp->quality = 7;
     case 7:            /* use psymodel (for short block and m/s switching), but no noise shapping */
         gfc->filter_type = 0;
-        gfc->psymodel = 1;
+        gfc->psymodel = 2; /* coarse partitions, fast */
         gfc->quantization = 0;
         gfc->noise_shaping = 0;
         gfc->noise_shaping_amp = 0;
@@ -1399,11 +1405,11 @@ lame_encode_buffer_sample_t(lame_global_flags * gfp,
 
     /* user selected scaling of the samples */
     if (gfp->scale != 0 && gfp->scale != 1.0) {
-	for (i=0 ; i<nsamples; ++i) {
+	for (i=0 ; i<nsamples; ++i)
 	    in_buffer[0][i] *= gfp->scale;
-	    if (gfc->channels_out == 2)
+	if (gfc->channels_out == 2)
+	    for (i=0 ; i<nsamples; ++i)
 		in_buffer[1][i] *= gfp->scale;
-	    }
     }
 
     /* user selected scaling of the channel 0 (left) samples */
@@ -1462,6 +1468,16 @@ lame_encode_buffer_sample_t(lame_global_flags * gfp,
 
 
 
+        /* keep track of identical stereo channels, the encoder
+         * then analyzes the right channel as a copy of the left one */
+        if (gfc->channels_out == 2) {
+            for (i = gfc->mf_size + n_out - 1; i >= gfc->mf_size; i--)
+                if (mfbuf[0][i] != mfbuf[1][i]) {
+                    gfc->mf_lr_diff = i + 1;
+                    break;
+                }
+        }
+
         /* update in_buffer counters */
         nsamples -= n_in;
         in_buffer[0] += n_in;
@@ -1497,6 +1513,7 @@ lame_encode_buffer_sample_t(lame_global_flags * gfp,
             /* shift out old samples */
             gfc->mf_size -= gfp->framesize;
             gfc->mf_samples_to_encode -= gfp->framesize;
+            gfc->mf_lr_diff = Max(0, gfc->mf_lr_diff - gfp->framesize);
             for (ch = 0; ch < gfc->channels_out; ch++)
                 for (i = 0; i < gfc->mf_size; i++)
                     mfbuf[ch][i] = mfbuf[ch][i + gfp->framesize];
@@ -1533,10 +1550,11 @@ lame_encode_buffer(lame_global_flags * gfp,
     }
 
     /* make a copy of input buffer, changing type to sample_t */
-    for (i = 0; i < nsamples; i++) {
+    for (i = 0; i < nsamples; i++)
         in_buffer[0][i] = buffer_l[i];
-	if (gfc->channels_in>1) in_buffer[1][i] = buffer_r[i];
-    }
+    if (gfc->channels_in>1)
+        for (i = 0; i < nsamples; i++)
+            in_buffer[1][i] = buffer_r[i];
 
     ret = lame_encode_buffer_sample_t(gfp,in_buffer[0],in_buffer[1],
 				      nsamples, mp3buf, mp3buf_size);
@@ -1572,10 +1590,11 @@ lame_encode_buffer_float(lame_global_flags * gfp,
     }
 
     /* make a copy of input buffer, changing type to sample_t */
-    for (i = 0; i < nsamples; i++) {
+    for (i = 0; i < nsamples; i++)
         in_buffer[0][i] = buffer_l[i];
-        if (gfc->channels_in>1) in_buffer[1][i] = buffer_r[i];
-    }
+    if (gfc->channels_in>1)
+        for (i = 0; i < nsamples; i++)
+            in_buffer[1][i] = buffer_r[i];
 
     ret = lame_encode_buffer_sample_t(gfp,in_buffer[0],in_buffer[1],
 				      nsamples, mp3buf, mp3buf_size);
@@ -1612,12 +1631,12 @@ lame_encode_buffer_int(lame_global_flags * gfp,
     }
 
     /* make a copy of input buffer, changing type to sample_t */
-    for (i = 0; i < nsamples; i++) {
                                 /* internal code expects +/- 32768.0 */
+    for (i = 0; i < nsamples; i++)
       in_buffer[0][i] = buffer_l[i] * (1.0 / ( 1L << (8 * sizeof(int) - 16)));
-      if (gfc->channels_in>1)
+    if (gfc->channels_in>1)
+      for (i = 0; i < nsamples; i++)
 	  in_buffer[1][i] = buffer_r[i] * (1.0 / ( 1L << (8 * sizeof(int) - 16)));
-    }
 
     ret = lame_encode_buffer_sample_t(gfp,in_buffer[0],in_buffer[1],
 				      nsamples, mp3buf, mp3buf_size);
@@ -1656,12 +1675,12 @@ lame_encode_buffer_long2(lame_global_flags * gfp,
     }
 
     /* make a copy of input buffer, changing type to sample_t */
-    for (i = 0; i < nsamples; i++) {
                                 /* internal code expects +/- 32768.0 */
+    for (i = 0; i < nsamples; i++)
       in_buffer[0][i] = buffer_l[i] * (1.0 / ( 1L << (8 * sizeof(long) - 16)));
-      if (gfc->channels_in>1)
+    if (gfc->channels_in>1)
+      for (i = 0; i < nsamples; i++)
 	  in_buffer[1][i] = buffer_r[i] * (1.0 / ( 1L << (8 * sizeof(long) - 16)));
-    }
 
     ret = lame_encode_buffer_sample_t(gfp,in_buffer[0],in_buffer[1],
 				      nsamples, mp3buf, mp3buf_size);
@@ -1699,11 +1718,11 @@ lame_encode_buffer_long(lame_global_flags * gfp,
     }
 
     /* make a copy of input buffer, changing type to sample_t */
-    for (i = 0; i < nsamples; i++) {
+    for (i = 0; i < nsamples; i++)
         in_buffer[0][i] = buffer_l[i];
-        if (gfc->channels_in>1)
+    if (gfc->channels_in>1)
+        for (i = 0; i < nsamples; i++)
 	    in_buffer[1][i] = buffer_r[i];
-    }
 
     ret = lame_encode_buffer_sample_t(gfp,in_buffer[0],in_buffer[1],
 				      nsamples, mp3buf, mp3buf_size);
@@ -1752,6 +1771,82 @@ lame_encode_buffer_interleaved(lame_global_flags * gfp,
 }
 
 
+/* one frame from the spectrum of a decoded Layer III frame */
+int
+lame_encode_spectrum(lame_global_flags * gfp, const mp3spectrum_struct * spec,
+                     unsigned char *mp3buf, int mp3buf_size)
+{
+    lame_internal_flags *gfc = gfp->internal_flags;
+    int     mp3size, ret, gr, ch, band, i;
+    FLOAT8  scale[2];
+
+    if (gfc->Class_ID != LAME_ID)
+        return -3;
+    if (spec->samplerate != gfp->out_samplerate
+        || spec->granules > gfc->mode_gr
+        || spec->channels < gfc->channels_out)
+        return -5;
+    if (spec->channels == 2 && gfc->channels_out == 1) {
+        /* a short block spectrum is ordered by window, it can only be
+           added to one with the same windows */
+        for (gr = 0; gr < spec->granules; gr++)
+            if (spec->gr[gr][0].block_type != spec->gr[gr][1].block_type
+                || spec->gr[gr][0].mixed_block_flag
+                   != spec->gr[gr][1].mixed_block_flag)
+                return -6;
+    }
+
+    /* copy out any tags that may have been written into bitstream */
+    mp3size = copy_buffer(gfc,mp3buf,mp3buf_size,0);
+    if (mp3size<0) return mp3size;  /* not enough buffer space */
+
+    scale[0] = scale[1] = gfp->scale != 0 ? gfp->scale : 1.0;
+    if (gfp->scale_left != 0)
+        scale[0] *= gfp->scale_left;
+    if (gfp->scale_right != 0)
+        scale[1] *= gfp->scale_right;
+    if (spec->channels == 2 && gfc->channels_out == 1)
+        scale[0] = scale[1] = 0.5 * scale[0];
+
+    for (gr = 0; gr < gfc->mode_gr; gr++) {
+        for (ch = 0; ch < gfc->channels_out; ch++) {
+            gr_info *gi = &gfc->l3_side.tt[gr][ch];
+            FLOAT8 *xr = gi->xr;
+
+            if (gr >= spec->granules) {
+                /* the decoder could not rebuild it */
+                memset(xr, 0, sizeof(FLOAT8)*576);
+                gi->block_type = NORM_TYPE;
+                gi->mixed_block_flag = 0;
+                continue;
+            }
+            gi->block_type = spec->gr[gr][ch].block_type;
+            gi->mixed_block_flag = spec->gr[gr][ch].mixed_block_flag;
+            for (i = 0; i < 576; i++)
+                xr[i] = scale[ch] * spec->gr[gr][ch].xr[i];
+            if (spec->channels == 2 && gfc->channels_out == 1)
+                /* the same windows, checked above */
+                for (i = 0; i < 576; i++)
+                    xr[i] += scale[1] * spec->gr[gr][1].xr[i];
+
+            /* lowpass and highpass, on the subbands as in mdct_sub48() */
+            for (band = 0; band < SBLIMIT; band++)
+                if (gfc->amp_filter[band] != 1.0)
+                    for (i = 18*band; i < 18*band + 18; i++)
+                        xr[i] *= gfc->amp_filter[band];
+        }
+    }
+    /* nothing is buffered for lame_encode_flush() */
+    gfc->mf_samples_to_encode = 0;
+
+    ret = lame_encode_frame(gfp, NULL, NULL, mp3buf + mp3size,
+                            mp3buf_size == 0 ? 0 : mp3buf_size - mp3size);
+    if (ret < 0)
+        return ret;
+    return mp3size + ret;
+}
+
+
 int
 lame_encode(lame_global_flags * const gfp,
             const short int in_buffer[2][1152],
@@ -1792,6 +1887,12 @@ lame_init_bitstream(lame_global_flags * gfp)
 {
     lame_internal_flags *gfc = gfp->internal_flags;
     gfp->frameNum=0;
+    gfc->nBytesOutput = 0;
+    gfc->nMusicCRC = 0;
+    gfc->seek_index.frames = 0;
+    gfc->seek_index.count = 0;
+    gfc->frame_info.frames = 0;
+    gfc->frame_info.count = 0;
 
     id3tag_write_v2(gfp);
 #ifdef BRHIST
@@ -1952,14 +2053,10 @@ lame_encode_finish(lame_global_flags * gfp,
 void
 lame_mp3_tags_fid(lame_global_flags * gfp, FILE * fpStream)
 {
-    if (gfp->bWriteVbrTag) {
-        /* Map VBR_q to Xing quality value: 0=worst, 100=best */
-        int     nQuality = ((9-gfp->VBR_q) * 100) / 9;
-
-        /* Write Xing header again */
-        if (fpStream && !fseek(fpStream, 0, SEEK_SET))
-            PutVbrTag(gfp, fpStream, nQuality);
-    }
+    /* Write Xing header again.  PutVbrTag() fails harmlessly if
+       fpStream cannot seek, e.g. a pipe */
+    if (gfp->bWriteVbrTag && fpStream)
+        PutVbrTag(gfp, fpStream);
 }
 lame_global_flags *
 lame_init(void)
@@ -1967,8 +2064,6 @@ lame_init(void)
     lame_global_flags *gfp;
     int     ret;
 
-    init_log_table();
-
     gfp = calloc(1, sizeof(lame_global_flags));
     if (gfp == NULL)
         return NULL;
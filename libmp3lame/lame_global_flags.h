@@ -41,6 +41,10 @@ struct lame_global_struct {
   /* general control params */
   int analysis;               /* collect data for a MP3 frame analyzer?      */
   int bWriteVbrTag;           /* add Xing VBR tag?                           */
+  int seek_index_interval;    /* seek index entry every n frames, 0 = off    */
+  int frame_info;             /* keep lame_frame_info of every frame?        */
+  int segment_interval;       /* samples per independently decodable
+                                 segment, 0 = off                            */
   int decode_only;            /* use lame/mpglib to convert mp3 to wav       */
   int quality;                /* quality setting 0=best,  9=worst  default=5 */
   MPEG_mode mode;             /* see enum in lame.h
@@ -150,6 +154,11 @@ struct lame_global_struct {
     void (*errorf)(const char *format, va_list ap);
   } report;
 
+  struct {
+    lame_output_callback func;  /* see lame_set_output_callback()          */
+    void *user;
+  } output;
+
   /************************************************************************/
   /* internal variables, do not set...                                    */
   /* provided because they may be of use to calling application           */
@@ -229,6 +229,10 @@ SOURCE=.\set_get.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\splice.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables.c
 # ADD CPP /W1
 # End Source File
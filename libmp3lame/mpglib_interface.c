@@ -8,10 +8,13 @@
 
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "interface.h"
+#include "common.h"
 #include "lame.h"
+#include "VbrTag.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
@@ -21,6 +24,16 @@
 MPSTR   mp;
 plotting_data *mpg123_pinfo = NULL;
 
+#define OUTSIZE_PREROLL   4096*sizeof(short)
+#define OUTSIZE_CLIPPED   4096*sizeof(short)
+
+/* a decoder of its own, see lame_decoder_new() */
+struct lame_decoder_struct {
+    MPSTR   mp;
+    char    out[OUTSIZE_CLIPPED];
+};
+
+
 int
 lame_decode_exit(void)
 {
@@ -37,6 +50,312 @@ lame_decode_init(void)
 }
 
 
+/* drops all buffered data, to continue decoding somewhere else in the
+   same stream.  what mpglib found in the Xing/Info tag is kept */
+int
+lame_decode_reset(void)
+{
+    int     num_frames = mp.num_frames;
+    int     enc_delay = mp.enc_delay;
+    int     enc_padding = mp.enc_padding;
+    int     down_sample = mp.down_sample;
+
+    ExitMP3(&mp);
+    InitMP3(&mp);
+    mp.num_frames = num_frames;
+    mp.enc_delay = enc_delay;
+    mp.enc_padding = enc_padding;
+    mp.down_sample = down_sample;
+    return 0;
+}
+
+
+/* 1, 2, 4 -> mp->down_sample */
+static int
+set_downsample(PMPSTR mp, int factor)
+{
+    switch (factor) {
+    case 1: mp->down_sample = 0; break;
+    case 2: mp->down_sample = 1; break;
+    case 4: mp->down_sample = 2; break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+int
+lame_decode_downsample(int factor)
+{
+    return set_downsample(&mp, factor);
+}
+
+
+/* decodes all complete frames in buffer and drops the output.  a frame
+   may give no or only some of its samples, depending on how much of its
+   reservoir the decoder has seen since the reset, so this is the only
+   way to know where the output of the next frame starts */
+static int
+decode_preroll(PMPSTR mp, unsigned char *buffer, int len, char *out, int osize)
+{
+    int     ret, bsize, done;
+
+    mp->preroll = 1;
+    ret = decodeMP3(mp, buffer, len, out, osize, &done);
+    do {
+        if (ret == MP3_ERR)
+            break;
+        bsize = mp->bsize;
+        ret = decodeMP3(mp, NULL, 0, out, osize, &done);
+    } while (mp->bsize != bsize);
+    mp->preroll = 0;
+    return ret == MP3_ERR ? -1 : 0;
+}
+
+int
+lame_decode_preroll(unsigned char *buffer, int len)
+{
+    static char out[OUTSIZE_PREROLL];
+
+    return decode_preroll(&mp, buffer, len, out, sizeof(out));
+}
+
+
+/*
+ * looks at the header and side info of the frame starting at buf[0],
+ * without decoding anything.  buf has to hold at least 8 bytes.
+ *
+ *  returns the frame size in bytes, 0 if there is no valid header
+ *  or the stream is free format.
+ *  *samples         = samples per channel in the frame
+ *  *main_data_begin = bytes of main data taken from previous frames,
+ *                     0 for Layer I and II
+ *  *side_bytes      = header, CRC and side info bytes
+ */
+static int
+frame_info(const unsigned char *buf, struct frame *fr, int *samples,
+           int *main_data_begin, int *side_bytes)
+{
+    const unsigned char *si;
+    unsigned long head;
+
+    head = ((unsigned long) buf[0] << 24) | ((unsigned long) buf[1] << 16)
+        | ((unsigned long) buf[2] << 8) | buf[3];
+    if (!head_check(head, 0) || !decode_header(fr, head) || fr->framesize <= 0)
+        return 0;
+
+    si = buf + (fr->error_protection ? 6 : 4);
+    *side_bytes = si - buf;
+    if (fr->lay == 1)
+        *samples = 384;
+    else if (fr->lay == 2 || !fr->lsf)
+        *samples = 1152;
+    else
+        *samples = 576;
+    if (fr->lay != 3)
+        *main_data_begin = 0;
+    else if (fr->lsf) {
+        *main_data_begin = si[0];
+        *side_bytes += fr->stereo == 1 ? 9 : 17;
+    }
+    else {
+        *main_data_begin = (si[0] << 1) | (si[1] >> 7);
+        *side_bytes += fr->stereo == 1 ? 17 : 32;
+    }
+    return fr->framesize + 4;
+}
+
+int
+lame_decode_frame_info(const unsigned char *buf, int *samples,
+                       int *main_data_begin, int *side_bytes)
+{
+    struct frame fr;
+
+    return frame_info(buf, &fr, samples, main_data_begin, side_bytes);
+}
+
+
+
+/*
+ * lame_decode_scan() only looks at headers and side info: it hops from
+ * frame to frame by the frame size, and never touches the main data.
+ */
+
+/* the header fields which must not change from frame to frame:
+   sync, version, layer and sampling frequency */
+#define SCAN_HEADER_MASK  0xfffe0c00UL
+
+/* number of bytes GetVbrTag() looks at */
+#define SCAN_XING_BYTES   194
+
+static unsigned long
+scan_header(const unsigned char *buf)
+{
+    return ((unsigned long) buf[0] << 24) | ((unsigned long) buf[1] << 16)
+        | ((unsigned long) buf[2] << 8) | buf[3];
+}
+
+/* CRC-16 (x^16+x^15+x^2+1, MSB first) of the last two header bytes and
+   the side info, as CRC_writeheader() computes it */
+static int
+scan_crc_ok(const unsigned char *buf, int side_bytes)
+{
+    unsigned int crc = 0xffff;
+    int     i, j;
+
+    for (i = 2; i < side_bytes; i = i == 3 ? 6 : i + 1) {
+        crc ^= buf[i] << 8;
+        for (j = 0; j < 8; j++) {
+            crc <<= 1;
+            if (crc & 0x10000)
+                crc ^= 0x18005;
+        }
+    }
+    return crc == (unsigned int) ((buf[4] << 8) | buf[5]);
+}
+
+/* size of the frame at buf[p], 0 if there is none with the stream
+   parameters of scan->header.  with resync, the next frame has to
+   follow it, so that a sync word in garbage is not taken for a frame */
+static int
+scan_frame(const unsigned char *buf, size_t p, size_t end,
+           const mp3scan_struct * scan, int resync, struct frame *fr,
+           int *side_bytes)
+{
+    struct frame next;
+    int     bytes, samples, mdb, next_side;
+
+    if (p + 8 > end
+        || (scan_header(buf + p) & SCAN_HEADER_MASK) != (scan->header & SCAN_HEADER_MASK))
+        return 0;
+    bytes = frame_info(buf + p, fr, &samples, &mdb, side_bytes);
+    if (bytes <= 0 || !resync || p + bytes >= end)
+        return bytes;
+    p += bytes;
+    if (p + 8 > end
+        || (scan_header(buf + p) & SCAN_HEADER_MASK) != (scan->header & SCAN_HEADER_MASK)
+        || frame_info(buf + p, &next, &samples, &mdb, &next_side) <= 0)
+        return 0;
+    return bytes;
+}
+
+/* looks for the first frame at or after buf[p], which fixes the stream
+   parameters.  returns its position, or end if there is none.
+   *tag_bytes is its size if it is a Xing/Info tag, else 0 */
+static size_t
+scan_start(const unsigned char *buf, size_t p, size_t end,
+           mp3scan_struct * scan, int *tag_bytes)
+{
+    unsigned char xing[SCAN_XING_BYTES];
+    VBRTAGDATA tag;
+    struct frame fr;
+    int     bytes, side_bytes, i;
+
+    *tag_bytes = 0;
+    for (; p + 8 <= end; p++) {
+        if (buf[p] != 0xff)
+            continue;
+        scan->header = scan_header(buf + p);
+        bytes = scan_frame(buf, p, end, scan, 1, &fr, &side_bytes);
+        if (bytes <= 0)
+            continue;
+
+        scan->version = fr.mpeg25 ? 2 : !fr.lsf;
+        scan->layer = fr.lay;
+        scan->samplerate = freqs[fr.sampling_frequency];
+        scan->stereo = fr.stereo;
+        scan->framesize = fr.lay == 1 ? 384 : fr.lay == 3 && fr.lsf ? 576 : 1152;
+        for (i = 0; i < 16; i++)
+            scan->bitrate_kbps[i] = tabsel_123[fr.lsf][fr.lay - 1][i];
+
+        memset(xing, 0, sizeof(xing));
+        memcpy(xing, buf + p, bytes < SCAN_XING_BYTES ? bytes : SCAN_XING_BYTES);
+        if (fr.lay == 3 && GetVbrTag(&tag, xing)) {
+            scan->enc_delay = tag.enc_delay;
+            scan->enc_padding = tag.enc_padding;
+            if (tag.flags & FRAMES_FLAG)
+                scan->tag_frames = tag.frames;
+            *tag_bytes = bytes;
+        }
+        return p;
+    }
+    scan->header = 0;
+    return end;
+}
+
+int
+lame_decode_scan(const unsigned char *buf, size_t len, size_t *pos,
+                 mp3scan_struct * scan)
+{
+    struct frame fr;
+    size_t  p = *pos, end = len, q;
+    int     bytes, side_bytes;
+    unsigned long nsamp;
+
+    /* ID3v1 */
+    if (len >= 128 && buf[len - 128] == 'T' && buf[len - 127] == 'A'
+        && buf[len - 126] == 'G')
+        end = len - 128;
+
+    if (p == 0) {
+        memset(scan, 0, sizeof(*scan));
+        scan->enc_delay = scan->enc_padding = -1;
+        scan->tag_frames = -1;
+        /* ID3v2 */
+        if (end >= 10 && buf[0] == 'I' && buf[1] == 'D' && buf[2] == '3') {
+            p = 10 + ((buf[6] & 127) << 21 | (buf[7] & 127) << 14
+                      | (buf[8] & 127) << 7 | (buf[9] & 127));
+            if (p > end)
+                p = end;
+        }
+        q = scan_start(buf, p, end, scan, &bytes);
+        if (q > p) {
+            scan->bad_bytes += q - p;
+            scan->error_pos = p;
+            *pos = q + bytes;
+            return LAME_SCAN_LOST_SYNC;
+        }
+        p += bytes;
+    }
+
+    while (p < end) {
+        bytes = scan_frame(buf, p, end, scan, 0, &fr, &side_bytes);
+        if (bytes <= 0) {
+            for (q = p + 1; q < end; q++)
+                if (buf[q] == 0xff && scan_frame(buf, q, end, scan, 1, &fr, &side_bytes) > 0)
+                    break;
+            scan->bad_bytes += q - p;
+            scan->error_pos = p;
+            *pos = q < end ? q : len;
+            return LAME_SCAN_LOST_SYNC;
+        }
+        if (p + bytes > end) {
+            scan->bad_bytes += end - p;
+            scan->error_pos = p;
+            *pos = len;
+            return LAME_SCAN_TRUNCATED;
+        }
+        scan->frames++;
+        scan->bitrate_frames[fr.bitrate_index]++;
+        if (fr.lay == 3 && fr.error_protection && !scan_crc_ok(buf + p, side_bytes)) {
+            scan->crc_errors++;
+            scan->error_pos = p;
+            *pos = p + bytes;
+            return LAME_SCAN_CRC_ERROR;
+        }
+        p += bytes;
+    }
+    *pos = len;
+
+    nsamp = scan->frames * scan->framesize;
+    if (scan->enc_delay >= 0 && scan->enc_padding >= 0
+        && nsamp >= (unsigned long) (scan->enc_delay + scan->enc_padding))
+        nsamp -= scan->enc_delay + scan->enc_padding;
+    scan->nsamp = nsamp;
+    return LAME_SCAN_END;
+}
+
+
 
 
 /* copy mono samples */
@@ -65,7 +384,7 @@ lame_decode_init(void)
  */
 
 int
-lame_decode1_headersB_clipchoice(unsigned char *buffer, int len,
+lame_decode1_headersB_clipchoice(PMPSTR mp, unsigned char *buffer, int len,
                      char pcm_l_raw[], char pcm_r_raw[], mp3data_struct * mp3data,
                      int *enc_delay, int *enc_padding, 
                      char *p, size_t psize, int decoded_sample_size,
@@ -85,58 +404,60 @@ lame_decode1_headersB_clipchoice(unsigned char *buffer, int len,
     mp3data->header_parsed = 0;
 
     ret =
-        (*decodeMP3_ptr)(&mp, buffer, len, p, psize, &processed_bytes);
+        (*decodeMP3_ptr)(mp, buffer, len, p, psize, &processed_bytes);
     /* three cases:  
      * 1. headers parsed, but data not complete
-     *       mp.header_parsed==1 
-     *       mp.framesize=0           
-     *       mp.fsizeold=size of last frame, or 0 if this is first frame
+     *       mp->header_parsed==1 
+     *       mp->framesize=0           
+     *       mp->fsizeold=size of last frame, or 0 if this is first frame
      *
      * 2. headers, data parsed, but ancillary data not complete
-     *       mp.header_parsed==1 
-     *       mp.framesize=size of frame           
-     *       mp.fsizeold=size of last frame, or 0 if this is first frame
+     *       mp->header_parsed==1 
+     *       mp->framesize=size of frame           
+     *       mp->fsizeold=size of last frame, or 0 if this is first frame
      *
      * 3. frame fully decoded:  
-     *       mp.header_parsed==0 
-     *       mp.framesize=0           
-     *       mp.fsizeold=size of frame (which is now the last frame)
+     *       mp->header_parsed==0 
+     *       mp->framesize=0           
+     *       mp->fsizeold=size of frame (which is now the last frame)
      *
      */
-    if (mp.header_parsed || mp.fsizeold > 0 || mp.framesize > 0) {
+    if (mp->header_parsed || mp->fsizeold > 0 || mp->framesize > 0) {
 	mp3data->header_parsed = 1;
-        mp3data->stereo = mp.fr.stereo;
-        mp3data->samplerate = freqs[mp.fr.sampling_frequency];
-        mp3data->mode = mp.fr.mode;
-        mp3data->mode_ext = mp.fr.mode_ext;
-        mp3data->framesize = smpls[mp.fr.lsf][mp.fr.lay];
+        mp3data->stereo = mp->fr.stereo;
+        mp3data->samplerate = freqs[mp->fr.sampling_frequency] >> mp->down_sample;
+        mp3data->mode = mp->fr.mode;
+        mp3data->mode_ext = mp->fr.mode_ext;
+        mp3data->framesize = smpls[mp->fr.lsf][mp->fr.lay] >> mp->down_sample;
+        /* at a reduced rate, 11025 and 22050 Hz may give a rate 1/4 or
+           1/2 Hz low.  the bitrate is that of the stream */
 
 	/* free format, we need the entire frame before we can determine
 	 * the bitrate.  If we haven't gotten the entire frame, bitrate=0 */
-        if (mp.fsizeold > 0) /* works for free format and fixed, no overrun, temporal results are < 400.e6 */
-            mp3data->bitrate = 8 * (4 + mp.fsizeold) * mp3data->samplerate /
-                (1.e3 * mp3data->framesize) + 0.5;
-        else if (mp.framesize > 0)
-            mp3data->bitrate = 8 * (4 + mp.framesize) * mp3data->samplerate /
-                (1.e3 * mp3data->framesize) + 0.5;
+        if (mp->fsizeold > 0) /* works for free format and fixed, no overrun, temporal results are < 400.e6 */
+            mp3data->bitrate = 8 * (4 + mp->fsizeold) * freqs[mp->fr.sampling_frequency] /
+                (1.e3 * smpls[mp->fr.lsf][mp->fr.lay]) + 0.5;
+        else if (mp->framesize > 0)
+            mp3data->bitrate = 8 * (4 + mp->framesize) * freqs[mp->fr.sampling_frequency] /
+                (1.e3 * smpls[mp->fr.lsf][mp->fr.lay]) + 0.5;
         else
             mp3data->bitrate =
-                tabsel_123[mp.fr.lsf][mp.fr.lay - 1][mp.fr.bitrate_index];
+                tabsel_123[mp->fr.lsf][mp->fr.lay - 1][mp->fr.bitrate_index];
 
 
 
-        if (mp.num_frames > 0) {
+        if (mp->num_frames > 0) {
             /* Xing VBR header found and num_frames was set */
-            mp3data->totalframes = mp.num_frames;
-            mp3data->nsamp = mp3data->framesize * mp.num_frames;
-            *enc_delay = mp.enc_delay;
-            *enc_padding = mp.enc_padding;
+            mp3data->totalframes = mp->num_frames;
+            mp3data->nsamp = mp3data->framesize * mp->num_frames;
+            *enc_delay = mp->enc_delay;
+            *enc_padding = mp->enc_padding;
         }
     }
 
     switch (ret) {
     case MP3_OK:
-        switch (mp.fr.stereo) {
+        switch (mp->fr.stereo) {
         case 1: 
             processed_samples = processed_bytes / decoded_sample_size;
             if (decoded_sample_size == sizeof(short)) {
@@ -180,8 +501,6 @@ lame_decode1_headersB_clipchoice(unsigned char *buffer, int len,
 }
 
 
-#define OUTSIZE_CLIPPED   4096*sizeof(short)
-
 int
 lame_decode1_headersB(unsigned char *buffer,
                      int len,
@@ -190,7 +509,7 @@ lame_decode1_headersB(unsigned char *buffer,
 {
   static char out[OUTSIZE_CLIPPED];
 
-  return lame_decode1_headersB_clipchoice(buffer, len, (char *)pcm_l, (char *)pcm_r, mp3data, enc_delay, enc_padding, out, OUTSIZE_CLIPPED, sizeof(short), decodeMP3 );
+  return lame_decode1_headersB_clipchoice(&mp, buffer, len, (char *)pcm_l, (char *)pcm_r, mp3data, enc_delay, enc_padding, out, OUTSIZE_CLIPPED, sizeof(short), decodeMP3 );
 }
 
 
@@ -204,7 +523,7 @@ lame_decode1_unclipped(unsigned char *buffer, int len, sample_t pcm_l[], sample_
   mp3data_struct mp3data;
   int enc_delay,enc_padding;
 
-  return lame_decode1_headersB_clipchoice(buffer, len, (char *)pcm_l, (char *)pcm_r, &mp3data, &enc_delay, &enc_padding, out, OUTSIZE_UNCLIPPED, sizeof(FLOAT8), decodeMP3_unclipped  );
+  return lame_decode1_headersB_clipchoice(&mp, buffer, len, (char *)pcm_l, (char *)pcm_r, &mp3data, &enc_delay, &enc_padding, out, OUTSIZE_UNCLIPPED, sizeof(FLOAT8), decodeMP3_unclipped  );
 }
 
 
@@ -277,6 +596,113 @@ lame_decode(unsigned char *buffer, int len, short pcm_l[], short pcm_r[])
 }
 
 
+
+
+lame_decoder_t *
+lame_decoder_new(void)
+{
+    lame_decoder_t *dec;
+
+    dec = malloc(sizeof(lame_decoder_t));
+    if (dec != NULL)
+        InitMP3(&dec->mp);
+    return dec;
+}
+
+
+void
+lame_decoder_free(lame_decoder_t * dec)
+{
+    if (dec == NULL)
+        return;
+    ExitMP3(&dec->mp);
+    free(dec);
+}
+
+
+int
+lame_decoder_preroll(lame_decoder_t * dec, unsigned char *buffer, int len)
+{
+    return decode_preroll(&dec->mp, buffer, len, dec->out, sizeof(dec->out));
+}
+
+
+int
+lame_decoder_downsample(lame_decoder_t * dec, int factor)
+{
+    return set_downsample(&dec->mp, factor);
+}
+
+
+int
+lame_decoder_spectrum(lame_decoder_t * dec, unsigned char *buffer, int len,
+                      mp3spectrum_struct * spec)
+{
+    PMPSTR  mp = &dec->mp;
+    int     ret, done, gr, ch, i;
+
+    mp->spectral = 1;
+    ret = decodeMP3(mp, buffer, len, dec->out, sizeof(dec->out), &done);
+    /* a call which only completes the ancillary data of the previous frame
+     * returns MP3_NEED_MORE, even with the next frames in the new data */
+    if (ret == MP3_NEED_MORE && len > 0)
+        ret = decodeMP3(mp, NULL, 0, dec->out, sizeof(dec->out), &done);
+    if (ret == MP3_ERR)
+        return -1;
+    if (ret != MP3_OK)
+        return 0;
+    if (mp->fr.lay != 3)
+        return -1;
+
+    spec->granules = mp->spec_granules;
+    spec->channels = mp->fr.stereo;
+    spec->samplerate = freqs[mp->fr.sampling_frequency];
+    spec->mode = mp->fr.mode;
+    spec->mode_ext = mp->fr.mode_ext;
+    spec->main_data_begin = mp->sideinfo.main_data_begin;
+    for (gr = 0; gr < spec->granules; gr++) {
+        for (ch = 0; ch < spec->channels; ch++) {
+            struct gr_info_s *gi = &mp->sideinfo.ch[ch].gr[gr];
+            real   *xr = mp->spec_xr[gr][ch][0];
+
+            spec->gr[gr][ch].part2_3_length = gi->part2_3_length;
+            spec->gr[gr][ch].big_values = gi->big_values;
+            spec->gr[gr][ch].global_gain = gi->global_gain;
+            spec->gr[gr][ch].scalefac_compress = gi->scalefac_compress;
+            spec->gr[gr][ch].block_type = gi->block_type;
+            spec->gr[gr][ch].mixed_block_flag = gi->mixed_block_flag;
+            /* full_gain[] is only set with window switching */
+            for (i = 0; i < 3; i++)
+                spec->gr[gr][ch].subblock_gain[i] = gi->block_type == 0 ? 0
+                    : (gi->full_gain[i] - gi->pow2gain) >> 3;
+            spec->gr[gr][ch].preflag = gi->preflag;
+            spec->gr[gr][ch].scalefac_scale = gi->scalefac_scale;
+            spec->gr[gr][ch].count1table_select = gi->count1table_select;
+            memcpy(spec->gr[gr][ch].scalefac, mp->spec_scalefac[gr][ch],
+                   sizeof(spec->gr[gr][ch].scalefac));
+            for (i = 0; i < SBLIMIT * SSLIMIT; i++)
+                spec->gr[gr][ch].xr[i] = xr[i];
+        }
+    }
+    return 1;
+}
+
+
+int
+lame_decoder_decode1_headers(lame_decoder_t * dec, unsigned char *buffer,
+                             int len, short pcm_l[], short pcm_r[],
+                             mp3data_struct * mp3data)
+{
+    int     enc_delay, enc_padding;
+
+    return lame_decode1_headersB_clipchoice(&dec->mp, buffer, len,
+                                            (char *) pcm_l, (char *) pcm_r,
+                                            mp3data, &enc_delay, &enc_padding,
+                                            dec->out, sizeof(dec->out),
+                                            sizeof(short), decodeMP3);
+}
+
+
 #endif
 
 /* end of mpglib_interface.c */
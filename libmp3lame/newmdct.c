@@ -681,35 +681,72 @@ inline static void mdct_long(FLOAT8 *out, FLOAT8 *in)
 }
 
 
+/* identical input channels with identical filterbank state give
+ * identical spectra, see lame_encode_buffer_sample_t() */
+static int
+mdct_channels(lame_internal_flags *gfc)
+{
+    int gr;
+
+    if (gfc->channels_out != 2 || gfc->mf_lr_diff != 0
+	|| memcmp(gfc->sb_sample[0][0], gfc->sb_sample[1][0],
+		  sizeof(gfc->sb_sample[0][0])))
+	return gfc->channels_out;
+    for (gr = 0; gr < gfc->mode_gr; gr++) {
+	gr_info *gi = gfc->l3_side.tt[gr];
+	if (gi[0].block_type != gi[1].block_type
+	    || gi[0].mixed_block_flag != gi[1].mixed_block_flag)
+	    return 2;
+    }
+    return 1;
+}
+
 void mdct_sub48(
     lame_internal_flags *gfc, const sample_t *w0, const sample_t *w1
     )
 {
-    int gr, k, ch;
+    int gr, k, ch, nch = mdct_channels(gfc);
     const sample_t *wk;
 
     wk = w0 + 286;
     /* thinking cache performance, ch->gr loop is better than gr->ch loop */
-    for (ch = 0; ch < gfc->channels_out; ch++) {
+    for (ch = 0; ch < nch; ch++) {
 	for (gr = 0; gr < gfc->mode_gr; gr++) {
 	    int	band;
 	    gr_info *gi = &(gfc->l3_side.tt[gr][ch]);
 	    FLOAT8 *mdct_enc = gi->xr;
 	    FLOAT8 *samp = gfc->sb_sample[ch][1 - gr][0];
-
-	    for (k = 0; k < 18 / 2; k++) {
-		window_subband(wk, samp);
-		window_subband(wk + 32, samp + 32);
-		samp += 64;
-		wk += 64;
-		/*
-		 * Compensate for inversion in the analysis filter
-		 */
-		for (band = 1; band < 32; band+=2) {
-		    samp[band-32] *= -1;
+	    int inaudible;
+
+	    /* the 18 windows of this granule read [wk-286, wk+17*32+224],
+	     * input below the ATH gives silent subband samples */
+	    inaudible = is_inaudible(wk - 286, 17*32 + 511, gfc->ATH->inaudible);
+	    if (inaudible) {
+		memset(samp, 0, 18*SBLIMIT*sizeof(FLOAT8));
+		wk += 18*32;
+	    } else {
+		for (k = 0; k < 18 / 2; k++) {
+		    window_subband(wk, samp);
+		    window_subband(wk + 32, samp + 32);
+		    samp += 64;
+		    wk += 64;
+		    /*
+		     * Compensate for inversion in the analysis filter
+		     */
+		    for (band = 1; band < 32; band+=2) {
+			samp[band-32] *= -1;
+		    }
 		}
 	    }
 
+	    /* this granule and the one before are below the ATH: nothing
+	     * to code, the quantization makes an empty granule of zero xr */
+	    if (inaudible && gfc->sb_inaudible[ch]) {
+		memset(mdct_enc, 0, sizeof(FLOAT8)*576);
+		continue;
+	    }
+	    gfc->sb_inaudible[ch] = inaudible;
+
 	    /*
 	     * Perform imdct of 18 previous subband samples
 	     * + 18 current subband samples
@@ -756,8 +793,9 @@ void mdct_sub48(
 		}
 		/*
 		 * Perform aliasing reduction butterfly
+		 * (nothing to do above the lowpass, both bands are zero)
 		 */
-		if (type != SHORT_TYPE && band != 0) {
+		if (type != SHORT_TYPE && band != 0 && band <= gfc->sblimit) {
 		  for (k = 7; k >= 0; --k) {
 		    FLOAT8 bu,bd;
 		    bu = mdct_enc[k] * ca[k] + mdct_enc[-1-k] * cs[k];
@@ -774,4 +812,11 @@ void mdct_sub48(
 	    memcpy(gfc->sb_sample[ch][0], gfc->sb_sample[ch][1], 576 * sizeof(FLOAT8));
 	}
     }
+
+    if (nch < gfc->channels_out) {
+	for (gr = 0; gr < gfc->mode_gr; gr++)
+	    memcpy(gfc->l3_side.tt[gr][1].xr, gfc->l3_side.tt[gr][0].xr,
+		   sizeof(FLOAT8)*576);
+	memcpy(gfc->sb_sample[1], gfc->sb_sample[0], sizeof(gfc->sb_sample[0]));
+    }
 }
@@ -163,8 +163,8 @@ blocktype_d[2]        block type to use for previous granule
 
 static const float non_linear_psy_constant = .3;
 
-#define NON_LINEAR_SCALE_ITEM(x)   pow((x), non_linear_psy_constant)
-#define NON_LINEAR_SCALE_SUM(x)    pow((x), 1/non_linear_psy_constant)
+#define NON_LINEAR_SCALE_ITEM(x)   FAST_POW((x), non_linear_psy_constant)
+#define NON_LINEAR_SCALE_SUM(x)    FAST_POW((x), 1/non_linear_psy_constant)
 
 #if 0
 #define NON_LINEAR_SCALE_ENERGY(x) pow(10, (x)/10)
@@ -247,19 +247,21 @@ static void
 compute_ffts(
     lame_global_flags *gfp,
     FLOAT fftenergy[HBLKSIZE],
-    FLOAT (*fftenergy_s)[HBLKSIZE_s],
     FLOAT (*wsamp_l)[BLKSIZE],
-    FLOAT (*wsamp_s)[3][BLKSIZE_s],
     int gr_out,
     int chn,
     const sample_t *buffer[2]
     )
 {
-    int b, j;
+    int j;
     lame_internal_flags *gfc=gfp->internal_flags;
     if (chn<2) {
-	fft_long ( gfc, *wsamp_l, chn, buffer);
-	fft_short( gfc, *wsamp_s, chn, buffer);
+	/* the FFT of digital silence is known, input below the ATH is
+	   analysed as digital silence */
+	if (is_inaudible(buffer[chn], BLKSIZE, gfc->ATH->inaudible))
+	    memset(*wsamp_l, 0, sizeof(*wsamp_l));
+	else
+	    fft_long ( gfc, *wsamp_l, chn, buffer);
     }
     /* FFT data for mid and side channel is derived from L & R */
     else if (chn == 2) {
@@ -269,14 +271,6 @@ compute_ffts(
 	    wsamp_l[0][j] = (l+r)*(FLOAT)(SQRT2*0.5);
 	    wsamp_l[1][j] = (l-r)*(FLOAT)(SQRT2*0.5);
 	}
-	for (b = 2; b >= 0; --b) {
-	    for (j = BLKSIZE_s-1; j >= 0 ; --j) {
-		FLOAT l = wsamp_s[0][b][j];
-		FLOAT r = wsamp_s[1][b][j];
-		wsamp_s[0][b][j] = (l+r)*(FLOAT)(SQRT2*0.5);
-		wsamp_s[1][b][j] = (l-r)*(FLOAT)(SQRT2*0.5);
-	    }
-	}
     }
 	
     /*********************************************************************
@@ -290,15 +284,6 @@ compute_ffts(
 	FLOAT im = (*wsamp_l)[BLKSIZE/2+j];
 	fftenergy[BLKSIZE/2-j] = NON_LINEAR_SCALE_ENERGY((re * re + im * im) * 0.5f);
     }
-    for (b = 2; b >= 0; --b) {
-	fftenergy_s[b][0]  = (*wsamp_s)[b][0];
-	fftenergy_s[b][0] *=  fftenergy_s [b][0];
-	for (j=BLKSIZE_s/2-1; j >= 0; --j) {
-	    FLOAT re = (*wsamp_s)[b][BLKSIZE_s/2-j];
-	    FLOAT im = (*wsamp_s)[b][BLKSIZE_s/2+j];
-	    fftenergy_s[b][BLKSIZE_s/2-j] = NON_LINEAR_SCALE_ENERGY((re * re + im * im) * 0.5f);
-	}
-    }
     /* total energy */
     {FLOAT totalenergy=0.0;
     for (j=11;j < HBLKSIZE; j++)
@@ -326,13 +311,56 @@ compute_ffts(
     }
 }
 
+/* same as above for the three short blocks */
+static void
+compute_ffts_s(
+    lame_global_flags *gfp,
+    FLOAT (*fftenergy_s)[HBLKSIZE_s],
+    FLOAT (*wsamp_s)[3][BLKSIZE_s],
+    int chn,
+    const sample_t *buffer[2]
+    )
+{
+    int b, j;
+    lame_internal_flags *gfc=gfp->internal_flags;
+    if (chn<2) {
+	if (is_inaudible(buffer[chn] + 576/3, 576/3*2 + BLKSIZE_s,
+			 gfc->ATH->inaudible))
+	    memset(*wsamp_s, 0, sizeof(*wsamp_s));
+	else
+	    fft_short( gfc, *wsamp_s, chn, buffer);
+    }
+    else if (chn == 2) {
+	for (b = 2; b >= 0; --b) {
+	    for (j = BLKSIZE_s-1; j >= 0 ; --j) {
+		FLOAT l = wsamp_s[0][b][j];
+		FLOAT r = wsamp_s[1][b][j];
+		wsamp_s[0][b][j] = (l+r)*(FLOAT)(SQRT2*0.5);
+		wsamp_s[1][b][j] = (l-r)*(FLOAT)(SQRT2*0.5);
+	    }
+	}
+    }
+
+    for (b = 2; b >= 0; --b) {
+	fftenergy_s[b][0]  = (*wsamp_s)[b][0];
+	fftenergy_s[b][0] *=  fftenergy_s [b][0];
+	for (j=BLKSIZE_s/2-1; j >= 0; --j) {
+	    FLOAT re = (*wsamp_s)[b][BLKSIZE_s/2-j];
+	    FLOAT im = (*wsamp_s)[b][BLKSIZE_s/2+j];
+	    fftenergy_s[b][BLKSIZE_s/2-j] = NON_LINEAR_SCALE_ENERGY((re * re + im * im) * 0.5f);
+	}
+    }
+}
+
 /*************************************************************** 
  * compute interchannel masking effects
+ * (here and below, short blocks before sblock0 are left alone)
  ***************************************************************/
 static void
 calc_interchannel_masking(
     lame_global_flags * gfp,
-    FLOAT ratio
+    FLOAT ratio,
+    int sblock0
     )
 {
     lame_internal_flags *gfc=gfp->internal_flags;
@@ -346,7 +374,7 @@ calc_interchannel_masking(
 	        gfc->thm[1].l[sb] += l*ratio;
         }
         for ( sb = 0; sb < SBMAX_s; sb++ ) {
-	        for ( sblock = 0; sblock < 3; sblock++ ) {
+	        for ( sblock = sblock0; sblock < 3; sblock++ ) {
 	            l = gfc->thm[0].s[sb][sblock];
 	            r = gfc->thm[1].s[sb][sblock];
 	            gfc->thm[0].s[sb][sblock] += r*ratio;
@@ -363,7 +391,8 @@ calc_interchannel_masking(
  ***************************************************************/
 static void
 msfix1(
-    lame_internal_flags *gfc
+    lame_internal_flags *gfc,
+    int sblock0
     )
 {
     int sb, sblock;
@@ -386,7 +415,7 @@ msfix1(
     }
 
     for ( sb = 0; sb < SBMAX_s; sb++ ) {
-	for ( sblock = 0; sblock < 3; sblock++ ) {
+	for ( sblock = sblock0; sblock < 3; sblock++ ) {
 	    if (gfc->thm[0].s[sb][sblock] > 1.58*gfc->thm[1].s[sb][sblock]
 	     || gfc->thm[1].s[sb][sblock] > 1.58*gfc->thm[0].s[sb][sblock])
 		continue;
@@ -413,12 +442,13 @@ static void
 ns_msfix(
     lame_internal_flags *gfc,
     FLOAT msfix,
-    FLOAT athadjust
+    FLOAT athadjust,
+    int sblock0
     )
 {
     int sb, sblock;
     FLOAT msfix2 = msfix;
-    FLOAT athlower = pow(10, athadjust);
+    FLOAT athlower = FAST_POW10(athadjust);
 
     msfix *= 2.0;
     msfix2 *= 2.0;
@@ -440,7 +470,7 @@ ns_msfix(
 
     athlower *= (BLKSIZE_s / BLKSIZE);
     for ( sb = 0; sb < SBMAX_s; sb++ ) {
-	for ( sblock = 0; sblock < 3; sblock++ ) {
+	for ( sblock = sblock0; sblock < 3; sblock++ ) {
 	    FLOAT8 thmLR,thmM,thmS,ath;
 	    ath  = (gfc->ATH->cb[gfc->bm_s[sb]])*athlower;
 	    thmLR = Min(Max(gfc->thm[0].s[sb][sblock],ath),
@@ -501,21 +531,20 @@ static void convert_partition2scalefac_l(
 static void
 compute_masking_s(
     lame_internal_flags *gfc,
-    FLOAT (*fftenergy_s)[HBLKSIZE_s],
+    const FLOAT *fftenergy_s,
     FLOAT8 *eb,
     FLOAT8 *thr,
     int chn,
-    int sblock,
     FLOAT8 athlower
     )
 {
     int j, b;
     athlower *= (BLKSIZE_s / BLKSIZE);
     for (j = b = 0; b < gfc->npart_s; b++) {
-	FLOAT ecb = fftenergy_s[sblock][j++];
+	FLOAT ecb = fftenergy_s[j++];
 	int kk = gfc->numlines_s[b];
 	while (--kk > 0)
-	    ecb += fftenergy_s[sblock][j++];
+	    ecb += fftenergy_s[j++];
 	eb[b] = ecb;
     }
     for (j = b = 0; b < gfc->npart_s; b++) {
@@ -657,8 +686,8 @@ int L3psycho_anal( lame_global_flags * gfp,
 	 *********************************************************************/
 	wsamp_s = wsamp_S+(chn & 1);
 	wsamp_l = wsamp_L+(chn & 1);
-	compute_ffts(gfp, fftenergy, fftenergy_s,
-		     wsamp_l, wsamp_s, gr_out, chn, buffer);
+	compute_ffts(gfp, fftenergy, wsamp_l, gr_out, chn, buffer);
+	compute_ffts_s(gfp, fftenergy_s, wsamp_s, chn, buffer);
 
 	/*********************************************************************
 	 *    compute unpredicatability of first six spectral lines
@@ -827,9 +856,9 @@ int L3psycho_anal( lame_global_flags * gfp,
 		/* tonality small:   tbb=1 */
 		/* tonality large:   tbb=-.299 */
 		tbb = CONV1 + FAST_LOG_X(tbb, CONV2);
-		if (tbb < 0.0) tbb = exp(-LN_TO_LOG10*NMT);
-		else if (tbb > 1.0) tbb = exp(-LN_TO_LOG10*TMN);
-		else tbb = exp(-LN_TO_LOG10 * ( (TMN-NMT)*tbb + NMT ));
+		if (tbb < 0.0) tbb = FAST_POW10(-0.1*NMT);
+		else if (tbb > 1.0) tbb = FAST_POW10(-0.1*TMN);
+		else tbb = FAST_POW10(-0.1 * ( (TMN-NMT)*tbb + NMT ));
 	    }
 
 /* at this point, tbb represents the amount the spreading function
@@ -927,8 +956,8 @@ int L3psycho_anal( lame_global_flags * gfp,
 	/* compute masking thresholds for short blocks */
 	for (sblock = 0; sblock < 3; sblock++) {
 	    FLOAT8 enn, thmm;
-	    compute_masking_s(gfc, fftenergy_s, eb, thr, chn,
-			      sblock,gfp->ATHlower*gfc->ATH->adjust);
+	    compute_masking_s(gfc, fftenergy_s[sblock], eb, thr, chn,
+			      gfp->ATHlower*gfc->ATH->adjust);
 	    b = -1;
 	    enn = thmm = 0.0;
 	    for (sb = 0; sb < SBMAX_s; sb++) {
@@ -953,13 +982,13 @@ int L3psycho_anal( lame_global_flags * gfp,
     } /* end loop over chn */
 
     if (gfp->interChRatio != 0.0)
-	calc_interchannel_masking(gfp, gfp->interChRatio);
+	calc_interchannel_masking(gfp, gfp->interChRatio, 0);
 
     if (gfp->mode == JOINT_STEREO) {
 	FLOAT8 db,x1,x2,sidetot=0,tot=0;
-	msfix1(gfc);
+	msfix1(gfc, 0);
 	if (gfp->msfix != 0.0)
-	    ns_msfix(gfc, gfp->msfix, gfp->ATHlower*gfc->ATH->adjust);
+	    ns_msfix(gfc, gfp->msfix, gfp->ATHlower*gfc->ATH->adjust, 0);
 
 	/* determin ms_ratio from masking thresholds*/
 	/* use ms_stereo (ms_ratio < .35) if average thresh. diff < 5 db */
@@ -1097,7 +1126,8 @@ inline static FLOAT8 mask_add(FLOAT8 m1,FLOAT8 m2,int k,int b, lame_internal_fla
 
   m1 += m2;
 
-  if ((unsigned int)(b+3) <= 3+3) {  /* approximately, 1 bark = 3 partitions */
+  if ((unsigned int)(b+gfc->mask_add_near) <= 2*gfc->mask_add_near) {
+      /* approximately 1 bark: 3 partitions, 1 with coarse partitions */
       /* 65% of the cases */
       /* originally 'if(i > 8)' */
       if (ratio >= ma_max_i1) {
@@ -1149,9 +1179,9 @@ static inline FLOAT8 NS_INTERP(FLOAT8 x, FLOAT8 y, FLOAT8 r)
         return x;              /* 99.7% of the time */
     if(r==0.0)
 	return y;
-    if(y>0.0)
-        return pow(x/y,r)*y;   /* rest of the time */ 
-    return 0.0;                /* never happens */ 
+    if(x>0.0 && y>0.0)
+        return FAST_POW(x/y,r)*y;   /* rest of the time */
+    return 0.0;
 }
 
 
@@ -1283,6 +1313,266 @@ pecalc_l(
 
 
 
+/* masking thresholds and energies of one short block, with pre-echo control */
+static void
+ns_masking_s(
+    lame_global_flags *gfp,
+    const FLOAT *fftenergy_s,
+    const FLOAT *en_subshort,
+    const int *ns_attacks,
+    int chn,
+    int sblock,
+    FLOAT athadjust,
+    FLOAT pcfact
+    )
+{
+    lame_internal_flags *gfc=gfp->internal_flags;
+    FLOAT8 eb[CBANDS+1];
+    FLOAT8 thr[CBANDS+1];
+    FLOAT8 enn, thmm;
+    int sb, b;
+
+    /* the sfb sums below access one partition beyond npart_s */
+    assert( gfc->npart_s <= CBANDS );
+    eb [gfc->npart_s] = 0;
+    thr[gfc->npart_s] = 0;
+
+    compute_masking_s(gfc, fftenergy_s, eb, thr, chn, athadjust);
+    b = -1;
+    for (sb = 0; sb < SBMAX_s; sb++) {
+	enn = thmm = 0.0;
+	while (++b < gfc->bo_s[sb]) {
+	    enn  += eb[b];
+	    thmm += thr[b];
+	}
+	enn  += 0.5 * eb[b];    /* for the last sfb b is larger than npart_s!! */
+	thmm += 0.5 * thr[b];   /* rh 20040301 */
+	gfc->en [chn].s[sb][sblock] = enn;
+
+	assert( enn >= 0 );
+	assert( thmm >= 0 );
+
+	/****   short block pre-echo control   ****/
+	thmm *= NS_PREECHO_ATT0;
+	if (ns_attacks[sblock] >= 2 || ns_attacks[sblock+1] == 1) {
+	    int idx = (sblock != 0) ? sblock-1 : 2;
+	    double p = NS_INTERP(gfc->thm[chn].s[sb][idx],
+				 thmm, NS_PREECHO_ATT1*pcfact);
+	    thmm = Min(thmm,p);
+	}
+
+	if (ns_attacks[sblock] == 1) {
+	    int idx = (sblock != 0) ? sblock-1 : 2;
+	    double p = NS_INTERP(gfc->thm[chn].s[sb][idx],
+				 thmm,NS_PREECHO_ATT2*pcfact);
+	    thmm = Min(thmm,p);
+	} else if ((sblock != 0 && ns_attacks[sblock-1] == 3)
+		|| (sblock == 0 && gfc->nsPsy.last_attacks[chn] == 3)) {
+	    int idx = (sblock != 2) ? sblock+1 : 0;
+	    double p = NS_INTERP(gfc->thm[chn].s[sb][idx],
+				 thmm,NS_PREECHO_ATT2*pcfact);
+	    thmm = Min(thmm,p);
+	}
+
+	/* pulse like signal detection for fatboy.wav and so on */
+	enn = en_subshort[sblock*3+3] + en_subshort[sblock*3+4]
+	    + en_subshort[sblock*3+5];
+	if (en_subshort[sblock*3+5]*6 < enn) {
+	    thmm *= 0.5;
+	    if (en_subshort[sblock*3+4]*6 < enn)
+		thmm *= 0.5;
+	}
+
+	gfc->thm[chn].s[sb][sblock] = thmm;
+    }
+}
+
+/* The right channel gives the same results as the left one if the input
+ * of both is identical (see lame_encode_buffer_sample_t) and so is the
+ * state carried over from the last granules.
+ */
+static int
+ns_lr_same(lame_global_flags *gfp)
+{
+    lame_internal_flags *gfc=gfp->internal_flags;
+
+    return gfc->channels_out == 2 && gfc->mf_lr_diff == 0
+	&& !gfp->analysis && !gfc->nsPsy.pass1fp
+	&& gfc->blocktype_old[0] == gfc->blocktype_old[1]
+	&& gfc->tot_ener[0] == gfc->tot_ener[1]
+	&& gfc->loudness_sq_save[0] == gfc->loudness_sq_save[1]
+	&& gfc->nsPsy.last_attacks[0] == gfc->nsPsy.last_attacks[1]
+	&& !memcmp(gfc->nsPsy.last_en_subshort[0],
+		   gfc->nsPsy.last_en_subshort[1],
+		   sizeof(gfc->nsPsy.last_en_subshort[0]))
+	&& !memcmp(gfc->nb_1[0], gfc->nb_1[1], sizeof(gfc->nb_1[0]))
+	&& !memcmp(gfc->nb_2[0], gfc->nb_2[1], sizeof(gfc->nb_2[0]))
+	&& !memcmp(gfc->nb_s1[0], gfc->nb_s1[1], sizeof(gfc->nb_s1[0]))
+	&& !memcmp(gfc->nb_s2[0], gfc->nb_s2[1], sizeof(gfc->nb_s2[0]))
+	&& !memcmp(&gfc->en[0], &gfc->en[1], sizeof(gfc->en[0]))
+	&& !memcmp(&gfc->thm[0], &gfc->thm[1], sizeof(gfc->thm[0]));
+}
+
+/* the right channel part of the analysis loop in L3psycho_anal_ns() */
+static void
+ns_copy_lr(lame_internal_flags *gfc, int gr_out)
+{
+    memcpy(gfc->nb_1[1], gfc->nb_1[0], sizeof(gfc->nb_1[0]));
+    memcpy(gfc->nb_2[1], gfc->nb_2[0], sizeof(gfc->nb_2[0]));
+    memcpy(gfc->nb_s1[1], gfc->nb_s1[0], sizeof(gfc->nb_s1[0]));
+    memcpy(gfc->nb_s2[1], gfc->nb_s2[0], sizeof(gfc->nb_s2[0]));
+    gfc->en[1] = gfc->en[0];
+    gfc->thm[1] = gfc->thm[0];
+    gfc->tot_ener[1] = gfc->tot_ener[0];
+    gfc->loudness_sq[gr_out][1] = gfc->loudness_sq[gr_out][0];
+    gfc->loudness_sq_save[1] = gfc->loudness_sq_save[0];
+    gfc->nsPsy.last_attacks[1] = gfc->nsPsy.last_attacks[0];
+}
+
+/* the sum of log(eM*eS / (eL*eR)), in nats over the BLKSIZE/2+1 lines,
+ * above which L/R is taken as certain: about 1.1 per line, eM*eS 5 dB
+ * above eL*eR.  Correlated material and uncorrelated noise stay below 65.
+ * On wide stereo (music left, speech right) at -b 128, 2299 frames,
+ * 288 turns 12 frames from M/S to L/R, 576 turns 3 and skips half the
+ * granules, 1152 none and under a quarter */
+#define NS_MS_UNLIKELY_LOG 576.0
+
+/* Guess from the L/R spectra whether M/S coding can pay off at all.  If
+ * the maskings followed the energies, the perceptual entropy of M/S would
+ * exceed that of L/R by the sum of log(eM*eS / (eL*eR)) over the lines.
+ * A large value means L/R coding and the M/S maskings are not needed.
+ * A digitally silent channel is left to the full analysis, M/S often
+ * wins there.
+ */
+static int
+ns_ms_unlikely(lame_global_flags *gfp, FLOAT (*wsamp_l)[BLKSIZE])
+{
+    lame_internal_flags *gfc=gfp->internal_flags;
+    FLOAT8 tl = 0.0, tr = 0.0, d = 0.0;
+    int b, i, j;
+
+    if (gfp->quality <= 2 || gfp->force_ms || gfp->analysis
+	|| gfc->nsPsy.pass1fp)
+	return 0;
+
+    for (b = j = 0; b < gfc->npart_l; b++) {
+	FLOAT8 el = 0.0, er = 0.0, c = 0.0, ems;
+	for (i = gfc->numlines_l[b]; i > 0; i--, j++) {
+	    FLOAT l = wsamp_l[0][j], r = wsamp_l[1][j];
+	    el += l*l;
+	    er += r*r;
+	    c  += l*r;
+	    if (j > 0) {
+		l = wsamp_l[0][BLKSIZE-j];
+		r = wsamp_l[1][BLKSIZE-j];
+		el += l*l;
+		er += r*r;
+		c  += l*r;
+	    }
+	}
+	tl += el;
+	tr += er;
+	if (el + er > 0.0) {
+	    /* eM*eS = ((eL+eR)/2)^2 - cross^2 */
+	    ems = 0.25*(el + er)*(el + er) - c*c;
+	    if (ems < 0.0)
+		ems = 0.0;
+	    d += gfc->numlines_l[b] * FAST_LOG((ems + 1e-9) / (el*er + 1e-9));
+	}
+    }
+    return tl > 0.0 && tr > 0.0 && d > NS_MS_UNLIKELY_LOG;
+}
+
+/* The analysis of a M/S channel resumes after it was skipped: forget
+ * its history, stale values must not feed pre-echo control and temporal
+ * masking.
+ */
+static void
+ns_forget_ms(lame_internal_flags *gfc, int chn)
+{
+    int b, sb;
+
+    for (b = 0; b < CBANDS; b++) {
+	gfc->nb_1[chn][b] = gfc->nb_2[chn][b] = 1e20;
+	gfc->nb_s1[chn][b] = gfc->nb_s2[chn][b] = 1.0;
+    }
+    for (sb = 0; sb < SBMAX_s; sb++)
+	gfc->thm[chn].s[sb][0] = gfc->thm[chn].s[sb][1]
+	    = gfc->thm[chn].s[sb][2] = 1e20;
+}
+
+static void
+ns_stereo_masking(
+    lame_global_flags *gfp,
+    int sblock0,
+    FLOAT athadjust
+    )
+{
+    lame_internal_flags *gfc=gfp->internal_flags;
+
+    if (gfp->interChRatio != 0.0)
+	calc_interchannel_masking(gfp, gfp->interChRatio, sblock0);
+
+    if (gfp->mode == JOINT_STEREO && !gfc->nsPsy.skipped_ms) {
+	FLOAT msfix;
+	msfix1(gfc, sblock0);
+	msfix = gfp->msfix;
+	if (msfix != 0.0)
+	    ns_msfix(gfc, msfix, athadjust, sblock0);
+    }
+}
+
+/*
+ * The short block analysis of the previous granule was skipped, but this
+ * one needs its last short block: the pre-echo control looks at its
+ * thresholds and compute_masking_s() at the spread energies of its last
+ * two short blocks (nb_s1, nb_s2).  Both blocks lie within the current
+ * FFT input (at -192 and 0), so redo them here.  The previous granule
+ * had no attacks, so no pre-echo control applies to its last block.
+ * Its sub-short energies are en_subshort[chn][0..2].
+ * The long block values touched by ns_stereo_masking() get recomputed
+ * later in this granule.
+ */
+static void
+ns_restore_masking_s(
+    lame_global_flags *gfp,
+    const sample_t *buffer[2],
+    FLOAT (*en_subshort)[12],
+    int numchn
+    )
+{
+    lame_internal_flags *gfc=gfp->internal_flags;
+    static const int no_attacks[4] = {0, 0, 0, 0};
+    FLOAT athadjust = gfc->nsPsy.skipped_athadjust;
+    FLOAT wsamp_S[2][3][BLKSIZE_s];
+    FLOAT fftenergy_s[3][HBLKSIZE_s];
+    FLOAT8 eb[CBANDS+1];
+    FLOAT8 thr[CBANDS+1];
+    FLOAT en_prev[12];
+    const sample_t *prev[2];
+    int chn;
+
+    /* fft_short() starts at 192: this puts the short blocks at -192, 0
+     * and 192, the last one is not used */
+    for (chn = 0; chn < gfc->channels_out; chn++)
+	prev[chn] = buffer[chn] - 2*192;
+
+    for (chn = 0; chn < numchn; chn++) {
+	compute_ffts_s(gfp, fftenergy_s, wsamp_S+(chn & 1), chn, prev);
+	/* only for nb_s1 */
+	compute_masking_s(gfc, fftenergy_s[0], eb, thr, chn, athadjust);
+
+	en_prev[9]  = en_subshort[chn][0];
+	en_prev[10] = en_subshort[chn][1];
+	en_prev[11] = en_subshort[chn][2];
+	ns_masking_s(gfp, fftenergy_s[1], en_prev, no_attacks, chn, 2,
+		     athadjust, 0.0);
+    }
+    ns_stereo_masking(gfp, 2, athadjust);
+}
+
+
+
 int L3psycho_anal_ns( lame_global_flags * gfp,
                     const sample_t *buffer[2], int gr_out, 
                     FLOAT *ms_ratio,
@@ -1310,16 +1600,26 @@ int L3psycho_anal_ns( lame_global_flags * gfp,
     /* usual variables like loop indices, etc..    */
     int numchn, chn;
     int b, i, j, k;
-    int	sb,sblock;
+    int	sblock;
 
     /* variables used for --nspsytune */
     FLOAT ns_hpfsmpl[2][576];
     FLOAT pcfact;
+    FLOAT en_subshort[4][12];
+    int ns_attacks[4][4];
+    int do_short, lr_same, skip_ms;
 
     numchn = gfc->channels_out;
     /* chn=2 and 3 = Mid and Side channels */
     if (gfp->mode == JOINT_STEREO) numchn=4;
 
+    lr_same = ns_lr_same(gfp);
+
+    /* the M/S maskings returned below were computed by the last call */
+    if (gr_out == 0)
+	gfc->nsPsy.ms_missing = 0;
+    gfc->nsPsy.ms_missing |= gfc->nsPsy.skipped_ms;
+
     if (gfp->VBR==vbr_off) pcfact = gfc->ResvMax == 0 ? 0 : ((FLOAT)gfc->ResvSize)/gfc->ResvMax*0.5;
     else if (gfp->VBR == vbr_rh  ||  gfp->VBR == vbr_mtrh  ||  gfp->VBR == vbr_mt) {
 	    /*static const FLOAT pcQns[10]={1.0,1.0,1.0,0.8,0.6,0.5,0.4,0.3,0.2,0.1};
@@ -1362,59 +1662,20 @@ int L3psycho_anal_ns( lame_global_flags * gfp,
 	}
     }
 
+    /*************************************************************** 
+     * determine the block type (window type)
+     ***************************************************************/
     for (chn=0; chn<numchn; chn++) {
-	FLOAT (*wsamp_l)[BLKSIZE];
-	FLOAT (*wsamp_s)[3][BLKSIZE_s];
-	FLOAT en_subshort[12];
 	FLOAT attack_intensity[12];
-	int ns_uselongblock = 1;
 	FLOAT attackThreshold;
-	FLOAT8 max[CBANDS],avg[CBANDS];
-	int ns_attacks[4] = {0};
-	FLOAT fftenergy[HBLKSIZE];
-	FLOAT fftenergy_s[3][HBLKSIZE_s];
-	/* convolution   */
-	FLOAT8 eb[CBANDS+1],eb2[CBANDS];
-	FLOAT8 thr[CBANDS+1];
-
-
-    /*This is the masking table:
-      According to tonality, values are going from 0dB (TMN)
-      to 9.3dB (NMT).
-      After additive masking computation, 8dB are added, so
-      final values are going from 8dB to 17.3dB
-    */
-    static const FLOAT8 tab[] = {
-        1.0/*pow(10, -0)*/,
-        0.79433/*pow(10, -0.1)*/,
-        0.63096/*pow(10, -0.2)*/,
-        0.63096/*pow(10, -0.2)*/,
-        0.63096/*pow(10, -0.2)*/,
-        0.63096/*pow(10, -0.2)*/,
-        0.63096/*pow(10, -0.2)*/,
-        0.25119/*pow(10, -0.6)*/,
-	    0.11749/*pow(10, -0.93)*/
-	};
+	int *attacks = ns_attacks[chn];
+	int ns_uselongblock = 1;
 
-    /*  rh 20040301: the following loops do access one off the limits
-     *  so I increase  the array dimensions by one and initialize the
-     *  accessed values to zero
-     */
-    assert( gfc->npart_s <= CBANDS );
-    assert( gfc->npart_l <= CBANDS );
-    eb [gfc->npart_s] = 0;
-    thr[gfc->npart_s] = 0;
-    eb [gfc->npart_l] = 0;
-    thr[gfc->npart_l] = 0;
-    
-	/*************************************************************** 
-	 * determine the block type (window type)
-	 ***************************************************************/
 	/* calculate energies of each sub-shortblocks */
 	for (i=0; i<3; i++) {
-	    en_subshort[i] = gfc->nsPsy.last_en_subshort[chn][i+6];
+	    en_subshort[chn][i] = gfc->nsPsy.last_en_subshort[chn][i+6];
 	    attack_intensity[i]
-		= en_subshort[i] / gfc->nsPsy.last_en_subshort[chn][i+4];
+		= en_subshort[chn][i] / gfc->nsPsy.last_en_subshort[chn][i+4];
 	}
 
 	if (chn == 2) {
@@ -1434,11 +1695,11 @@ int L3psycho_anal_ns( lame_global_flags * gfp,
 		    if (p < fabs(*pf))
 			p = fabs(*pf);
 
-		gfc->nsPsy.last_en_subshort[chn][i] = en_subshort[i+3] = p;
-		if (p > en_subshort[i+3-2])
-		    p = p / en_subshort[i+3-2];
-		else if (en_subshort[i+3-2] > p*10.0)
-		    p = en_subshort[i+3-2] / (p*10.0);
+		gfc->nsPsy.last_en_subshort[chn][i] = en_subshort[chn][i+3] = p;
+		if (p > en_subshort[chn][i+3-2])
+		    p = p / en_subshort[chn][i+3-2];
+		else if (en_subshort[chn][i+3-2] > p*10.0)
+		    p = en_subshort[chn][i+3-2] / (p*10.0);
 		else
 		    p = 0.0;
 		attack_intensity[i+3] = p;
@@ -1457,90 +1718,121 @@ int L3psycho_anal_ns( lame_global_flags * gfp,
 	/* compare energies between sub-shortblocks */
 	attackThreshold = (chn == 3)
 	    ? gfc->nsPsy.attackthre_s : gfc->nsPsy.attackthre;
+	attacks[0] = attacks[1] = attacks[2] = attacks[3] = 0;
 	for (i=0;i<12;i++) 
-	    if (!ns_attacks[i/3] && attack_intensity[i] > attackThreshold)
-		ns_attacks[i/3] = (i % 3)+1;
+	    if (!attacks[i/3] && attack_intensity[i] > attackThreshold)
+		attacks[i/3] = (i % 3)+1;
 
-	if (ns_attacks[0] && gfc->nsPsy.last_attacks[chn])
-	    ns_attacks[0] = 0;
+	if (attacks[0] && gfc->nsPsy.last_attacks[chn])
+	    attacks[0] = 0;
 
 	if (gfc->nsPsy.last_attacks[chn] == 3 ||
-	    ns_attacks[0] + ns_attacks[1] + ns_attacks[2] + ns_attacks[3]) {
+	    attacks[0] + attacks[1] + attacks[2] + attacks[3]) {
 	    ns_uselongblock = 0;
 
-	    if (ns_attacks[1] && ns_attacks[0]) ns_attacks[1] = 0;
-	    if (ns_attacks[2] && ns_attacks[1]) ns_attacks[2] = 0;
-	    if (ns_attacks[3] && ns_attacks[2]) ns_attacks[3] = 0;
+	    if (attacks[1] && attacks[0]) attacks[1] = 0;
+	    if (attacks[2] && attacks[1]) attacks[2] = 0;
+	    if (attacks[3] && attacks[2]) attacks[3] = 0;
 	}
 	uselongblock[chn] = ns_uselongblock;
+    }
+
+    /* The short block maskings of this granule are needed only if it
+     * can be coded with short blocks: after an attack in any channel,
+     * or when a STOP block may still turn into a short one.  Otherwise
+     * the next granule can use them for pre-echo control and temporal
+     * masking only if it is short itself, in which case
+     * ns_restore_masking_s() recomputes what it needs.
+     */
+    do_short = gfp->short_blocks == short_block_forced
+	|| gfc->blocktype_old[0] == SHORT_TYPE
+	|| gfc->blocktype_old[1] == SHORT_TYPE;
+    for (chn=0; chn<numchn; chn++)
+	if (!uselongblock[chn])
+	    do_short = 1;
+
+    if (do_short && gfc->nsPsy.skipped_s)
+	ns_restore_masking_s(gfp, buffer, en_subshort, numchn);
+    gfc->nsPsy.skipped_s = !do_short;
+    gfc->nsPsy.skipped_athadjust = gfp->ATHlower*gfc->ATH->adjust;
+
+    for (chn=0; chn<numchn; chn++) {
+	FLOAT (*wsamp_l)[BLKSIZE];
+	FLOAT (*wsamp_s)[3][BLKSIZE_s];
+	FLOAT8 max[CBANDS],avg[CBANDS];
+	FLOAT fftenergy[HBLKSIZE];
+	FLOAT fftenergy_s[3][HBLKSIZE_s];
+	/* convolution   */
+	FLOAT8 eb[CBANDS+1],eb2[CBANDS];
+	FLOAT8 thr[CBANDS+1];
+
+
+    /*This is the masking table:
+      According to tonality, values are going from 0dB (TMN)
+      to 9.3dB (NMT).
+      After additive masking computation, 8dB are added, so
+      final values are going from 8dB to 17.3dB
+    */
+    static const FLOAT8 tab[] = {
+        1.0/*pow(10, -0)*/,
+        0.79433/*pow(10, -0.1)*/,
+        0.63096/*pow(10, -0.2)*/,
+        0.63096/*pow(10, -0.2)*/,
+        0.63096/*pow(10, -0.2)*/,
+        0.63096/*pow(10, -0.2)*/,
+        0.63096/*pow(10, -0.2)*/,
+        0.25119/*pow(10, -0.6)*/,
+	    0.11749/*pow(10, -0.93)*/
+	};
+
+    /*  rh 20040301: the following loops do access one off the limits
+     *  so I increase  the array dimensions by one and initialize the
+     *  accessed values to zero
+     */
+    assert( gfc->npart_l <= CBANDS );
+    eb [gfc->npart_l] = 0;
+    thr[gfc->npart_l] = 0;
 
 	/* there is a one granule delay.  Copy maskings computed last call
 	 * into masking_ratio to return to calling program.
 	 */
 	energy[chn]=gfc->tot_ener[chn];
 
+	if (chn == 1 && lr_same) {
+	    /* M/S are derived from these FFTs below */
+	    memcpy(wsamp_L[1], wsamp_L[0], sizeof(wsamp_L[0]));
+	    if (do_short)
+		memcpy(wsamp_S[1], wsamp_S[0], sizeof(wsamp_S[0]));
+	    ns_copy_lr(gfc, gr_out);
+	    continue;
+	}
+
+	/* L/R coding is certain, see ns_ms_unlikely() */
+	if (chn == 2)
+	    gfc->nsPsy.skipped_ms = ns_ms_unlikely(gfp, wsamp_L);
+	skip_ms = chn > 1 && gfc->nsPsy.skipped_ms;
+
 	/*********************************************************************
 	 *  compute FFTs
 	 *********************************************************************/
 	wsamp_s = wsamp_S+(chn & 1);
 	wsamp_l = wsamp_L+(chn & 1);
-	compute_ffts(gfp, fftenergy, fftenergy_s,
-		     wsamp_l, wsamp_s, gr_out, chn, buffer);
+	compute_ffts(gfp, fftenergy, wsamp_l, gr_out, chn, buffer);
 
 	/* compute masking thresholds for short blocks */
-	for (sblock = 0; sblock < 3; sblock++) {
-	    FLOAT8 enn, thmm;
-	    compute_masking_s(gfc, fftenergy_s, eb, thr, chn, sblock,
-			      gfp->ATHlower*gfc->ATH->adjust);
-        b = -1;
-	    for (sb = 0; sb < SBMAX_s; sb++) {
-		enn = thmm = 0.0;
-		while (++b < gfc->bo_s[sb]) {
-		    enn  += eb[b];
-		    thmm += thr[b];
-		}
-		enn  += 0.5 * eb[b];    /* for the last sfb b is larger than npart_s!! */
-		thmm += 0.5 * thr[b];   /* rh 20040301 */
-		gfc->en [chn].s[sb][sblock] = enn;
-        
-        assert( enn >= 0 );
-        assert( thmm >= 0 );
-        
-		/****   short block pre-echo control   ****/
-		thmm *= NS_PREECHO_ATT0;
-		if (ns_attacks[sblock] >= 2 || ns_attacks[sblock+1] == 1) {
-		    int idx = (sblock != 0) ? sblock-1 : 2;
-		    double p = NS_INTERP(gfc->thm[chn].s[sb][idx],
-					 thmm, NS_PREECHO_ATT1*pcfact);
-		    thmm = Min(thmm,p);
-		}
-
-		if (ns_attacks[sblock] == 1) {
-		    int idx = (sblock != 0) ? sblock-1 : 2;
-		    double p = NS_INTERP(gfc->thm[chn].s[sb][idx],
-					 thmm,NS_PREECHO_ATT2*pcfact);
-		    thmm = Min(thmm,p);
-		} else if ((sblock != 0 && ns_attacks[sblock-1] == 3)
-			|| (sblock == 0 && gfc->nsPsy.last_attacks[chn] == 3)) {
-		    int idx = (sblock != 2) ? sblock+1 : 0;
-		    double p = NS_INTERP(gfc->thm[chn].s[sb][idx],
-					 thmm,NS_PREECHO_ATT2*pcfact);
-		    thmm = Min(thmm,p);
-		}
-
-		/* pulse like signal detection for fatboy.wav and so on */
-		enn = en_subshort[sblock*3+3] + en_subshort[sblock*3+4]
-		    + en_subshort[sblock*3+5];
-		if (en_subshort[sblock*3+5]*6 < enn) {
-		    thmm *= 0.5;
-		    if (en_subshort[sblock*3+4]*6 < enn)
-			thmm *= 0.5;
-		}
+	if (do_short && !skip_ms) {
+	    compute_ffts_s(gfp, fftenergy_s, wsamp_s, chn, buffer);
+	    for (sblock = 0; sblock < 3; sblock++)
+		ns_masking_s(gfp, fftenergy_s[sblock], en_subshort[chn],
+			     ns_attacks[chn], chn, sblock,
+			     gfp->ATHlower*gfc->ATH->adjust, pcfact);
+	}
+	gfc->nsPsy.last_attacks[chn] = ns_attacks[chn][2];
 
-		gfc->thm[chn].s[sb][sblock] = thmm;
-	    }
+	if (skip_ms) {
+	    ns_forget_ms(gfc, chn);
+	    continue;
 	}
-	gfc->nsPsy.last_attacks[chn] = ns_attacks[2];
 
 	/*********************************************************************
 	 *    Calculate the energy and the tonality of each partition.
@@ -1651,16 +1943,7 @@ int L3psycho_anal_ns( lame_global_flags * gfp,
 
     } /* end loop over chn */
 
-    if (gfp->interChRatio != 0.0)
-	calc_interchannel_masking(gfp, gfp->interChRatio);
-
-    if (gfp->mode == JOINT_STEREO) {
-	FLOAT msfix;
-	msfix1(gfc);
-	msfix = gfp->msfix;
-	if (msfix != 0.0)
-	    ns_msfix(gfc, msfix, gfp->ATHlower*gfc->ATH->adjust);
-    }
+    ns_stereo_masking(gfp, do_short ? 0 : 3, gfp->ATHlower*gfc->ATH->adjust);
 
     /*************************************************************** 
      * determine final block type
@@ -1703,6 +1986,147 @@ int L3psycho_anal_ns( lame_global_flags * gfp,
 
 
 
+/* energies and thresholds of one granule and channel, from its MDCT
+ * coefficients.  xr is in the order of the filterbank, short blocks
+ * [3*line+window], mixed blocks start with the long sfbs below 36 */
+static void
+xr_masking(
+    lame_internal_flags *gfc,
+    const FLOAT8 *xr,
+    int block_type,
+    int mixed,
+    III_psy_xmin *en,
+    III_psy_xmin *thm
+    )
+{
+    FLOAT8 offset = pow(10.0, -XR_MASKING_OFFSET/10.0) * XR_TO_FFT_ENERGY;
+    int sfb, sfb_lmax, sfb_smin, i, j, w;
+
+    memset(en, 0, sizeof(*en));
+    memset(thm, 0, sizeof(*thm));
+    sfb_lmax = SBMAX_l;
+    sfb_smin = SBMAX_s;
+    if (block_type == SHORT_TYPE) {
+	sfb_lmax = mixed ? gfc->mode_gr*2 + 4 : 0;
+	sfb_smin = mixed ? 3 : 0;
+    }
+
+    for (sfb = 0; sfb < sfb_lmax; sfb++)
+	for (j = gfc->scalefac_band.l[sfb]; j < gfc->scalefac_band.l[sfb+1]; j++)
+	    en->l[sfb] += xr[j] * xr[j];
+    for (sfb = 0; sfb < sfb_lmax; sfb++) {
+	FLOAT8 x = 0.0;
+	for (i = 0; i < sfb_lmax; i++)
+	    x += gfc->s3_xr_l[sfb][i] * en->l[i];
+	thm->l[sfb] = x * offset;
+	en->l[sfb] *= XR_TO_FFT_ENERGY;
+    }
+
+    for (sfb = sfb_smin; sfb < SBMAX_s; sfb++)
+	for (j = gfc->scalefac_band.s[sfb]; j < gfc->scalefac_band.s[sfb+1]; j++)
+	    for (w = 0; w < 3; w++)
+		en->s[sfb][w] += xr[3*j+w] * xr[3*j+w];
+    for (w = 0; w < 3; w++) {
+	for (sfb = sfb_smin; sfb < SBMAX_s; sfb++) {
+	    FLOAT8 x = 0.0;
+	    for (i = sfb_smin; i < SBMAX_s; i++)
+		x += gfc->s3_xr_s[sfb][i] * en->s[i][w];
+	    thm->s[sfb][w] = x * offset;
+	}
+    }
+    for (sfb = sfb_smin; sfb < SBMAX_s; sfb++)
+	for (w = 0; w < 3; w++)
+	    en->s[sfb][w] *= XR_TO_FFT_ENERGY;
+}
+
+/* psychoacoustic model of lame_encode_spectrum(): there is no PCM, only
+ * the MDCT coefficients and the block types of the source frame in
+ * l3_side.  The energy of each scalefactor band is spread over its
+ * neighbours with s3_func(), no tonality and no pre-echo control.  The M/S
+ * thresholds get the same stereo fixes as in L3psycho_anal_ns() */
+int L3psycho_anal_xr( lame_global_flags * gfp,
+		      int gr_out,
+		      FLOAT *ms_ratio,
+		      III_psy_ratio masking_ratio[2][2],
+		      III_psy_ratio masking_MS_ratio[2][2],
+		      FLOAT percep_entropy[2], FLOAT percep_MS_entropy[2],
+		      FLOAT energy[4])
+{
+    lame_internal_flags *gfc=gfp->internal_flags;
+    gr_info *gi = gfc->l3_side.tt[gr_out];
+    FLOAT8 ms[2][576];
+    int numchn, chn, j;
+
+    numchn = gfc->channels_out;
+    gfc->nsPsy.ms_missing = 1;
+    if (numchn == 2 && gi[0].block_type == gi[1].block_type
+	&& gi[0].mixed_block_flag == gi[1].mixed_block_flag) {
+	for (j = 0; j < 576; j++) {
+	    ms[0][j] = (gi[0].xr[j] + gi[1].xr[j]) * (SQRT2*0.5);
+	    ms[1][j] = (gi[0].xr[j] - gi[1].xr[j]) * (SQRT2*0.5);
+	}
+	gfc->nsPsy.ms_missing = 0;
+	numchn = 4;
+    }
+
+    for (chn = 0; chn < numchn; chn++) {
+	const FLOAT8 *xr = chn < 2 ? gi[chn].xr : ms[chn-2];
+	FLOAT8 en = 0.0, loud = 0.0;
+
+	for (j = 0; j < 576; j++) {
+	    en += xr[j] * xr[j];
+	    loud += xr[j] * xr[j] * gfc->eql_xr[j];
+	}
+	energy[chn] = en * XR_TO_FFT_ENERGY;
+	if (chn < 2)
+	    gfc->loudness_sq[gr_out][chn] = loud;
+	xr_masking(gfc, xr, gi[chn & 1].block_type,
+		   gi[chn & 1].mixed_block_flag, &gfc->en[chn], &gfc->thm[chn]);
+    }
+    if (numchn == 4)
+	ns_stereo_masking(gfp, 0, gfp->ATHlower*gfc->ATH->adjust);
+
+    for (chn = 0; chn < numchn; chn++) {
+	int type = gi[chn & 1].block_type;
+	III_psy_ratio *mr;
+	FLOAT *ppe;
+
+	if (chn > 1) {
+	    ppe = percep_MS_entropy - 2;
+	    mr = &masking_MS_ratio[gr_out][chn-2];
+	} else {
+	    ppe = percep_entropy;
+	    mr = &masking_ratio[gr_out][chn];
+	}
+	mr->en = gfc->en[chn];
+	mr->thm = gfc->thm[chn];
+	if (type == SHORT_TYPE)
+	    ppe[chn] = pecalc_s(mr, gfc->masking_lower);
+	else
+	    ppe[chn] = pecalc_l(mr, gfc->masking_lower);
+    }
+
+    *ms_ratio = 0.0;
+    if (numchn == 4) {
+	if (energy[2] + energy[3] > 0.0)
+	    *ms_ratio = energy[3] / (energy[2] + energy[3]);
+    } else if (gfc->channels_out == 2) {
+	/* different windows, L/R coding */
+	*ms_ratio = 1.0;
+	energy[2] = energy[0];
+	energy[3] = energy[1];
+	percep_MS_entropy[0] = percep_entropy[0];
+	percep_MS_entropy[1] = percep_entropy[1];
+	masking_MS_ratio[gr_out][0] = masking_ratio[gr_out][0];
+	masking_MS_ratio[gr_out][1] = masking_ratio[gr_out][1];
+    }
+    return 0;
+}
+
+
+
+
+
 /* 
  *   The spreading function.  Values returned in units of energy
  */
@@ -1742,7 +2166,7 @@ init_numline(
     FLOAT8 *bval, FLOAT8 *bval_width, FLOAT8 *mld,
 
     FLOAT8 sfreq, int blksize, int *scalepos,
-    FLOAT8 deltafreq, int sbmax
+    FLOAT8 deltafreq, int sbmax, FLOAT8 delbark
     )
 {
     int partition[HBLKSIZE];
@@ -1752,12 +2176,12 @@ init_numline(
     sfreq /= blksize;
     j = 0;
     /* compute numlines, the number of spectral lines in each partition band */
-    /* each partition band should be about DELBARK wide. */
+    /* each partition band should be about delbark wide. */
     for (i=0;i<CBANDS;i++) {
 	FLOAT8 bark1;
 	int j2;
 	bark1 = freq2bark(sfreq*j);
-	for (j2 = j; freq2bark(sfreq*j2) - bark1 < DELBARK && j2 <= blksize/2;
+	for (j2 = j; freq2bark(sfreq*j2) - bark1 < delbark && j2 <= blksize/2;
 	     j2++)
 	    ;
 
@@ -1871,6 +2295,7 @@ int psymodel_init(lame_global_flags *gfp)
     FLOAT8 bval_width[CBANDS];
     FLOAT8 norm[CBANDS];
     FLOAT8 sfreq = gfp->out_samplerate;
+    FLOAT8 delbark_l = DELBARK;
 
     gfc->ms_ener_ratio_old=.25;
     gfc->blocktype_old[0] = gfc->blocktype_old[1] = NORM_TYPE; /* the vbr header is long blocks*/
@@ -1917,12 +2342,22 @@ int psymodel_init(lame_global_flags *gfp)
     /*************************************************************************
      * now compute the psychoacoustic model specific constants
      ************************************************************************/
+    /* the fast mode halves the number of long block partitions, which
+     * makes the spreading convolution about four times cheaper
+     */
+    gfc->mask_add_near = 3;
+    if (gfc->psymodel == 2 && gfp->psymodel == PSY_NSPSYTUNE) {
+	delbark_l = DELBARK_FAST;
+	gfc->mask_add_near = 1;
+    }
+
     /* compute numlines, bo, bm, bval, bval_width, mld */
     gfc->npart_l
 	= init_numline(gfc->numlines_l, gfc->bo_l, gfc->bm_l,
 		       bval, bval_width, gfc->mld_l,
 		       sfreq, BLKSIZE, 
-		       gfc->scalefac_band.l, BLKSIZE/(2.0*576), SBMAX_l);
+		       gfc->scalefac_band.l, BLKSIZE/(2.0*576), SBMAX_l,
+		       delbark_l);
     assert(gfc->npart_l <= CBANDS);
     /* compute the spreading function */
     for(i=0;i<gfc->npart_l;i++) {
@@ -1970,7 +2405,8 @@ int psymodel_init(lame_global_flags *gfp)
 	= init_numline(gfc->numlines_s, gfc->bo_s, gfc->bm_s,
 		       bval, bval_width, gfc->mld_s,
 		       sfreq, BLKSIZE_s,
-		       gfc->scalefac_band.s, BLKSIZE_s/(2.0*192), SBMAX_s);
+		       gfc->scalefac_band.s, BLKSIZE_s/(2.0*192), SBMAX_s,
+		       DELBARK);
     assert(gfc->npart_s <= CBANDS);
 
     /* SNR formula. short block is normalized by SNR. is it still right ? */
@@ -2041,5 +2477,31 @@ int psymodel_init(lame_global_flags *gfp)
 	}
     }
 
+    /* the same for L3psycho_anal_xr, which sees MDCT lines */
+    for (i = 0; i < 576; i++) {
+	gfc->eql_xr[i] = 0.0;
+	if (gfp->ATHtype != -1)
+	    gfc->eql_xr[i] = gfc->ATH->eql_w[i * (BLKSIZE/2) / 576]
+		* XR_TO_FFT_ENERGY * VO_SCALE * 576 / (BLKSIZE/2);
+    }
+    {
+	FLOAT8 bark_l[SBMAX_l], bark_s[SBMAX_s];
+	FLOAT8 self = s3_func(0.0);
+
+	/* centers of the scalefactor bands, line k is at (k+.5)*sfreq/1152 */
+	for (i = 0; i < SBMAX_l; i++)
+	    bark_l[i] = freq2bark(sfreq / (2.0*576) * 0.5
+		* (gfc->scalefac_band.l[i] + gfc->scalefac_band.l[i+1]));
+	for (i = 0; i < SBMAX_s; i++)
+	    bark_s[i] = freq2bark(sfreq / (2.0*192) * 0.5
+		* (gfc->scalefac_band.s[i] + gfc->scalefac_band.s[i+1]));
+	for (i = 0; i < SBMAX_l; i++)
+	    for (j = 0; j < SBMAX_l; j++)
+		gfc->s3_xr_l[i][j] = s3_func(bark_l[i] - bark_l[j]) / self;
+	for (i = 0; i < SBMAX_s; i++)
+	    for (j = 0; j < SBMAX_s; j++)
+		gfc->s3_xr_s[i][j] = s3_func(bark_s[i] - bark_s[j]) / self;
+    }
+
     return 0;
 }
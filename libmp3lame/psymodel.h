@@ -43,6 +43,13 @@ int L3psycho_anal_ns( lame_global_flags *gfc,
 		      int blocktype_d[2]); 
 
 
+int L3psycho_anal_xr( lame_global_flags *gfc, int gr,
+		      FLOAT *ms_ratio,
+		      III_psy_ratio ratio[2][2],
+		      III_psy_ratio MS_ratio[2][2],
+		      FLOAT pe[2], FLOAT pe_MS[2], FLOAT ener[4]);
+
+
 int psymodel_init(lame_global_flags *gfp);
 
 
@@ -53,6 +60,8 @@ int psymodel_init(lame_global_flags *gfp);
 
 /* size of each partition band, in barks: */
 #define DELBARK .34
+/* long block partitions used by the fast psymodel (gfc->psymodel == 2) */
+#define DELBARK_FAST (2*DELBARK)
 #define CW_LOWER_INDEX 6
 
 
@@ -73,6 +82,19 @@ int psymodel_init(lame_global_flags *gfp);
 /* tuned for output level (sensitive to energy scale) */
 #define VO_SCALE (1./( 14752*14752 )/(BLKSIZE/2))
 
+/* energy of the long FFT over the energy of the MDCT of a granule.  For
+ * white noise of power P (16 bit scale) the FFT bins add up to BLKSIZE/2
+ * times the power of the Blackman window of fft.c, BLKSIZE*BLACKMAN_POWER,
+ * times P.  The 576 lines of mdct_sub48() add up to 2*P/32768^2: the
+ * power gain of the filterbank is 1/288 per line, measured on 8000
+ * granules of white noise (0.1% spread over the 32 subbands) */
+#define BLACKMAN_POWER (0.42*0.42 + 0.5*0.5/2 + 0.08*0.08/2)
+#define XR_TO_FFT_ENERGY \
+    ((FLOAT8)BLKSIZE*BLKSIZE*BLACKMAN_POWER * 32768.*32768. / 4)
+/* masking offset of L3psycho_anal_xr, in dB below the spread energy,
+ * that of L3psycho_anal_ns() */
+#define XR_MASKING_OFFSET 8.0
+
 #define temporalmask_sustain_sec 0.01
 
 #define NS_PREECHO_ATT0 0.8
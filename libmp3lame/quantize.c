@@ -186,7 +186,7 @@ init_xrpow(
     /*  check if there is some energy we have to quantize
      *  and calculate xrpow matching our fresh scalefactors
      */
-    for (i = 0; i < 576; ++i) {
+    for (i = 0; i <= cod_info->max_nonzero_coeff; ++i) {
         tmp = fabs (cod_info->xr[i]);
         sum += tmp;
         xrpow[i] = sqrt (tmp * sqrt(tmp));
@@ -194,6 +194,7 @@ init_xrpow(
         if (xrpow[i] > cod_info->xrpow_max)
             cod_info->xrpow_max = xrpow[i];
     }
+    memset(&xrpow[i], 0, (576-i)*sizeof(FLOAT8));
     /*  return 1 if we have something to quantize, else 0
      */
     if (sum > (FLOAT8)1E-20) {
@@ -207,7 +208,7 @@ init_xrpow(
         return 1;
     }
 
-    memset(&cod_info->l3_enc, 0, sizeof(int)*576);
+    memset(cod_info->l3_enc, 0, sizeof(int)*576);
     return 0;
 }
 
@@ -399,7 +400,20 @@ init_outer_loop(
     cod_info->slen[2]             = 0;
     cod_info->slen[3]             = 0;
     
+    /*  lines above the polyphase lowpass are zero, see mdct_sub48()
+     */
     cod_info->max_nonzero_coeff = 575;
+    if (gfc->sblimit < SBLIMIT) {
+	int upper = 18*gfc->sblimit + 7; /* the alias butterfly leaks 8 lines */
+	if (cod_info->block_type == SHORT_TYPE) {
+	    /* short lines 6*sblimit and up, in re-ordered layout */
+	    for (sfb = 0; gfc->scalefac_band.s[sfb+1] < 6*gfc->sblimit; sfb++)
+		;
+	    j = 3*gfc->scalefac_band.s[sfb+1] - 1;
+	    upper = cod_info->mixed_block_flag ? Max(j, upper) : j;
+	}
+	cod_info->max_nonzero_coeff = upper;
+    }
 
     /*  fresh scalefactors are all zero
      */
@@ -1093,6 +1107,8 @@ outer_loop (
 {
     lame_internal_flags *gfc=gfp->internal_flags;
     gr_info cod_info_w;
+    int l3_enc_w[576];
+    int * const l3_enc = cod_info->l3_enc;
     FLOAT8 save_xrpow[576];
     FLOAT8 distort[SFBMAX];
     calc_noise_result best_noise_info;
@@ -1101,6 +1117,7 @@ outer_loop (
     int over;
     int age;
     calc_noise_data prev_noise;
+    int first;
 
     bin_search_StepSize (gfc, cod_info, targ_bits, ch, xrpow);
 
@@ -1115,6 +1132,8 @@ outer_loop (
     /* coefficients and thresholds both l/r (or both mid/side) */
     over = calc_noise (gfc, cod_info, l3_xmin, distort, &best_noise_info, &prev_noise);
     cod_info_w = *cod_info;
+    cod_info_w.l3_enc = l3_enc_w;
+    first = 1;
     age = 0;
     if (gfp->VBR == vbr_rh || gfp->VBR == vbr_mtrh)
 	memcpy(save_xrpow, xrpow, sizeof(FLOAT8)*576);
@@ -1160,6 +1179,19 @@ outer_loop (
         if (huff_bits <= 0)
             break;
 
+	/*  count_bits() only requantizes the bands whose step changed, so
+	 *  l3_enc_w has to hold the last quantization.  A best one found
+	 *  there is moved out of its way now, not when it was found
+	 */
+	if (first) {
+	    memcpy(l3_enc_w, l3_enc, sizeof(int)*576);
+	    first = 0;
+	}
+	else if (cod_info->l3_enc != l3_enc) {
+	    memcpy(l3_enc, l3_enc_w, sizeof(int)*576);
+	    cod_info->l3_enc = l3_enc;
+	}
+
 	/*  increase quantizer stepsize until needed bits are below maximum
 	 */
 	while ((cod_info_w.part2_3_length
@@ -1213,8 +1245,12 @@ outer_loop (
     while (cod_info_w.global_gain < 255u);
 
     assert (cod_info->global_gain < 256);
-    /*  finish up
+    /*  finish up, the best quantization goes back into the side info
      */
+    if (cod_info->l3_enc != l3_enc) {
+	memcpy(l3_enc, l3_enc_w, sizeof(int)*576);
+	cod_info->l3_enc = l3_enc;
+    }
     if (gfp->VBR == vbr_rh || gfp->VBR == vbr_mtrh)
 	/* restore for reuse on next try */
 	memcpy(xrpow, save_xrpow, sizeof(FLOAT8)*576);
@@ -1285,6 +1321,8 @@ VBR_encode_granule (
     lame_internal_flags *gfc=gfp->internal_flags;
     gr_info         bst_cod_info;
     FLOAT8          bst_xrpow [576]; 
+    int             bst_l3_enc [576];
+    int     * const l3_enc = cod_info->l3_enc;
     int Max_bits  = max_bits;
     int real_bits = max_bits+1;
     int this_bits = (max_bits+min_bits)/2;
@@ -1293,6 +1331,8 @@ VBR_encode_granule (
 
     assert(Max_bits <= MAX_BITS);
 
+    bst_cod_info.l3_enc = bst_l3_enc;
+
     /*  search within round about 40 bits of optimal
      */
     do {
@@ -1317,9 +1357,14 @@ VBR_encode_granule (
              */
             real_bits = cod_info->part2_3_length;
 
-            /*  store best quantization so far
+            /*  store best quantization so far, swapping the l3_enc
+             *  buffers: outer_loop does not need the old values
              */
-            bst_cod_info = *cod_info;
+            {
+                int *work = bst_cod_info.l3_enc;
+                bst_cod_info = *cod_info;
+                cod_info->l3_enc = work;
+            }
             memcpy(bst_xrpow, xrpow, sizeof(FLOAT8)*576);
 
             /*  try with fewer bits
@@ -1336,10 +1381,12 @@ VBR_encode_granule (
             this_bits = (max_bits+min_bits)/2;
             
             if (found) {
+                int *work = cod_info->l3_enc;
                 found = 2;
                 /*  start again with best quantization so far
                  */
                 *cod_info = bst_cod_info;
+                cod_info->l3_enc = work;
                 memcpy(xrpow, bst_xrpow, sizeof(FLOAT8)*576);
             }
         }
@@ -1350,9 +1397,14 @@ VBR_encode_granule (
     /*  found=0 => nothing found, use last one
      *  found=1 => we just found the best and left the loop
      *  found=2 => we restored a good one and have now l3_enc to restore too
+     *  when found, l3_enc of the best one is in the buffer bst_cod_info
+     *  took over, it goes back into the side info's l3_enc
      */
-    if (found==2) {
-        memcpy(cod_info->l3_enc, bst_cod_info.l3_enc, sizeof(int)*576);
+    if (found)
+        cod_info->l3_enc = bst_cod_info.l3_enc;
+    if (cod_info->l3_enc != l3_enc) {
+        memcpy(l3_enc, cod_info->l3_enc, sizeof(int)*576);
+        cod_info->l3_enc = l3_enc;
     }
     assert(cod_info->part2_3_length <= Max_bits);
 
@@ -278,6 +278,12 @@ static void compute_ath( lame_global_flags *gfp )
         }
     }
     
+    gfc->ATH->lowest = FLOAT_MAX;
+    for (sfb = 0; sfb < SBMAX_l; sfb++)
+        gfc->ATH->lowest = Min( gfc->ATH->lowest, ATH_l[sfb] );
+    for (sfb = 0; sfb < SBMAX_s; sfb++)
+        gfc->ATH->lowest = Min( gfc->ATH->lowest, ATH_s[sfb] );
+
     /*  work in progress, don't rely on it too much
      */
     gfc->ATH-> floor = 10. * log10( ATHmdct( gfp, -1. ) );
@@ -301,12 +307,17 @@ iteration_init( lame_global_flags *gfp)
 {
   lame_internal_flags *gfc=gfp->internal_flags;
   III_side_info_t * const l3_side = &gfc->l3_side;
-  int i;
+  int i, gr, ch;
 
   if ( gfc->iteration_init_init==0 ) {
     gfc->iteration_init_init=1;
 
     l3_side->main_data_begin = 0;
+    for (gr = 0; gr < 2; gr++)
+      for (ch = 0; ch < 2; ch++) {
+        l3_side->tt[gr][ch].xr = l3_side->xr[gr][ch];
+        l3_side->tt[gr][ch].l3_enc = l3_side->l3_enc[gr][ch];
+      }
     compute_ath(gfp);
 
     pow43[0] = 0.0;
@@ -530,7 +541,7 @@ FLOAT athAdjust( FLOAT a, FLOAT x, FLOAT athFloor )
     u *= w; 
     u += athFloor + o-p;                            /* redo scaling */
 
-    return pow( 10., 0.1*u );
+    return FAST_POW10( 0.1*u );
 }
 
 
@@ -591,9 +602,10 @@ int calc_xmin(
 
 
     /*use this function to determine the highest non-zero coeff*/
-    max_nonzero = 575;
+    /*init_outer_loop has already bounded it by the lowpass*/
+    k = cod_info->max_nonzero_coeff + 1;
+    max_nonzero = Min(k, 575);
     if (cod_info->block_type == NORM_TYPE) {
-        k = 576;
         while (k-- && !xr[k]){
             max_nonzero = k;
         }
@@ -26,6 +26,7 @@
 #endif
 
 #include <assert.h>
+#include <math.h>
 #include "bitstream.h"
 #include "reservoir.h"
 
@@ -33,6 +34,59 @@
 #include <dmalloc.h>
 #endif
 
+/* a decoder starting at a frame needs one granule of MDCT overlap plus
+   the synthesis filterbank, 1088 samples, before its output is clean.
+   Less the decoder delay of 529, that is the margin in input samples */
+#define SEGMENT_MARGIN  (1088 - 529)
+
+/* first frame of segment s, see lame_set_segment_interval(): the last one
+   a decoder can start with and be clean at sample s * interval */
+static double
+segment_frame(const lame_global_flags *gfp, double s)
+{
+    double  x = s * gfp->segment_interval + gfp->encoder_delay - SEGMENT_MARGIN;
+
+    if (s <= 0 || x < 0)
+        return 0;
+    return floor(x / gfp->framesize);
+}
+
+/* does the next frame start a segment? then this one drains the reservoir */
+static int
+segment_drain(const lame_global_flags *gfp)
+{
+    double  next = gfp->frameNum + 1.0, s;
+
+    if (gfp->segment_interval <= 0)
+        return 0;
+    /* the first segment that starts at the next frame or later */
+    s = ceil((next * gfp->framesize - gfp->encoder_delay + SEGMENT_MARGIN)
+             / gfp->segment_interval);
+    if (s < 1)
+        s = 1;
+    return segment_frame(gfp, s) == next;
+}
+
+int
+lame_get_segment_start(const lame_global_flags *gfp, int s,
+                       unsigned long *frame, int *priming)
+{
+    double  k;
+
+    if (gfp->segment_interval <= 0 || s < 0)
+        return -1;
+    k = segment_frame(gfp, s);
+    if (k >= gfp->frameNum)
+        return -1;
+    if (frame != NULL)
+        *frame = (unsigned long) k;
+    if (priming != NULL)
+        *priming = (int) ((double) s * gfp->segment_interval
+                          + gfp->encoder_delay - k * gfp->framesize);
+    return 0;
+}
+
+
 /*
   ResvFrameBegin:
   Called (repeatedly) at the beginning of a frame. Updates the maximum
@@ -114,6 +168,9 @@ ResvFrameBegin(lame_global_flags *gfp, int *mean_bits)
  *
  *      gfc->ResvSize:  current reservoir size
  *
+ *      gfc->ResvDrain: the next frame starts a segment, so nothing may
+ *                      be left in the reservoir after this one
+ *
  *      l3_side->resvDrain_pre:
  *         ancillary data to be added to previous frame:
  *         (only usefull in VBR modes if it is possible to have
@@ -159,6 +216,8 @@ ResvFrameBegin(lame_global_flags *gfp, int *mean_bits)
     assert ( 0 == gfc->ResvMax % 8 );
     assert ( gfc->ResvMax >= 0 );
 
+    gfc->ResvDrain = segment_drain(gfp);
+
     l3_side->resvDrain_pre = 0;
 #ifdef HAVE_GTK
     if (gfc->pinfo != NULL) {
@@ -204,7 +263,8 @@ void ResvMaxBits(lame_global_flags *gfp, int mean_bits, int *targ_bits, int *ext
      * than FhG.  It could simple be mean_bits/15, but this was rigged
      * to always produce 100 (the old value) at 128kbs */
     /*    *targ_bits -= (int) (mean_bits/15.2);*/
-    if (!gfp->disable_reservoir && !(gfc->substep_shaping & 1))
+    if (!gfp->disable_reservoir && !(gfc->substep_shaping & 1)
+        && !gfc->ResvDrain)
       *targ_bits -= .1*mean_bits;
   }
 
@@ -212,6 +272,9 @@ void ResvMaxBits(lame_global_flags *gfp, int mean_bits, int *targ_bits, int *ext
   /* amount from the reservoir we are allowed to use. ISO says 6/10 */
   *extra_bits =
     (ResvSize  < (gfc->ResvMax*6)/10  ? ResvSize : (gfc->ResvMax*6)/10);
+  /* the reservoir is emptied at the end of the frame anyway */
+  if (gfc->ResvDrain)
+    *extra_bits = ResvSize;
   *extra_bits -= add_bits;
 
   if (*extra_bits < 0) *extra_bits=0;
@@ -255,7 +318,8 @@ ResvFrameEnd(lame_internal_flags *gfc, int mean_bits)
 	stuffingBits += over_bits;
 
 
-    over_bits = (gfc->ResvSize - stuffingBits) - gfc->ResvMax;
+    over_bits = (gfc->ResvSize - stuffingBits)
+        - (gfc->ResvDrain ? 0 : gfc->ResvMax);
     if (over_bits > 0) {
       assert ( 0 == over_bits % 8 );
       assert ( over_bits >= 0 );
@@ -245,6 +245,76 @@ lame_get_bWriteVbrTag( const lame_global_flags*  gfp )
 }
 
 
+/* sidecar seek index, an entry every n frames */
+int
+lame_set_seek_index_interval( lame_global_flags*  gfp,
+                              int n )
+{
+    /* default = 0 (no index) */
+
+    if ( 0 > n || 0xFFFF < n )
+        return -1;
+
+    gfp->seek_index_interval = n;
+
+    return 0;
+}
+
+int
+lame_get_seek_index_interval( const lame_global_flags*  gfp )
+{
+    return gfp->seek_index_interval;
+}
+
+
+/* per frame descriptors for muxers */
+int
+lame_set_frame_info( lame_global_flags*  gfp,
+                     int                 frame_info )
+{
+    /* default = 0 (off) */
+
+    /* enforce disable/enable meaning, if we need more than two values
+       we need to switch to an enum to have an apropriate representation
+       of the possible meanings of the value */
+    if ( 0 > frame_info || 1 < frame_info )
+        return -1;
+
+    gfp->frame_info = frame_info;
+
+    return 0;
+}
+
+int
+lame_get_frame_info( const lame_global_flags*  gfp )
+{
+    assert( 0 <= gfp->frame_info && 1 >= gfp->frame_info );
+
+    return gfp->frame_info;
+}
+
+
+/* empty the bit reservoir every n samples, for segmenters */
+int
+lame_set_segment_interval( lame_global_flags*  gfp,
+                           int                 n )
+{
+    /* default = 0 (off) */
+
+    if ( 0 > n )
+        return -1;
+
+    gfp->segment_interval = n;
+
+    return 0;
+}
+
+int
+lame_get_segment_interval( const lame_global_flags*  gfp )
+{
+    return gfp->segment_interval;
+}
+
 
 /* decode only, use lame/mpglib to convert mp3 to wav */
 int
@@ -562,6 +632,18 @@ lame_set_msgf( lame_global_flags*  gfp,
     return 0;
 }
 
+/* mp3 data handed out without copying it to mp3buf */
+int
+lame_set_output_callback( lame_global_flags*    gfp,
+                          lame_output_callback  func,
+                          void*                 user )
+{
+    gfp->output.func = func;
+    gfp->output.user = user;
+
+    return 0;
+}
+
 
 /*
  * Set one of
@@ -1703,6 +1785,19 @@ lame_get_encoder_padding( const lame_global_flags*  gfp )
     return gfp->encoder_padding;
 }
 
+/* delay and padding of a transcoded source, 12 bits each in the LAME tag */
+int
+lame_set_encoder_delay_padding( lame_global_flags*  gfp,
+                                int                 delay,
+                                int                 padding )
+{
+    if (delay < 0 || delay > 4095 || padding < 0 || padding > 4095)
+        return -1;
+    gfp->encoder_delay = delay;
+    gfp->encoder_padding = padding;
+    return 0;
+}
+
 
 /* Size of MPEG frame. */
 int
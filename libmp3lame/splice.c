@@ -0,0 +1,1034 @@
+/*
+ *	Cutting and splicing of Layer III files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * lame_splice() builds the output on the frame grid of the pieces: frame
+ * j of the output is frame j + shift of the file of the piece which owns
+ * it.  Positions p below are on the timeline of the output frames, frame
+ * j starts at p = j * framesize, and output sample u is decoded at
+ * p = delay + 529 + u.  The first piece owns everything before its end,
+ * the last one everything after its start, so the frames at both ends
+ * continue their files.
+ *
+ * A frame is copied if the MDCT overlap and the synthesis filter of its
+ * granules, SPLICE_MARGIN samples on either side, see only one piece,
+ * and if all of its main data is in its file.  The other frames, a few
+ * around each cut, form bursts.  A burst is encoded again from the PCM
+ * the output should decode to, by an encoder of its own without bit
+ * reservoir, which starts SPLICE_PRIMING samples early.  Then the main
+ * data of all frames is packed into the slots of the output, each as
+ * early as main_data_begin allows; a frame whose main data does not fit
+ * gets a higher bitrate, or one of the frames before it does.
+ *
+ * The window of the last granule before a burst and of the first one
+ * after it must fit those of the encoded frames: short and start/stop
+ * blocks next to long ones do not cancel their aliasing.  The burst
+ * grows over such frames, and again if the encoder chose otherwise.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef HAVE_MPGLIB
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "util.h"
+#include "bitstream.h"
+#include "VbrTag.h"
+#include "id3tag.h"
+#include "lame.h"
+
+#ifdef WITH_DMALLOC
+#include <dmalloc.h>
+#endif
+
+
+/* samples a copied frame keeps away from a cut: the MDCT overlap of one
+   granule plus the synthesis filterbank */
+#define SPLICE_MARGIN      1088
+
+/* decoder delay, 528 + 1 */
+#define SPLICE_DECDELAY    529
+
+/* the output starts at least one granule before the first sample */
+#define SPLICE_MIN_DELAY   576
+
+/* samples a burst encoder gets before its first frame */
+#define SPLICE_PRIMING     2304
+
+/* rounds of growing bursts to match the block types around them */
+#define SPLICE_MAX_GROW    8
+
+/* bytes mpglib looks at for a Xing tag after a reset */
+#define SPLICE_MIN_PREROLL 194
+
+/* bytes fed to a decoder at a time */
+#define SPLICE_FEED_BYTES  4096
+
+#define SPLICE_MAX_FRAME   2880
+
+
+/* a frame of a file or of the output of a burst encoder */
+typedef struct {
+    unsigned long pos;          /* of the header */
+    unsigned long data;         /* of the slot, in the main data of the stream */
+    int     size;               /* bytes */
+    int     side;               /* header, CRC and side info bytes */
+    int     mdb;                /* main_data_begin */
+    int     len;                /* main data bytes */
+    int     copyable;           /* all of its main data is in the stream */
+    unsigned char first[2];     /* block type of the first granule, */
+    unsigned char last[2];      /* and of the last one, per channel */
+} splice_frame;
+
+typedef struct {
+    const unsigned char *buf;
+    splice_frame *fr;
+    long    frames;
+    int     delay;              /* encoder delay */
+    unsigned long length;       /* samples */
+} splice_stream;
+
+typedef struct {
+    splice_stream *s;
+    long    shift;              /* output frame j is frame j + shift of s */
+    unsigned long begin, end;   /* samples of s */
+    unsigned long out_end;      /* end in output samples */
+} splice_piece;
+
+typedef struct {
+    long    f0, f1;             /* output frames [f0,f1) */
+    long    first;              /* frame of st which is output frame f0 */
+    int     used;
+    unsigned char *mp3;
+    splice_stream st;
+} splice_burst;
+
+/* a frame of the output */
+typedef struct {
+    const splice_stream *s;     /* where it comes from */
+    long    i;                  /* frame of s */
+    int     burst;              /* encoded again */
+    int     opt, min_opt;       /* 2 * bitrate index + padding bit */
+    int     slot;               /* main data bytes */
+    unsigned long data;         /* of the slot */
+    unsigned long start;        /* of its main data */
+} splice_out;
+
+typedef struct {
+    int     version;            /* 0 = MPEG-2, 1 = MPEG-1, 2 = MPEG-2.5 */
+    int     samplerate;
+    int     channels;
+    int     mode;
+    int     framesize;
+    int     protection;         /* CRC */
+    int     maxmdb;
+    int     bitrate_index;      /* of the first frame */
+    int     quality;
+
+    splice_stream *streams;
+    int     nstreams;
+    splice_piece *piece;
+    int     npieces;
+
+    long    delay;              /* encoder delay of the output */
+    long    padding;
+    long    frames;
+    splice_out *out;
+    splice_burst *burst;
+    int     nbursts;
+} splice_ctx;
+
+
+
+static long
+floor_div(long a, long b)
+{
+    return a >= 0 ? a / b : -((b - 1 - a) / b);
+}
+
+static unsigned int
+get_bits(const unsigned char *p, int *bit, int n)
+{
+    unsigned int v = 0;
+
+    while (n-- > 0) {
+        v = (v << 1) | ((p[*bit >> 3] >> (7 - (*bit & 7))) & 1);
+        (*bit)++;
+    }
+    return v;
+}
+
+/* main data size and block types, from the side info */
+static void
+parse_side_info(const unsigned char *buf, splice_frame * f, int lsf, int channels)
+{
+    const unsigned char *si = buf + (buf[1] & 1 ? 4 : 6);
+    int     bit, gr, ch, bt, bits = 0;
+
+    if (lsf)
+        bit = 8 + (channels == 1 ? 1 : 2);
+    else
+        bit = 9 + (channels == 1 ? 5 : 3) + 4 * channels;
+    for (gr = 0; gr < (lsf ? 1 : 2); gr++) {
+        for (ch = 0; ch < channels; ch++) {
+            bits += get_bits(si, &bit, 12);
+            bit += 9 + 8 + (lsf ? 9 : 4);
+            if (get_bits(si, &bit, 1)) {
+                bt = get_bits(si, &bit, 2);
+                bit += 20;
+            }
+            else {
+                bt = 0;
+                bit += 22;
+            }
+            bit += lsf ? 2 : 3;
+            if (gr == 0)
+                f->first[ch] = bt;
+            f->last[ch] = bt;
+        }
+    }
+    f->len = (bits + 7) / 8;
+}
+
+/* the frames of buf[first,end) */
+static int
+parse_frames(splice_stream * s, const unsigned char *buf, size_t first,
+             size_t end, int lsf, int channels)
+{
+    splice_frame *f;
+    size_t  p;
+    unsigned long data = 0;
+    long    size = 0;
+    int     bytes, samples, mdb, side;
+
+    s->buf = buf;
+    s->fr = NULL;
+    s->frames = 0;
+    for (p = first; p + 8 <= end; p += bytes) {
+        bytes = lame_decode_frame_info(buf + p, &samples, &mdb, &side);
+        if (bytes <= 0 || p + bytes > end)
+            break;
+        if (s->frames == size) {
+            size = size ? 2 * size : 1024;
+            if ((f = realloc(s->fr, size * sizeof(*f))) == NULL)
+                return -2;
+            s->fr = f;
+        }
+        f = &s->fr[s->frames++];
+        f->pos = p;
+        f->data = data;
+        f->size = bytes;
+        f->side = side;
+        f->mdb = mdb;
+        parse_side_info(buf + p, f, lsf, channels);
+        f->copyable = (unsigned long) mdb <= data && f->len <= mdb + bytes - side;
+        data += bytes - side;
+    }
+    return 0;
+}
+
+/* a file of one of the pieces */
+static int
+open_stream(splice_ctx * ctx, splice_stream * s, const unsigned char *mp3, size_t size)
+{
+    unsigned char xing[SPLICE_MIN_PREROLL];
+    mp3scan_struct scan;
+    VBRTAGDATA tag;
+    size_t  pos = 0, p = 0, end = size;
+    int     ret, bytes, samples, mdb, side, n;
+    unsigned long frames;
+
+    while ((ret = lame_decode_scan(mp3, size, &pos, &scan)) != LAME_SCAN_END)
+        if (ret != LAME_SCAN_TRUNCATED)
+            return -1;
+    if (scan.frames == 0 || scan.layer != 3)
+        return -1;
+    if (ctx->nstreams == 0) {
+        ctx->version = scan.version;
+        ctx->samplerate = scan.samplerate;
+        ctx->channels = scan.stereo;
+        ctx->framesize = scan.framesize;
+        ctx->mode = (scan.header >> 6) & 3;
+        ctx->protection = !(scan.header & 0x10000);
+        ctx->maxmdb = scan.version == 1 ? 511 : 255;
+    }
+    else if (scan.samplerate != ctx->samplerate || scan.stereo != ctx->channels)
+        return -5;
+
+    /* where lame_decode_scan() has found the frames */
+    if (size >= 128 && mp3[size - 128] == 'T' && mp3[size - 127] == 'A'
+        && mp3[size - 126] == 'G')
+        end = size - 128;
+    if (end >= 10 && mp3[0] == 'I' && mp3[1] == 'D' && mp3[2] == '3')
+        p = 10 + ((mp3[6] & 127) << 21 | (mp3[7] & 127) << 14
+                  | (mp3[8] & 127) << 7 | (mp3[9] & 127));
+    if (p + 8 > end || (bytes = lame_decode_frame_info(mp3 + p, &samples, &mdb, &side)) <= 0)
+        return -1;
+    n = bytes < SPLICE_MIN_PREROLL ? bytes : SPLICE_MIN_PREROLL;
+    memset(xing, 0, sizeof(xing));
+    memcpy(xing, mp3 + p, n);
+    if (GetVbrTag(&tag, xing))
+        p += bytes;
+
+    ret = parse_frames(s, mp3, p, end, scan.version != 1, scan.stereo);
+    if (ret < 0)
+        return ret;
+    if ((unsigned long) s->frames != scan.frames)
+        return -1;
+    if (ctx->nstreams == 0)
+        ctx->bitrate_index = mp3[s->fr[0].pos + 2] >> 4;
+
+    frames = scan.frames * scan.framesize;
+    if (scan.enc_delay >= 0 && scan.enc_padding >= 0) {
+        s->delay = scan.enc_delay;
+        s->length = scan.nsamp;
+    }
+    else {
+        /* what LAME does, and the decoder delay left as padding */
+        s->delay = 576;
+        s->length = frames > 576 + SPLICE_DECDELAY ? frames - 576 - SPLICE_DECDELAY : 0;
+    }
+    return 0;
+}
+
+
+
+/*
+ * the timeline
+ */
+
+/* the piece owning position p of the output */
+static int
+owner(const splice_ctx * ctx, long p)
+{
+    long    u = p - ctx->delay - SPLICE_DECDELAY;
+    int     k;
+
+    for (k = 0; k < ctx->npieces - 1; k++)
+        if (u < (long) ctx->piece[k].out_end)
+            break;
+    return k;
+}
+
+/* puts every piece on the frame grid of the output.  the first one
+   fixes the grid and the delay, the others move the end of the piece
+   before them by up to half a frame to fit in */
+static void
+make_timeline(splice_ctx * ctx)
+{
+    splice_piece *pc = ctx->piece, *prev;
+    long    N = ctx->framesize, u, r, e;
+    int     k;
+
+    pc[0].shift = floor_div((long) pc[0].begin + pc[0].s->delay - SPLICE_MIN_DELAY, N);
+    ctx->delay = pc[0].begin + pc[0].s->delay - pc[0].shift * N;
+    u = pc[0].end - pc[0].begin;
+    pc[0].out_end = u;
+    for (k = 1; k < ctx->npieces; k++) {
+        prev = &pc[k - 1];
+        r = ((long) pc[k].begin + pc[k].s->delay - ctx->delay - u) % N;
+        if (r < 0)
+            r += N;
+        if (r > N / 2)
+            r -= N;
+        e = (long) prev->end + r;
+        if (e > (long) prev->s->length && e - N > (long) prev->begin)
+            e -= N;
+        else if (e <= (long) prev->begin)
+            e += N;
+        u += e - (long) prev->end;
+        prev->end = e;
+        prev->out_end = u;
+        pc[k].shift = ((long) pc[k].begin + pc[k].s->delay - ctx->delay - u) / N;
+        u += pc[k].end - pc[k].begin;
+        pc[k].out_end = u;
+    }
+    ctx->frames = (ctx->delay + u + SPLICE_DECDELAY + N - 1) / N;
+    ctx->padding = ctx->frames * N - ctx->delay - u;
+}
+
+/* can output frame j be a frame of a file */
+static int
+is_verbatim(const splice_ctx * ctx, long j)
+{
+    long    N = ctx->framesize, i;
+    int     k0, k1, k;
+    const splice_piece *pc = ctx->piece;
+
+    k0 = owner(ctx, j * N - SPLICE_MARGIN);
+    k1 = owner(ctx, (j + 1) * N + SPLICE_MARGIN - 1);
+    for (k = k0 + 1; k <= k1; k++)
+        if (pc[k].s != pc[k0].s || pc[k].shift != pc[k0].shift)
+            return 0;
+    i = j + pc[k0].shift;
+    return i >= 0 && i < pc[k0].s->frames && pc[k0].s->fr[i].copyable;
+}
+
+/* the right half of the window of the last granule is short: start
+   and short blocks */
+static int
+right_short(const splice_frame * f, int ch)
+{
+    return f->last[ch] == 1 || f->last[ch] == 2;
+}
+
+/* the left half of the window of the first granule is short: short
+   and stop blocks */
+static int
+left_short(const splice_frame * f, int ch)
+{
+    return f->first[ch] == 2 || f->first[ch] == 3;
+}
+
+/* does the last granule of a overlap the first one of b */
+static int
+windows_match(const splice_frame * a, const splice_frame * b, int channels)
+{
+    int     ch;
+
+    for (ch = 0; ch < channels; ch++)
+        if (right_short(a, ch) != left_short(b, ch))
+            return 0;
+    return 1;
+}
+
+/* a frame next to a burst, on its left or right, with a short window
+   towards it */
+static int
+short_towards(const splice_frame * f, int left, int channels)
+{
+    int     ch;
+
+    for (ch = 0; ch < channels; ch++)
+        if (left ? right_short(f, ch) : left_short(f, ch))
+            return 1;
+    return 0;
+}
+
+static const splice_frame *
+out_frame(const splice_ctx * ctx, long j)
+{
+    return &ctx->out[j].s->fr[ctx->out[j].i];
+}
+
+
+
+/*
+ * the bursts
+ */
+
+/* the frame of s holding main data byte x */
+static long
+frame_of(const splice_stream * s, unsigned long x)
+{
+    long    lo = 0, hi = s->frames - 1, m;
+
+    while (lo < hi) {
+        m = (lo + hi + 1) / 2;
+        if (s->fr[m].data <= x)
+            lo = m;
+        else
+            hi = m - 1;
+    }
+    return lo;
+}
+
+/* decodes frames [lo,hi) of s, silence where s has none.  as in
+   decode_threads.c: decoding starts one granule early at g, after the
+   frames from p with the main data of g and later frames were fed
+   through lame_decoder_preroll() */
+static int
+decode_frames(const splice_ctx * ctx, const splice_stream * s, long lo, long hi,
+              short *pcm[2])
+{
+    lame_decoder_t *dec;
+    mp3data_struct mp3data;
+    short   pcm_l[1152], pcm_r[1152];
+    const splice_frame *fr = s->fr;
+    long    N = ctx->framesize, a, b, g, p, j, m, n, need;
+    size_t  pos, end, k;
+    int     ch, ret, drop;
+
+    for (ch = 0; ch < ctx->channels; ch++)
+        memset(pcm[ch], 0, (hi - lo) * N * sizeof(short));
+    a = lo > 0 ? lo : 0;
+    b = hi < s->frames ? hi : s->frames;
+    if (a >= b)
+        return 0;
+
+    g = a - 1152 / N;
+    if (g < 0)
+        g = 0;
+    drop = a - g;
+    m = (long) fr[g].data - fr[g].mdb;
+    for (j = g + 1; j < s->frames && (long) fr[j].data - ctx->maxmdb < m; j++)
+        if ((long) fr[j].data - fr[j].mdb < m)
+            m = (long) fr[j].data - fr[j].mdb;
+    p = m > 0 ? frame_of(s, m) : 0;
+    while (p > 0 && fr[g].pos - fr[p].pos < SPLICE_MIN_PREROLL)
+        p--;
+
+    if ((dec = lame_decoder_new()) == NULL)
+        return -2;
+    memset(&mp3data, 0, sizeof(mp3data));
+    if (p < g && lame_decoder_preroll(dec, (unsigned char *) s->buf + fr[p].pos,
+                                      fr[g].pos - fr[p].pos) < 0) {
+        lame_decoder_free(dec);
+        return -1;
+    }
+    pos = fr[g].pos;
+    end = b < s->frames ? fr[b].pos + fr[b].size : fr[b - 1].pos + fr[b - 1].size;
+    n = (a - lo) * N;
+    need = (b - lo) * N;
+    while (n < need) {
+        ret = lame_decoder_decode1_headers(dec, NULL, 0, pcm_l, pcm_r, &mp3data);
+        if (ret == 0) {
+            if (pos == end)
+                break;
+            k = end - pos < SPLICE_FEED_BYTES ? end - pos : SPLICE_FEED_BYTES;
+            ret = lame_decoder_decode1_headers(dec, (unsigned char *) s->buf + pos,
+                                               (int) k, pcm_l, pcm_r, &mp3data);
+            pos += k;
+        }
+        if (ret < 0)
+            break;
+        if (ret == 0 || drop-- > 0)
+            continue;
+        if (ret > need - n)
+            ret = need - n;
+        memcpy(pcm[0] + n, pcm_l, ret * sizeof(short));
+        if (ctx->channels == 2)
+            memcpy(pcm[1] + n, pcm_r, ret * sizeof(short));
+        n += ret;
+    }
+    lame_decoder_free(dec);
+    return n < need ? -1 : 0;
+}
+
+/* the PCM of output positions [p0,p0+n) */
+static int
+make_pcm(const splice_ctx * ctx, long p0, long n, short *pcm[2])
+{
+    const splice_piece *pc;
+    short  *dec[2] = { NULL, NULL };
+    long    N = ctx->framesize, p, q, x, lo, hi, size = 0;
+    int     k, ch, ret = 0;
+
+    for (p = p0; p < p0 + n && ret == 0; p = q) {
+        k = owner(ctx, p);
+        pc = &ctx->piece[k];
+        q = p0 + n;
+        if (k < ctx->npieces - 1
+            && q > ctx->delay + SPLICE_DECDELAY + (long) pc->out_end)
+            q = ctx->delay + SPLICE_DECDELAY + pc->out_end;
+
+        x = p + pc->shift * N;
+        lo = floor_div(x, N);
+        hi = floor_div(q + pc->shift * N + N - 1, N);
+        if ((hi - lo) * N > size) {
+            size = (hi - lo) * N;
+            for (ch = 0; ch < ctx->channels; ch++) {
+                free(dec[ch]);
+                if ((dec[ch] = malloc(size * sizeof(short))) == NULL)
+                    ret = -2;
+            }
+            if (ret < 0)
+                break;
+        }
+        ret = decode_frames(ctx, pc->s, lo, hi, dec);
+        for (ch = 0; ch < ctx->channels; ch++)
+            memcpy(pcm[ch] + (p - p0), dec[ch] + (x - lo * N),
+                   (q - p) * sizeof(short));
+    }
+    for (ch = 0; ch < ctx->channels; ch++)
+        free(dec[ch]);
+    return ret;
+}
+
+/* encodes output frames [b->f0,b->f1) again */
+static int
+encode_burst(const splice_ctx * ctx, splice_burst * b)
+{
+    lame_global_flags *gfe;
+    short  *pcm[2] = { NULL, NULL };
+    long    N = ctx->framesize, j, i, p0, n, prime;
+    int     bi = 0, k, ch, size, ret = -2, imp3;
+
+    /* the highest bitrate of the frames it replaces */
+    for (j = b->f0; j < b->f1; j++) {
+        k = owner(ctx, j * N + N / 2);
+        i = j + ctx->piece[k].shift;
+        if (i >= 0 && i < ctx->piece[k].s->frames) {
+            const splice_stream *s = ctx->piece[k].s;
+            if (s->buf[s->fr[i].pos + 2] >> 4 > bi)
+                bi = s->buf[s->fr[i].pos + 2] >> 4;
+        }
+    }
+    if (bi == 0)
+        bi = ctx->bitrate_index;
+
+    if ((gfe = lame_init()) == NULL)
+        return -2;
+    lame_set_in_samplerate(gfe, ctx->samplerate);
+    lame_set_out_samplerate(gfe, ctx->samplerate);
+    lame_set_num_channels(gfe, ctx->channels);
+    lame_set_mode(gfe, ctx->channels == 1 ? MONO : JOINT_STEREO);
+    lame_set_brate(gfe, bitrate_table[ctx->version][bi]);
+    lame_set_disable_reservoir(gfe, 1);
+    lame_set_error_protection(gfe, ctx->protection);
+    lame_set_bWriteVbrTag(gfe, 0);
+    if (ctx->quality >= 0)
+        lame_set_quality(gfe, ctx->quality);
+    if (lame_init_params(gfe) < 0) {
+        lame_close(gfe);
+        return -3;
+    }
+
+    /* encoder frame q is output frame q + f0 - prime */
+    prime = (SPLICE_PRIMING + N - 1) / N;
+    p0 = (b->f0 - prime) * N + lame_get_encoder_delay(gfe) + SPLICE_DECDELAY;
+    n = (b->f1 - b->f0 + prime + 2) * N;
+    size = 5 * n / 4 + 2 * 7200;
+    for (ch = 0; ch < ctx->channels; ch++)
+        if ((pcm[ch] = malloc(n * sizeof(short))) == NULL)
+            goto done;
+    if ((b->mp3 = malloc(size)) == NULL)
+        goto done;
+    if ((ret = make_pcm(ctx, p0, n, pcm)) < 0)
+        goto done;
+
+    ret = -3;
+    imp3 = lame_encode_buffer(gfe, pcm[0], pcm[ctx->channels - 1], n, b->mp3, size);
+    if (imp3 < 0)
+        goto done;
+    k = lame_encode_flush(gfe, b->mp3 + imp3, size - imp3);
+    if (k < 0)
+        goto done;
+    imp3 += k;
+
+    ret = parse_frames(&b->st, b->mp3, 0, imp3, ctx->version != 1, ctx->channels);
+    if (ret < 0)
+        goto done;
+    b->first = prime;
+    ret = -1;
+    if (b->st.frames < prime + b->f1 - b->f0)
+        goto done;
+    for (j = prime; j < prime + b->f1 - b->f0; j++)
+        if (!b->st.fr[j].copyable)
+            goto done;
+    ret = 0;
+
+  done:
+    for (ch = 0; ch < ctx->channels; ch++)
+        free(pcm[ch]);
+    lame_close(gfe);
+    return ret;
+}
+
+static void
+free_burst(splice_burst * b)
+{
+    free(b->mp3);
+    free(b->st.fr);
+    memset(b, 0, sizeof(*b));
+}
+
+/* encodes the bursts the frames not copied make up, keeping those
+   encoded before which have not changed */
+static int
+make_bursts(splice_ctx * ctx)
+{
+    splice_burst *b;
+    long    j, f0, q;
+    int     k, n = 0, ret;
+
+    for (k = 0; k < ctx->nbursts; k++)
+        ctx->burst[k].used = 0;
+    for (j = 0; j < ctx->frames; j++) {
+        if (!ctx->out[j].burst)
+            continue;
+        for (f0 = j; j < ctx->frames && ctx->out[j].burst; j++);
+        for (k = 0; k < ctx->nbursts; k++)
+            if (ctx->burst[k].mp3 != NULL && ctx->burst[k].f0 == f0 && ctx->burst[k].f1 == j)
+                break;
+        if (k == ctx->nbursts) {
+            for (k = 0; k < ctx->nbursts && ctx->burst[k].mp3 != NULL; k++);
+            if (k == ctx->nbursts) {
+                b = realloc(ctx->burst, (ctx->nbursts + 1) * sizeof(*b));
+                if (b == NULL)
+                    return -2;
+                ctx->burst = b;
+                memset(&b[ctx->nbursts++], 0, sizeof(*b));
+            }
+            b = &ctx->burst[k];
+            b->f0 = f0;
+            b->f1 = j;
+            if ((ret = encode_burst(ctx, b)) < 0) {
+                free_burst(b);
+                return ret;
+            }
+        }
+        ctx->burst[k].used = 1;
+        n++;
+    }
+    /* only now, the realloc() above moves the bursts */
+    for (k = 0; k < ctx->nbursts; k++) {
+        b = &ctx->burst[k];
+        if (!b->used) {
+            free_burst(b);
+            continue;
+        }
+        for (q = b->f0; q < b->f1; q++) {
+            ctx->out[q].s = &b->st;
+            ctx->out[q].i = b->first + q - b->f0;
+        }
+    }
+    return n;
+}
+
+/* bursts grow over the frames next to them with a short window towards
+   them, and over those whose window the encoder did not match.
+   returns 1 if a burst has grown */
+static int
+grow_bursts(splice_ctx * ctx, int encoded)
+{
+    splice_out *o = ctx->out;
+    long    j;
+    int     grown = 0;
+
+    for (j = 0; j < ctx->frames; j++) {
+        if (o[j].burst)
+            continue;
+        if (j > 0 && o[j - 1].burst
+            && (encoded ? !windows_match(out_frame(ctx, j - 1), out_frame(ctx, j),
+                                         ctx->channels)
+                : short_towards(out_frame(ctx, j), 0, ctx->channels)))
+            o[j].burst = grown = 1;
+        else if (j + 1 < ctx->frames && o[j + 1].burst
+                 && (encoded ? !windows_match(out_frame(ctx, j), out_frame(ctx, j + 1),
+                                              ctx->channels)
+                     : short_towards(out_frame(ctx, j), 1, ctx->channels)))
+            o[j].burst = grown = 1;
+    }
+    return grown;
+}
+
+
+
+/*
+ * the output
+ */
+
+static int
+slot_bytes(const splice_ctx * ctx, long j, int opt)
+{
+    int     kbps = bitrate_table[ctx->version][opt >> 1];
+
+    return (ctx->version == 1 ? 144000 : 72000) * kbps / ctx->samplerate
+        + (opt & 1) - out_frame(ctx, j)->side;
+}
+
+/* places the main data of every frame, as early as main_data_begin
+   allows.  a frame whose main data does not fit gets a higher bitrate
+   or the padding bit, or one of the frames before it does.  returns
+   -1, or the first frame which can not be placed */
+static long
+pack(splice_ctx * ctx)
+{
+    splice_out *o = ctx->out;
+    const splice_frame *f;
+    unsigned long data, start, end;
+    long    j, k;
+    int     opt;
+
+    for (j = 0; j < ctx->frames; j++) {
+        f = out_frame(ctx, j);
+        o[j].min_opt = 2 * (o[j].s->buf[f->pos + 2] >> 4);
+    }
+    for (j = 0; j < ctx->frames;) {
+        f = out_frame(ctx, j);
+        data = j > 0 ? o[j - 1].data + o[j - 1].slot : 0;
+        end = j > 0 ? o[j - 1].start + out_frame(ctx, j - 1)->len : 0;
+        start = data > (unsigned long) ctx->maxmdb ? data - ctx->maxmdb : 0;
+        if (start < end)
+            start = end;
+        for (opt = o[j].min_opt; opt < 30; opt++)
+            if (start + f->len <= data + slot_bytes(ctx, j, opt))
+                break;
+        if (opt < 30) {
+            o[j].opt = opt;
+            o[j].slot = slot_bytes(ctx, j, opt);
+            o[j].data = data;
+            o[j].start = start;
+            j++;
+            continue;
+        }
+        /* more room in the slots before */
+        for (k = j - 1; k >= 0 && k >= j - 8 && o[k].opt >= 29; k--);
+        if (k < 0 || k < j - 8)
+            return j;
+        o[k].min_opt = o[k].opt + 1;
+        j = k;
+    }
+    return -1;
+}
+
+/* n bytes from byte off of the main data of frame i of s */
+static void
+copy_main_data(const splice_stream * s, long i, unsigned long off, int n,
+               unsigned char *dst)
+{
+    unsigned long x = s->fr[i].data - s->fr[i].mdb + off;
+    long    m = frame_of(s, x);
+    int     k;
+
+    while (n > 0) {
+        const splice_frame *f = &s->fr[m++];
+        k = f->data + f->size - f->side - x;
+        if (k > n)
+            k = n;
+        memcpy(dst, s->buf + f->pos + f->side + (x - f->data), k);
+        dst += k;
+        x += k;
+        n -= k;
+    }
+}
+
+/* CRC-16 of the last two header bytes and the side info */
+static void
+put_crc(unsigned char *frame, int side)
+{
+    unsigned int crc = 0xffff;
+    int     i, j;
+
+    for (i = 2; i < side; i = i == 3 ? 6 : i + 1) {
+        crc ^= frame[i] << 8;
+        for (j = 0; j < 8; j++) {
+            crc <<= 1;
+            if (crc & 0x10000)
+                crc ^= 0x18005;
+        }
+    }
+    frame[4] = crc >> 8;
+    frame[5] = crc & 255;
+}
+
+/* output frame j, returns its size */
+static int
+make_frame(const splice_ctx * ctx, long j, unsigned char *frame)
+{
+    const splice_out *o = &ctx->out[j], *q;
+    const splice_frame *f = out_frame(ctx, j);
+    unsigned char *si;
+    unsigned long from, to, len;
+    int     mdb = o->data - o->start;
+
+    memcpy(frame, o->s->buf + f->pos, f->side);
+    si = frame + (frame[1] & 1 ? 4 : 6);
+    frame[2] = (frame[2] & 0x0d) | (o->opt >> 1) << 4 | (o->opt & 1) << 1;
+    if (ctx->version == 1) {
+        si[0] = mdb >> 1;
+        si[1] = (si[1] & 0x7f) | (mdb & 1) << 7;
+    }
+    else
+        si[0] = mdb;
+    if (!(frame[1] & 1))
+        put_crc(frame, f->side);
+
+    /* the main data of this frame and the next ones in its slot */
+    memset(frame + f->side, 0, o->slot);
+    for (q = o; q < ctx->out + ctx->frames && q->start < o->data + o->slot; q++) {
+        len = q->s->fr[q->i].len;
+        from = q->start > o->data ? q->start : o->data;
+        to = q->start + len < o->data + o->slot ? q->start + len : o->data + o->slot;
+        if (from < to)
+            copy_main_data(q->s, q->i, from - q->start, to - from,
+                           frame + f->side + (from - o->data));
+    }
+    return f->side + o->slot;
+}
+
+static int
+write_output(splice_ctx * ctx, lame_global_flags * gfp, FILE * outf)
+{
+    lame_internal_flags *gfc;
+    unsigned char frame[SPLICE_MAX_FRAME], *head;
+    double  kbps = 0;
+    long    j;
+    int     n, cbr = 1;
+
+    for (j = 0; j < ctx->frames; j++) {
+        kbps += bitrate_table[ctx->version][ctx->out[j].opt >> 1];
+        if (ctx->out[j].opt >> 1 != ctx->out[0].opt >> 1)
+            cbr = 0;
+    }
+    kbps /= ctx->frames;
+
+    lame_set_in_samplerate(gfp, ctx->samplerate);
+    lame_set_out_samplerate(gfp, ctx->samplerate);
+    lame_set_num_channels(gfp, ctx->channels);
+    lame_set_mode(gfp, ctx->mode == 3 ? MONO : ctx->mode == 1 ? JOINT_STEREO : STEREO);
+    lame_set_error_protection(gfp, ctx->protection);
+    lame_set_free_format(gfp, 0);
+    if (cbr) {
+        lame_set_VBR(gfp, vbr_off);
+        lame_set_brate(gfp, (int) kbps);
+    }
+    else {
+        lame_set_VBR(gfp, vbr_abr);
+        lame_set_VBR_mean_bitrate_kbps(gfp, (int) (kbps + .5));
+    }
+    lame_set_findReplayGain(gfp, 0);
+    lame_set_decode_on_the_fly(gfp, 0);
+    if (lame_init_params(gfp) < 0)
+        return -3;
+    lame_set_encoder_delay_padding(gfp, ctx->delay, ctx->padding);
+    gfc = gfp->internal_flags;
+
+    /* the ID3v2 tag and the dummy Xing/Info frame */
+    n = gfc->bs.buf_byte_idx + 1;
+    if ((head = malloc(n > 0 ? n : 1)) == NULL)
+        return -2;
+    n = copy_buffer(gfc, head, n, 0);
+    if (n < 0 || (gfp->output.func == NULL && n > 0
+                  && fwrite(head, 1, n, outf) != (size_t) n)) {
+        free(head);
+        return -4;
+    }
+    free(head);
+
+    for (j = 0; j < ctx->frames; j++) {
+        n = make_frame(ctx, j, frame);
+        if (gfp->seek_index_interval > 0)
+            AddSeekIndexFrame(gfp, gfc->nBytesOutput, frame);
+        if (gfp->bWriteVbrTag)
+            AddVbrFrameHeader(gfp, frame);
+        if (gfp->frame_info)
+            add_frame_info(gfc, gfc->nBytesOutput, frame);
+        UpdateMusicCRC(&gfc->nMusicCRC, frame, n);
+        gfc->nBytesOutput += n;
+        if (gfp->output.func != NULL ? gfp->output.func(gfp->output.user, frame, n) != 0
+            : fwrite(frame, 1, n, outf) != (size_t) n)
+            return -4;
+    }
+    gfp->frameNum = ctx->frames;
+
+    id3tag_write_v1(gfp);
+    n = copy_buffer(gfc, frame, sizeof(frame), 0);
+    if (n < 0 || (gfp->output.func == NULL && n > 0
+                  && fwrite(frame, 1, n, outf) != (size_t) n))
+        return -4;
+    return 0;
+}
+
+
+
+int
+lame_splice(lame_global_flags * gfp, const lame_splice_segment seg[], int nseg,
+            FILE * outf)
+{
+    splice_ctx ctx;
+    splice_stream *s;
+    long    j;
+    int     k, m, round, ret = 0;
+
+    if (gfp == NULL || seg == NULL || nseg <= 0
+        || (outf == NULL && gfp->output.func == NULL))
+        return -1;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.quality = lame_get_quality(gfp);
+    ctx.streams = calloc(nseg, sizeof(*ctx.streams));
+    ctx.piece = calloc(nseg, sizeof(*ctx.piece));
+    if (ctx.streams == NULL || ctx.piece == NULL) {
+        ret = -2;
+        goto done;
+    }
+
+    /* the files, each once */
+    for (k = 0; k < nseg && ret == 0; k++) {
+        for (m = 0; m < k; m++)
+            if (seg[m].mp3 == seg[k].mp3 && seg[m].size == seg[k].size)
+                break;
+        if (m < k)
+            s = ctx.piece[m].s;
+        else if ((ret = open_stream(&ctx, s = &ctx.streams[ctx.nstreams], seg[k].mp3,
+                                    seg[k].size)) == 0)
+            ctx.nstreams++;
+        else
+            free(s->fr);
+        ctx.piece[k].s = s;
+        ctx.piece[k].begin = seg[k].begin;
+        ctx.piece[k].end = seg[k].end ? seg[k].end : s->length;
+        if (ret == 0 && (seg[k].begin >= ctx.piece[k].end || ctx.piece[k].end > s->length))
+            ret = -1;
+    }
+    if (ret < 0)
+        goto done;
+    ctx.npieces = nseg;
+    make_timeline(&ctx);
+
+    if ((ctx.out = calloc(ctx.frames, sizeof(*ctx.out))) == NULL) {
+        ret = -2;
+        goto done;
+    }
+    for (j = 0; j < ctx.frames; j++) {
+        k = owner(&ctx, j * ctx.framesize);
+        ctx.out[j].s = ctx.piece[k].s;
+        ctx.out[j].i = j + ctx.piece[k].shift;
+        ctx.out[j].burst = !is_verbatim(&ctx, j);
+    }
+    for (round = 0; round < SPLICE_MAX_GROW && grow_bursts(&ctx, 0); round++);
+
+    /* bursts grow until their windows match and all main data fits */
+    for (round = 0;; round++) {
+        if ((ret = make_bursts(&ctx)) < 0)
+            goto done;
+        if (round < SPLICE_MAX_GROW && grow_bursts(&ctx, 1))
+            continue;
+        if ((j = pack(&ctx)) < 0)
+            break;
+        assert(!ctx.out[j].burst);
+        ctx.out[j].burst = 1;
+    }
+
+    ret = write_output(&ctx, gfp, outf);
+    if (ret == 0)
+        for (j = 0; j < ctx.frames; j++)
+            ret += ctx.out[j].burst;
+
+  done:
+    for (k = 0; k < ctx.nbursts; k++)
+        free_burst(&ctx.burst[k]);
+    free(ctx.burst);
+    for (k = 0; k < ctx.nstreams; k++)
+        free(ctx.streams[k].fr);
+    free(ctx.streams);
+    free(ctx.piece);
+    free(ctx.out);
+    return ret;
+}
+
+#endif
+
+/* end of splice.c */
@@ -767,7 +767,8 @@ int noquant_count_bits(
     int bits = 0;
     int i, a1, a2;
     int *const ix = gi->l3_enc;
-    i=576;
+    /* nothing can be nonzero above max_nonzero_coeff */
+    i = Min(576, (gi->max_nonzero_coeff + 2) & ~1);
     /* Determine count1 region */
     for (; i > 1; i -= 2) 
 	if (ix[i - 1] | ix[i - 2])
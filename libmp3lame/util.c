@@ -76,6 +76,16 @@ void  freegfc ( lame_internal_flags* const gfc )   /* bit stream structure */
         gfc->VBR_seek_table.bag=NULL;
         gfc->VBR_seek_table.size=0;
     }
+    if ( gfc->seek_index.bag ) {
+        free ( gfc->seek_index.bag );
+        gfc->seek_index.bag=NULL;
+        gfc->seek_index.size=0;
+    }
+    if ( gfc->frame_info.bag ) {
+        free ( gfc->frame_info.bag );
+        gfc->frame_info.bag=NULL;
+        gfc->frame_info.size=0;
+    }
     if ( gfc->ATH ) {
         free ( gfc->ATH );
     }
@@ -373,6 +383,20 @@ int gcd ( int i, int j )
 
 
 
+/* returns 1 if the n samples at buf have no more energy than limit:
+   digital silence, or input below the ATH (see gfc->ATH->inaudible) */
+
+int is_inaudible ( const sample_t *buf, int n, FLOAT limit )
+{
+    FLOAT8 sum = 0;
+    while (--n >= 0)
+	if ((sum += buf[n] * buf[n]) > limit)
+	    return 0;
+    return 1;
+}
+
+
+
 /* copy in new samples from in_buffer into mfbuf, with resampling
    if necessary.  n_in = number of samples from the input buffer that
    were used.  n_out = number of samples copied into mfbuf  */
@@ -383,7 +407,7 @@ void fill_buffer(lame_global_flags *gfp,
 		 int nsamples, int *n_in, int *n_out)
 {
     lame_internal_flags *gfc = gfp->internal_flags;
-    int ch,i;
+    int ch;
 
     /* copy in new samples into mfbuf, with resampling if necessary */
     if ( (gfc->resample_ratio < .9999) || (gfc->resample_ratio > 1.0001) ){
@@ -397,11 +421,9 @@ void fill_buffer(lame_global_flags *gfp,
     else {
 	*n_out = Min(gfp->framesize, nsamples);
 	*n_in = *n_out;
-	for (i = 0; i < *n_out; ++i) {
-	    mfbuf[0][gfc->mf_size + i] = in_buffer[0][i];
-	    if (gfc->channels_out == 2)
-		mfbuf[1][gfc->mf_size + i] = in_buffer[1][i];
-	}
+	for (ch = 0; ch < gfc->channels_out; ch++)
+	    memcpy(&mfbuf[ch][gfc->mf_size], in_buffer[ch],
+		   sizeof(sample_t) * *n_out);
     }
 }
     
@@ -750,76 +772,5 @@ void disable_FPE(void) {
 
 
 
-#ifdef USE_FAST_LOG
-/***********************************************************************
- *
- * Fast Log Approximation for log2, used to approximate every other log
- * (log10 and log)
- * maximum absolute error for log10 is around 10-6
- * maximum *relative* error can be high when x is almost 1 because error/log10(x) tends toward x/e
- *
- * use it if typical RESULT values are > 1e-5 (for example if x>1.00001 or x<0.99999)
- * or if the relative precision in the domain around 1 is not important (result in 1 is exact and 0)
- *
- ***********************************************************************/
-
-
-#define LOG2_SIZE       (512)
-#define LOG2_SIZE_L2    (9)
-
-static ieee754_float32_t log_table[LOG2_SIZE+1];
-
-
-
-void init_log_table(void)
-{
-  int j;
-  static int init = 0;
-
-  /* Range for log2(x) over [1,2[ is [0,1[ */
-  assert((1<<LOG2_SIZE_L2)==LOG2_SIZE);
-  
-  if(!init) {
-    for(j=0; j<LOG2_SIZE+1; j++)
-      log_table[j] = log(1.0f+j/(ieee754_float32_t)LOG2_SIZE)/log(2.0f);
-  }
-  init = 1;
-}
-
-
-
-ieee754_float32_t fast_log2(ieee754_float32_t x)
-{
-  ieee754_float32_t log2val, partial;
-  union {
-    ieee754_float32_t f;
-    int     i;
-  } fi;
-  int mantisse;
-  fi.f = x;
-  mantisse = fi.i & 0x7fffff;
-  log2val = ((fi.i>>23) & 0xFF)-0x7f;
-  partial = (mantisse & ((1<<(23-LOG2_SIZE_L2))-1));
-  partial *= 1.0f/((1<<(23-LOG2_SIZE_L2)));
-
-
-  mantisse >>= (23-LOG2_SIZE_L2);
-
-  /* log2val += log_table[mantisse];  without interpolation the results are not good */
-  log2val += log_table[mantisse] * (1.0f-partial) + log_table[mantisse+1]*partial;
-
-  return log2val;
-}
-
-#else /* Don't use FAST_LOG */
-
-
-void init_log_table(void)
-{
-}
-
-
-#endif
-
 /* end of util.c */
 
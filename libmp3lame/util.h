@@ -112,11 +112,15 @@ extern "C" {
 #define         FAST_LOG(x)         (fast_log2(x)*LOG2)
 #define         FAST_LOG10_X(x,y)   (fast_log2(x)*(LOG2/LOG10*(y)))
 #define         FAST_LOG_X(x,y)     (fast_log2(x)*(LOG2*(y)))
+#define         FAST_POW(x,y)       fast_exp2((y)*fast_log2(x))
+#define         FAST_POW10(x)       fast_exp2((x)*(LOG10/LOG2))
 #else
 #define         FAST_LOG10(x)       log10(x)
 #define         FAST_LOG(x)         log(x)
 #define         FAST_LOG10_X(x,y)   (log10(x)*(y))
 #define         FAST_LOG_X(x,y)     (log(x)*(y))
+#define         FAST_POW(x,y)       pow(x,y)
+#define         FAST_POW10(x)       pow(10.0,x)
 #endif
 
 
@@ -139,8 +143,9 @@ typedef struct  bit_stream_struc {
     int         buf_size;       /* size of buffer (in number of bytes) */
     int         totbit;         /* bit counter of bit stream */
     int         buf_byte_idx;   /* pointer to top byte in buffer */
-    int         buf_bit_idx;    /* pointer to top bit of top byte in buffer */
-    
+    uint64_t    cache;          /* bits not yet stored in buf, right aligned */
+    int         cache_bits;     /* number of valid bits in cache */
+
     /* format of file in rd mode (BINARY/ASCII) */
 } Bit_stream_struc;
 
@@ -160,6 +165,15 @@ typedef struct {
     FLOAT     attackthre;
     FLOAT     attackthre_s;
 
+    /* short block analysis of the last granule was skipped */
+    int   skipped_s;
+    FLOAT skipped_athadjust;
+
+    /* M/S analysis of the last granule was skipped, and so some M/S
+     * maskings returned for the current frame are missing */
+    int   skipped_ms;
+    int   ms_missing;
+
     /* variables for nspsytune2 */
     FILE *pass1fp;
 } nsPsy_t;
@@ -176,6 +190,31 @@ typedef struct
 } VBR_seek_info_t;
 
 
+/* lame_frame_info of the frames written, see add_frame_info() */
+typedef struct
+{
+    unsigned long frames;       /* frames seen */
+    int count;                  /* entries in bag */
+    int size;                   /* size of our bag, in entries */
+    lame_frame_info *bag;
+} frame_info_t;
+
+
+/* sidecar seek index, see AddSeekIndexFrame() */
+/* main_data_begin reaches back up to 255 frames at MPEG-2 8 kbps with
+   CRC (1 byte of main data per frame), plus the frames of the preroll */
+#define SEEK_INDEX_RECENT 512
+
+typedef struct
+{
+    unsigned long recent[SEEK_INDEX_RECENT]; /* offsets of the last frames */
+    unsigned long frames;       /* frames seen */
+    int count;                  /* entries in bag */
+    int size;                   /* size of our bag, in entries */
+    unsigned char *bag;         /* entries, already in file format */
+} seek_index_t;
+
+
 /**
  *  ATH related stuff, if something new ATH related has to be added,
  *  please plugg it here into the ATH_t struct
@@ -190,6 +229,8 @@ typedef struct
     FLOAT   adjust_limit;   /* limit for dynamic ATH adjust */
     FLOAT   decay;          /* determined to lower x dB each second */
     FLOAT   floor;          /* lowest ATH value */
+    FLOAT   lowest;         /* lowest ATH of all sfbs, long and short */
+    FLOAT   inaudible;      /* input energy of a granule below the ATH */
     FLOAT   l[SBMAX_l];     /* ATH for sfbs in long blocks */
     FLOAT   s[SBMAX_s];     /* ATH for sfbs in short blocks */
     FLOAT   psfb21[PSFB21]; /* ATH for partitionned sfb21 in long blocks */
@@ -306,6 +347,7 @@ struct lame_internal_flags {
   unsigned long frame_count;  /* Number of frames coded, 2^32 > 3 years */
   int          mf_samples_to_encode;
   int          mf_size;
+  int          mf_lr_diff;    /* mfbuf[0] and [1] are identical from here on */
   FLOAT        ampl;	  /* amplification at the end of the current chunk (1. = 0 dB) */
   FLOAT        last_ampl;	  /* amplification at the end of the last chunk    (1. = 0 dB) */
   int VBR_min_bitrate;            /* min bitrate index */
@@ -337,7 +379,9 @@ struct lame_internal_flags {
 			       3 = use substep inside loop and last step
 			    */
 
-  int psymodel;             /* 1 = gpsycho. 0 = none */
+  int psymodel;             /* 0 = none, 1 = gpsycho,
+                               2 = gpsycho with coarse long block partitions
+                             */
   int noise_shaping_stop;   /* 0 = stop at over=0, all scalefacs amplified or
                                    a scalefac has reached max value
                                1 = stop when all scalefacs amplified or        
@@ -364,6 +408,11 @@ struct lame_internal_flags {
   struct id3tag_spec tag_spec;
   uint16_t nMusicCRC;
 
+  /* for the Xing/LAME tag, so it can be built without reading the output */
+  unsigned long nBytesOutput;     /* returned by copy_buffer() so far */
+  unsigned long nVbrTagOffset;    /* of the Xing frame, i.e. the ID3v2 size */
+  unsigned char VbrFirstHeader[4];/* header of the first audio frame */
+
 
   /* variables used by quantize.c */
   int OldValue[2];
@@ -389,7 +438,9 @@ struct lame_internal_flags {
 
   /* variables for newmdct.c */
   FLOAT8 sb_sample[2][2][18][SBLIMIT];
+  int sb_inaudible[2];       /* last granule of sb_sample was below the ATH */
   FLOAT8 amp_filter[32];
+  int sblimit;               /* subbands >= sblimit are zeroed by amp_filter */
 
   /* variables for bitstream.c */
   /* mpeg1: buffer=511 bytes  smallest frame: 96-38(sideinfo)=58
@@ -414,6 +465,7 @@ struct lame_internal_flags {
   /* variables for reservoir.c */
   int ResvSize; /* in bits */
   int ResvMax;  /* in bits */
+  int ResvDrain; /* empty the reservoir, the next frame starts a segment */
 
   scalefac_struct scalefac_band;
 
@@ -448,6 +500,12 @@ struct lame_internal_flags {
   FLOAT loudness_sq[2][2];  /* loudness^2 approx. per granule and channel */
   FLOAT loudness_sq_save[2];/* account for granule delay of L3psycho_anal */
 
+  /* spreading between scalefactor bands and loudness weights of the
+   * MDCT lines, for L3psycho_anal_xr */
+  FLOAT8 s3_xr_l[SBMAX_l][SBMAX_l];
+  FLOAT8 s3_xr_s[SBMAX_s][SBMAX_s];
+  FLOAT8 eql_xr[576];
+
   FLOAT window[BLKSIZE];
   FLOAT window_s[BLKSIZE_s/2];
 
@@ -456,6 +514,7 @@ struct lame_internal_flags {
   int	bm_l[SBMAX_l],bo_l[SBMAX_l] ;
   int	bm_s[SBMAX_s],bo_s[SBMAX_s] ;
   int	npart_l,npart_s;
+  int	mask_add_near;	/* partition distance of about 1 bark, see mask_add() */
   
   int	s3ind[CBANDS][2];
   int	s3ind_s[CBANDS][2];
@@ -491,6 +550,8 @@ struct lame_internal_flags {
   unsigned crcvalue;
   
   VBR_seek_info_t VBR_seek_table; /* used for Xing VBR header */
+  seek_index_t seek_index;        /* used for the sidecar seek index */
+  frame_info_t frame_info;        /* for lame_take_frame_info() */
   
   ATH_t *ATH;   /* all ATH related stuff */
   VBR_t *VBR;
@@ -540,11 +601,73 @@ extern int            nearestBitrateFullIndex(const int brate);
 extern FLOAT          ATHformula(FLOAT freq,lame_global_flags *gfp);
 extern FLOAT8         freq2bark(FLOAT8 freq);
 extern FLOAT8         freq2cbw(FLOAT8 freq);
+extern int            is_inaudible(const sample_t *buf, int n, FLOAT limit);
 void disable_FPE(void);
 
-/* log/log10 approximations */
-extern void init_log_table(void);
-extern ieee754_float32_t fast_log2(ieee754_float32_t x);
+#ifdef USE_FAST_LOG
+/***********************************************************************
+ *
+ * Fast log2 and exp2 approximations in single precision, inline and
+ * without tables so that loops using them can be vectorized.  They
+ * need IEEE 754 floats.  The other FAST_ functions above are built
+ * from these.
+ *
+ * fast_log2: normal x > 0.  The absolute error is about 1 ulp of the
+ *     result, below 4e-6 over the whole float range.
+ * fast_exp2: relative error below 1e-7, 0 for x < -126, saturates at
+ *     2^127.
+ * FAST_POW(x,y) = fast_exp2(y*fast_log2(x)), relative error below
+ *     1e-6 for |y*log2(x)| < 10.
+ *
+ * misc/fastmath.c checks these bounds against libm and benchmarks them.
+ *
+ ***********************************************************************/
+
+static inline ieee754_float32_t fast_log2(ieee754_float32_t x)
+{
+    union {
+	ieee754_float32_t f;
+	int     i;
+    } fi;
+    ieee754_float32_t m, t, t2;
+    int     e;
+
+    /* x = 2^e * m with sqrt(0.5) <= m < sqrt(2) */
+    fi.f = x;
+    e = ((fi.i + 0x004afb0d) >> 23) - 127;
+    fi.i -= e << 23;
+    m = fi.f;
+
+    /* log2(m) = 2/ln(2) * atanh(t) */
+    t = (m - 1.0f) / (m + 1.0f);
+    t2 = t * t;
+    return e + t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078016f
+	+ t2 * (0.412198583f + t2 * 0.320598898f))));
+}
+
+static inline ieee754_float32_t fast_exp2(ieee754_float32_t x)
+{
+    union {
+	ieee754_float32_t f;
+	int     i;
+    } fi;
+    ieee754_float32_t f;
+    int     n;
+
+    if (x < -126.0f)
+	return 0.0f;
+    if (x > 127.0f)
+	x = 127.0f;
+
+    /* x = n + f with -0.5 <= f < 0.5, 2^f by its Taylor series */
+    n = (int)(x + 127.5f) - 127;
+    f = x - n;
+    fi.i = (n + 127) << 23;
+    return fi.f * (1.0f + f * (0.693147181f + f * (0.240226507f
+	+ f * (0.0555041087f + f * (0.00961812911f + f * (0.00133335581f
+	+ f * (0.000154035304f + f * 1.52527338e-05f)))))));
+}
+#endif
 
 
 void fill_buffer(lame_global_flags *gfp,
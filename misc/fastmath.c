@@ -0,0 +1,156 @@
+/*
+ * Accuracy and speed of the fast log2/exp2/pow approximations in
+ * libmp3lame/util.h, compared with libm.
+ *
+ * usage: fastmath [loops]
+ *
+ * Prints the maximum absolute and relative error of every function over
+ * the argument range the encoder uses, and the time per call of the
+ * approximation and of the libm function.  Exits with 1 if an error is
+ * above the bound documented in util.h.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "../libmp3lame/util.h"
+
+#ifdef USE_FAST_LOG
+
+#define N  4096
+
+/* the bounds documented in util.h */
+#define LOG2_ABS_BOUND  4.e-6
+#define EXP2_REL_BOUND  1.e-7
+#define POW_REL_BOUND   1.e-6
+
+static float  xs [N];
+static float  ys [N];
+static float  out[N];
+static double sink;
+
+
+typedef void ( *vf ) ( int );
+
+static void  f_log2   ( int n ) { int i; for (i = 0; i < n; i++) out[i] = fast_log2(xs[i]); }
+static void  l_log2   ( int n ) { int i; for (i = 0; i < n; i++) out[i] = log(xs[i]) * (1/LOG2); }
+static void  f_log10  ( int n ) { int i; for (i = 0; i < n; i++) out[i] = FAST_LOG10(xs[i]); }
+static void  l_log10  ( int n ) { int i; for (i = 0; i < n; i++) out[i] = log10(xs[i]); }
+static void  f_exp2   ( int n ) { int i; for (i = 0; i < n; i++) out[i] = fast_exp2(ys[i]); }
+static void  l_exp2   ( int n ) { int i; for (i = 0; i < n; i++) out[i] = pow(2.0, ys[i]); }
+static void  f_pow    ( int n ) { int i; for (i = 0; i < n; i++) out[i] = FAST_POW(xs[i], 0.3f); }
+static void  l_pow    ( int n ) { int i; for (i = 0; i < n; i++) out[i] = pow(xs[i], 0.3); }
+
+
+static double  usec ( vf fn, int loops )
+{
+    vf volatile  f = fn;    /* keep the calls from being merged */
+    clock_t  t;
+    int      l;
+
+    t = clock ();
+    for ( l = 0; l < loops; l++ ) {
+        f (N);
+        sink += out [l % N];
+    }
+    return (double)(clock () - t) / CLOCKS_PER_SEC * 1.e6 / loops / N;
+}
+
+
+static void  speed ( const char* name, vf fast, vf libm, int loops )
+{
+    double  tf = usec (fast, loops);
+    double  tl = usec (libm, loops);
+
+    printf ( "%-8s %8.2f ns %8.2f ns  %5.1fx\n", name, tf*1.e3, tl*1.e3, tl/tf );
+}
+
+
+static int  check ( const char* name, double error, double bound )
+{
+    if ( error <= bound )
+        return 0;
+    printf ( "%s: error %.3g above the bound %.3g of util.h\n", name, error, bound );
+    return 1;
+}
+
+
+/* returns the number of errors above their bounds */
+static int  accuracy ( void )
+{
+    double  e, abs_log = 0, rel_log = 0, rel_exp = 0, rel_pow = 0;
+    double  xd, yd;
+    float   x, y;
+
+    /* the arguments are rounded to float first, as in the encoder */
+
+    /* log2 over all exponents, fine steps in the mantissa */
+    for ( xd = 1.e-30; xd < 1.e30; xd *= 1.0001 ) {
+        x = xd;
+        e = fabs ( fast_log2 (x) - log(x) / LOG2 );
+        if ( e > abs_log ) abs_log = e;
+        if ( fabs(x-1) > 1.e-3  &&  e / fabs(log(x)/LOG2) > rel_log )
+            rel_log = e / fabs(log(x)/LOG2);
+    }
+    /* exp2 over the whole normal range */
+    for ( yd = -126; yd < 127; yd += 1.e-4 ) {
+        y = yd;
+        e = fabs ( fast_exp2 (y) / pow(2,y) - 1 );
+        if ( e > rel_exp ) rel_exp = e;
+    }
+    /* pow as used by NS_INTERP and the ATH adjustment */
+    for ( xd = 1.e-3; xd < 1.e3; xd *= 1.0001 ) {
+        x = xd;
+        y = log10 (x);
+        e = fabs ( FAST_POW (x, 0.3f) / pow(x,0.3f) - 1 );
+        if ( e > rel_pow ) rel_pow = e;
+        e = fabs ( FAST_POW10 (y) / pow(10,y) - 1 );
+        if ( e > rel_pow ) rel_pow = e;
+    }
+
+    printf ( "fast_log2  max abs error %.3g, max rel error %.3g (|x-1| > 1e-3)\n", abs_log, rel_log );
+    printf ( "fast_exp2  max rel error %.3g\n", rel_exp );
+    printf ( "FAST_POW   max rel error %.3g\n\n", rel_pow );
+
+    return check ( "fast_log2", abs_log, LOG2_ABS_BOUND )
+         + check ( "fast_exp2", rel_exp, EXP2_REL_BOUND )
+         + check ( "FAST_POW",  rel_pow, POW_REL_BOUND  );
+}
+
+
+int  main ( int argc, char** argv )
+{
+    int  i, bad;
+    int  loops = argc > 1  ?  atoi (argv[1])  :  2000;
+
+    for ( i = 0; i < N; i++ ) {
+        xs [i] = exp ( (i - N/2) * 0.01 );
+        ys [i] = (i - N/2) * 0.01;
+    }
+
+    bad = accuracy ();
+
+    printf ( "         approx.    libm       speedup\n" );
+    speed ( "log2",  f_log2,  l_log2,  loops );
+    speed ( "log10", f_log10, l_log10, loops );
+    speed ( "exp2",  f_exp2,  l_exp2,  loops );
+    speed ( "pow",   f_pow,   l_pow,   loops );
+    return bad ? 1 : 0;
+}
+
+#else
+
+int  main ( void )
+{
+    printf ( "USE_FAST_LOG is not defined, the encoder uses libm\n" );
+    return 0;
+}
+
+#endif
+
+/* end of fastmath.c */
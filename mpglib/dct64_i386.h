@@ -22,6 +22,8 @@
 #include "common.h"
 
 void dct64( real *a,real *b,real *c);
+void dct32( real *a,real *b,real *c);
+void dct16( real *a,real *b,real *c);
 
 
 #endif
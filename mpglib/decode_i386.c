@@ -57,8 +57,9 @@ char *strchr (), *strrchr ();
   *samples = sum;
 
 
- /* versions: clipped (when TYPE == short) and unclipped (when TYPE == real) of synth_1to1_mono* functions */
-#define SYNTH_1TO1_MONO_CLIPCHOICE(TYPE,SYNTH_1TO1)                    \
+ /* versions: clipped (when TYPE == short) and unclipped (when TYPE == real) of synth_Nto1_mono* functions,
+    N = 32 / NS */
+#define SYNTH_1TO1_MONO_CLIPCHOICE(TYPE,SYNTH_1TO1,NS)                 \
   TYPE samples_tmp[64];                                                \
   TYPE *tmp1 = samples_tmp;                                            \
   int i,ret;                                                           \
@@ -67,24 +68,44 @@ char *strchr (), *strrchr ();
   ret = SYNTH_1TO1 (mp,bandPtr,0,(unsigned char *) samples_tmp,&pnt1); \
   out += *pnt;                                                         \
                                                                        \
-  for(i=0;i<32;i++) {                                                  \
+  for(i=0;i<NS;i++) {                                                  \
     *( (TYPE *) out) = *tmp1;                                          \
     out += sizeof(TYPE);                                               \
     tmp1 += 2;                                                         \
   }                                                                    \
-  *pnt += 32*sizeof(TYPE);                                             \
+  *pnt += NS*sizeof(TYPE);                                             \
                                                                        \
   return ret; 
 
 
 int synth_1to1_mono(PMPSTR mp, real *bandPtr,unsigned char *out,int *pnt)
 {
-  SYNTH_1TO1_MONO_CLIPCHOICE(short,synth_1to1)
+  SYNTH_1TO1_MONO_CLIPCHOICE(short,synth_1to1,32)
 }
 
 int synth_1to1_mono_unclipped(PMPSTR mp, real *bandPtr, unsigned char *out,int *pnt)
 {
-  SYNTH_1TO1_MONO_CLIPCHOICE(real,synth_1to1_unclipped)
+  SYNTH_1TO1_MONO_CLIPCHOICE(real,synth_1to1_unclipped,32)
+}
+
+int synth_2to1_mono(PMPSTR mp, real *bandPtr,unsigned char *out,int *pnt)
+{
+  SYNTH_1TO1_MONO_CLIPCHOICE(short,synth_2to1,16)
+}
+
+int synth_2to1_mono_unclipped(PMPSTR mp, real *bandPtr, unsigned char *out,int *pnt)
+{
+  SYNTH_1TO1_MONO_CLIPCHOICE(real,synth_2to1_unclipped,16)
+}
+
+int synth_4to1_mono(PMPSTR mp, real *bandPtr,unsigned char *out,int *pnt)
+{
+  SYNTH_1TO1_MONO_CLIPCHOICE(short,synth_4to1,8)
+}
+
+int synth_4to1_mono_unclipped(PMPSTR mp, real *bandPtr, unsigned char *out,int *pnt)
+{
+  SYNTH_1TO1_MONO_CLIPCHOICE(real,synth_4to1_unclipped,8)
 }
 
 /* versions: clipped (when TYPE == short) and unclipped (when TYPE == real) of synth_1to1* functions */
@@ -203,3 +224,136 @@ int synth_1to1_unclipped(PMPSTR mp, real *bandPtr,int channel, unsigned char *ou
 }
 
 
+
+
+/*
+ * synth_2to1() and synth_4to1() give every second, resp. fourth, sample
+ * of synth_1to1(), for input with only the lowest 16, resp. 8, subbands.
+ * There is nothing above half, resp. a quarter, of the Nyquist frequency
+ * then, so nothing aliases.  The DCT rows of the other samples are
+ * never computed, and the window is stepped over them.  D is the
+ * decimation, 2 or 4.
+ */
+#define SYNTH_NTO1_CLIPCHOICE(TYPE,WRITE_SAMPLE,D,DCT)        \
+  static const int step = 2;                                  \
+  int bo;                                                     \
+  TYPE *samples = (TYPE *) (out + *pnt);                      \
+                                                              \
+  real *b0,(*buf)[0x110];                                     \
+  int clip = 0;                                               \
+  int bo1;                                                    \
+                                                              \
+  bo = mp->synth_bo;                                          \
+                                                              \
+  if(!channel) {                                              \
+    bo--;                                                     \
+    bo &= 0xf;                                                \
+    buf = mp->synth_buffs[0];                                 \
+  }                                                           \
+  else {                                                      \
+    samples++;                                                \
+    buf = mp->synth_buffs[1];                                 \
+  }                                                           \
+                                                              \
+  if(bo & 0x1) {                                              \
+    b0 = buf[0];                                              \
+    bo1 = bo;                                                 \
+    DCT(buf[1]+((bo+1)&0xf),buf[0]+bo,bandPtr);               \
+  }                                                           \
+  else {                                                      \
+    b0 = buf[1];                                              \
+    bo1 = bo+1;                                               \
+    DCT(buf[0]+bo,buf[1]+bo+1,bandPtr);                       \
+  }                                                           \
+                                                              \
+  mp->synth_bo = bo;                                          \
+                                                              \
+  {                                                           \
+    register int j;                                           \
+    real *window = decwin + 16 - bo1;                         \
+                                                              \
+    for (j=16/D;j;j--,b0+=0x10*D,window+=0x20*D,samples+=step) \
+    {                                                         \
+      real sum;                                               \
+      sum  = window[0x0] * b0[0x0];                           \
+      sum -= window[0x1] * b0[0x1];                           \
+      sum += window[0x2] * b0[0x2];                           \
+      sum -= window[0x3] * b0[0x3];                           \
+      sum += window[0x4] * b0[0x4];                           \
+      sum -= window[0x5] * b0[0x5];                           \
+      sum += window[0x6] * b0[0x6];                           \
+      sum -= window[0x7] * b0[0x7];                           \
+      sum += window[0x8] * b0[0x8];                           \
+      sum -= window[0x9] * b0[0x9];                           \
+      sum += window[0xA] * b0[0xA];                           \
+      sum -= window[0xB] * b0[0xB];                           \
+      sum += window[0xC] * b0[0xC];                           \
+      sum -= window[0xD] * b0[0xD];                           \
+      sum += window[0xE] * b0[0xE];                           \
+      sum -= window[0xF] * b0[0xF];                           \
+                                                              \
+      WRITE_SAMPLE (samples,sum,clip);                        \
+    }                                                         \
+                                                              \
+    {                                                         \
+      real sum;                                               \
+      sum  = window[0x0] * b0[0x0];                           \
+      sum += window[0x2] * b0[0x2];                           \
+      sum += window[0x4] * b0[0x4];                           \
+      sum += window[0x6] * b0[0x6];                           \
+      sum += window[0x8] * b0[0x8];                           \
+      sum += window[0xA] * b0[0xA];                           \
+      sum += window[0xC] * b0[0xC];                           \
+      sum += window[0xE] * b0[0xE];                           \
+      WRITE_SAMPLE (samples,sum,clip);                        \
+      b0-=0x10*D,window-=0x20*D,samples+=step;                \
+    }                                                         \
+    window += bo1<<1;                                         \
+                                                              \
+    for (j=16/D-1;j;j--,b0-=0x10*D,window-=0x20*D,samples+=step) \
+    {                                                         \
+      real sum;                                               \
+      sum = -window[-0x1] * b0[0x0];                          \
+      sum -= window[-0x2] * b0[0x1];                          \
+      sum -= window[-0x3] * b0[0x2];                          \
+      sum -= window[-0x4] * b0[0x3];                          \
+      sum -= window[-0x5] * b0[0x4];                          \
+      sum -= window[-0x6] * b0[0x5];                          \
+      sum -= window[-0x7] * b0[0x6];                          \
+      sum -= window[-0x8] * b0[0x7];                          \
+      sum -= window[-0x9] * b0[0x8];                          \
+      sum -= window[-0xA] * b0[0x9];                          \
+      sum -= window[-0xB] * b0[0xA];                          \
+      sum -= window[-0xC] * b0[0xB];                          \
+      sum -= window[-0xD] * b0[0xC];                          \
+      sum -= window[-0xE] * b0[0xD];                          \
+      sum -= window[-0xF] * b0[0xE];                          \
+      sum -= window[-0x0] * b0[0xF];                          \
+                                                              \
+      WRITE_SAMPLE (samples,sum,clip);                        \
+    }                                                         \
+  }                                                           \
+  *pnt += 64/D*sizeof(TYPE);                                  \
+                                                              \
+  return clip;                                           
+
+
+int synth_2to1(PMPSTR mp, real *bandPtr,int channel,unsigned char *out, int *pnt)
+{
+  SYNTH_NTO1_CLIPCHOICE(short,WRITE_SAMPLE_CLIPPED,2,dct32)
+}
+
+int synth_2to1_unclipped(PMPSTR mp, real *bandPtr,int channel, unsigned char *out, int *pnt)
+{
+  SYNTH_NTO1_CLIPCHOICE(real,WRITE_SAMPLE_UNCLIPPED,2,dct32)
+}
+
+int synth_4to1(PMPSTR mp, real *bandPtr,int channel,unsigned char *out, int *pnt)
+{
+  SYNTH_NTO1_CLIPCHOICE(short,WRITE_SAMPLE_CLIPPED,4,dct16)
+}
+
+int synth_4to1_unclipped(PMPSTR mp, real *bandPtr,int channel, unsigned char *out, int *pnt)
+{
+  SYNTH_NTO1_CLIPCHOICE(real,WRITE_SAMPLE_UNCLIPPED,4,dct16)
+}
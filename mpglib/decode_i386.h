@@ -27,5 +27,15 @@ int synth_1to1(PMPSTR mp, real *bandPtr,int channel,unsigned char *out,int *pnt)
 int synth_1to1_mono_unclipped(PMPSTR mp, real *bandPtr,unsigned char *out,int *pnt);
 int synth_1to1_unclipped(PMPSTR mp, real *bandPtr,int channel,unsigned char *out,int *pnt);
 
+int synth_2to1_mono(PMPSTR mp, real *bandPtr,unsigned char *out,int *pnt);
+int synth_2to1(PMPSTR mp, real *bandPtr,int channel,unsigned char *out,int *pnt);
+int synth_2to1_mono_unclipped(PMPSTR mp, real *bandPtr,unsigned char *out,int *pnt);
+int synth_2to1_unclipped(PMPSTR mp, real *bandPtr,int channel,unsigned char *out,int *pnt);
+
+int synth_4to1_mono(PMPSTR mp, real *bandPtr,unsigned char *out,int *pnt);
+int synth_4to1(PMPSTR mp, real *bandPtr,int channel,unsigned char *out,int *pnt);
+int synth_4to1_mono_unclipped(PMPSTR mp, real *bandPtr,unsigned char *out,int *pnt);
+int synth_4to1_unclipped(PMPSTR mp, real *bandPtr,int channel,unsigned char *out,int *pnt);
+
 #endif
 
@@ -27,6 +27,26 @@
 #endif
 
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+#else
+static int tables_ready = 0;
+#endif
+
+/* the tables are shared by all decoders */
+static void init_tables(void)
+{
+	make_decode_tables(32767);
+
+	init_layer3(SBLIMIT);
+
+#ifdef USE_LAYER_2
+	init_layer2();
+#endif
+}
+
 BOOL InitMP3( PMPSTR mp) 
 {
 	memset(mp,0,sizeof(MPSTR));
@@ -48,16 +68,17 @@ BOOL InitMP3( PMPSTR mp)
 	mp->head = mp->tail = NULL;
 	mp->fr.single = -1;
 	mp->bsnum = 0;
-	wordpointer = mp->bsspace[mp->bsnum] + 512;
+	mp->wordpointer = mp->bsspace[mp->bsnum] + 512;
 	mp->synth_bo = 1;
 	mp->sync_bitstream = 1;
 
-	make_decode_tables(32767);
-
-	init_layer3(SBLIMIT);
-
-#ifdef USE_LAYER_2
-	init_layer2();
+#ifdef HAVE_PTHREAD
+	pthread_once(&tables_once, init_tables);
+#else
+	if (!tables_ready) {
+		init_tables();
+		tables_ready = 1;
+	}
 #endif
 
 	return !0;
@@ -398,14 +419,14 @@ int decodeMP3_clipchoice( PMPSTR mp,unsigned char *in,int isize,char *out,
                 mp->sync_bitstream=1;
 		
 		/* skip some bytes, buffer the rest */
-		size = (int) (wordpointer - (mp->bsspace[mp->bsnum]+512));
+		size = (int) (mp->wordpointer - (mp->bsspace[mp->bsnum]+512));
 		
 		if (size > MAXFRAMESIZE) {
 		    /* wordpointer buffer is trashed.  probably cant recover, but try anyway */
 		    fprintf(stderr,"mpglib: wordpointer trashed.  size=%i (%i)  bytes=%i \n",
 			    size,MAXFRAMESIZE,bytes);		  
 		    size=0;
-		    wordpointer = mp->bsspace[mp->bsnum]+512;
+		    mp->wordpointer = mp->bsspace[mp->bsnum]+512;
 		}
 		
 		/* buffer contains 'size' data right now 
@@ -417,12 +438,15 @@ int decodeMP3_clipchoice( PMPSTR mp,unsigned char *in,int isize,char *out,
 		    read_buf_byte(mp);
 		}
 		
-		copy_mp(mp,bytes,wordpointer);
+		copy_mp(mp,bytes,mp->wordpointer);
 		mp->fsizeold += bytes;
 	    }
 	    
 	    read_head(mp);
 	    decode_header(&mp->fr,mp->header);
+	    /* the spectral mode gives all subbands */
+	    mp->fr.down_sample = mp->spectral ? 0 : mp->down_sample;
+	    mp->fr.down_sample_sblimit = SBLIMIT>>(mp->fr.down_sample);
 	    mp->header_parsed=1;
 	    mp->framesize = mp->fr.framesize;
 	    mp->free_format = (mp->framesize==0);
@@ -435,8 +459,8 @@ int decodeMP3_clipchoice( PMPSTR mp,unsigned char *in,int isize,char *out,
 		mp->ssize += 2;
 	    
 	    mp->bsnum = 1-mp->bsnum; /* toggle buffer */
-	    wordpointer = mp->bsspace[mp->bsnum] + 512;
-	    bitindex = 0;
+	    mp->wordpointer = mp->bsspace[mp->bsnum] + 512;
+	    mp->bitindex = 0;
 	    
 	    /* for very first header, never parse rest of data */
 	    if (mp->fsizeold==-1)
@@ -452,11 +476,11 @@ int decodeMP3_clipchoice( PMPSTR mp,unsigned char *in,int isize,char *out,
                 if (mp->bsize < mp->ssize) 
 		  return MP3_NEED_MORE;
 
-		copy_mp(mp,mp->ssize,wordpointer);
+		copy_mp(mp,mp->ssize,mp->wordpointer);
 
 		if(mp->fr.error_protection)
-		  getbits(16);
-		bits=do_layer3_sideinfo(&mp->fr);
+		  getbits(mp,16);
+		bits=do_layer3_sideinfo(mp);
 		/* bits = actual number of bits needed to parse this frame */
 		/* can be negative, if all bits needed are in the reservoir */
 		if (bits<0) bits=0;
@@ -492,7 +516,7 @@ int decodeMP3_clipchoice( PMPSTR mp,unsigned char *in,int isize,char *out,
 				return MP3_NEED_MORE;
 		}
 
-		copy_mp(mp,mp->dsize,wordpointer);
+		copy_mp(mp,mp->dsize,mp->wordpointer);
 
 		*done = 0;
 
@@ -502,17 +526,17 @@ int decodeMP3_clipchoice( PMPSTR mp,unsigned char *in,int isize,char *out,
 #ifdef USE_LAYER_1
 			case 1:
 				if(mp->fr.error_protection)
-					getbits(16);
+					getbits(mp,16);
 
-				do_layer1(mp,(unsigned char *) out,done);
+				do_layer1(mp,(unsigned char *) out,done, synth_1to1_mono_ptr, synth_1to1_ptr);
 			break;
 #endif
 #ifdef USE_LAYER_2
 			case 2:
 				if(mp->fr.error_protection)
-					getbits(16);
+					getbits(mp,16);
 
-				do_layer2(mp,(unsigned char *) out,done);
+				do_layer2(mp,(unsigned char *) out,done, synth_1to1_mono_ptr, synth_1to1_ptr);
 			break;
 #endif
 			case 3:
@@ -522,7 +546,7 @@ int decodeMP3_clipchoice( PMPSTR mp,unsigned char *in,int isize,char *out,
 				fprintf(stderr,"invalid layer %d\n",mp->fr.lay);
 		}
 
-		wordpointer = mp->bsspace[mp->bsnum] + 512 + mp->ssize + mp->dsize;
+		mp->wordpointer = mp->bsspace[mp->bsnum] + 512 + mp->ssize + mp->dsize;
 
 		mp->data_parsed=1;
 		iret=MP3_OK;
@@ -557,10 +581,10 @@ int decodeMP3_clipchoice( PMPSTR mp,unsigned char *in,int isize,char *out,
 
 	if (bytes>0) {
 	  int size;
-	  copy_mp(mp,bytes,wordpointer);
-	  wordpointer += bytes;
+	  copy_mp(mp,bytes,mp->wordpointer);
+	  mp->wordpointer += bytes;
 
-	  size = (int) (wordpointer - (mp->bsspace[mp->bsnum]+512));
+	  size = (int) (mp->wordpointer - (mp->bsspace[mp->bsnum]+512));
 	  if (size > MAXFRAMESIZE) {
 	    fprintf(stderr,"fatal error.  MAXFRAMESIZE not large enough.\n");
 	  }
@@ -578,6 +602,16 @@ int decodeMP3_clipchoice( PMPSTR mp,unsigned char *in,int isize,char *out,
 	return iret;
 }
 
+/* the synthesis for each mp->down_sample */
+static int (* const synth_mono[3])(PMPSTR,real *,unsigned char *,int *) =
+	{ synth_1to1_mono, synth_2to1_mono, synth_4to1_mono };
+static int (* const synth_stereo[3])(PMPSTR,real *,int,unsigned char *,int *) =
+	{ synth_1to1, synth_2to1, synth_4to1 };
+static int (* const synth_mono_unclipped[3])(PMPSTR,real *,unsigned char *,int *) =
+	{ synth_1to1_mono_unclipped, synth_2to1_mono_unclipped, synth_4to1_mono_unclipped };
+static int (* const synth_stereo_unclipped[3])(PMPSTR,real *,int,unsigned char *,int *) =
+	{ synth_1to1_unclipped, synth_2to1_unclipped, synth_4to1_unclipped };
+
 int decodeMP3( PMPSTR mp,unsigned char *in,int isize,char *out,
 		int osize,int *done)
 {
@@ -587,7 +621,8 @@ int decodeMP3( PMPSTR mp,unsigned char *in,int isize,char *out,
 	}
 
 	/* passing pointers to the functions which clip the samples */
-	return decodeMP3_clipchoice(mp, in, isize, out, osize, done, synth_1to1_mono, synth_1to1);
+	return decodeMP3_clipchoice(mp, in, isize, out, osize, done,
+				    synth_mono[mp->down_sample], synth_stereo[mp->down_sample]);
 }	
 
 int decodeMP3_unclipped( PMPSTR mp,unsigned char *in,int isize,char *out,
@@ -600,7 +635,8 @@ int decodeMP3_unclipped( PMPSTR mp,unsigned char *in,int isize,char *out,
 	}
 
 	/* passing pointers to the functions which don't clip the samples */
-	return decodeMP3_clipchoice(mp, in, isize, out, osize, done, synth_1to1_mono_unclipped, synth_1to1_unclipped);
+	return decodeMP3_clipchoice(mp, in, isize, out, osize, done,
+				    synth_mono_unclipped[mp->down_sample], synth_stereo_unclipped[mp->down_sample]);
 }	
 
 
@@ -24,7 +24,7 @@
 #include <dmalloc.h>
 #endif
 
-void I_step_one(unsigned int balloc[], unsigned int scale_index[2][SBLIMIT],struct frame *fr)
+void I_step_one(PMPSTR mp,unsigned int balloc[], unsigned int scale_index[2][SBLIMIT],struct frame *fr)
 {
   unsigned int *ba=balloc;
   unsigned int *sca = (unsigned int *) scale_index;
@@ -34,38 +34,38 @@ void I_step_one(unsigned int balloc[], unsigned int scale_index[2][SBLIMIT],stru
     int i;
     int jsbound = fr->jsbound;
     for (i=0;i<jsbound;i++) { 
-      *ba++ = getbits(4);
-      *ba++ = getbits(4);
+      *ba++ = getbits(mp,4);
+      *ba++ = getbits(mp,4);
     }
     for (i=jsbound;i<SBLIMIT;i++)
-      *ba++ = getbits(4);
+      *ba++ = getbits(mp,4);
 
     ba = balloc;
 
     for (i=0;i<jsbound;i++) {
       if ((*ba++))
-        *sca++ = getbits(6);
+        *sca++ = getbits(mp,6);
       if ((*ba++))
-        *sca++ = getbits(6);
+        *sca++ = getbits(mp,6);
     }
     for (i=jsbound;i<SBLIMIT;i++)
       if ((*ba++)) {
-        *sca++ =  getbits(6);
-        *sca++ =  getbits(6);
+        *sca++ =  getbits(mp,6);
+        *sca++ =  getbits(mp,6);
       }
   }
   else {
     int i;
     for (i=0;i<SBLIMIT;i++)
-      *ba++ = getbits(4);
+      *ba++ = getbits(mp,4);
     ba = balloc;
     for (i=0;i<SBLIMIT;i++)
       if ((*ba++))
-        *sca++ = getbits(6);
+        *sca++ = getbits(mp,6);
   }
 }
 
-void I_step_two(real fraction[2][SBLIMIT],unsigned int balloc[2*SBLIMIT],
+void I_step_two(PMPSTR mp,real fraction[2][SBLIMIT],unsigned int balloc[2*SBLIMIT],
 	unsigned int scale_index[2][SBLIMIT],struct frame *fr)
 {
   int i,n;
@@ -82,13 +82,13 @@ void I_step_two(real fraction[2][SBLIMIT],unsigned int balloc[2*SBLIMIT],
     ba = balloc;
     for (sample=smpb,i=0;i<jsbound;i++)  {
       if ((n = *ba++))
-        *sample++ = getbits(n+1);
+        *sample++ = getbits(mp,n+1);
       if ((n = *ba++))
-        *sample++ = getbits(n+1);
+        *sample++ = getbits(mp,n+1);
     }
     for (i=jsbound;i<SBLIMIT;i++) 
       if ((n = *ba++))
-        *sample++ = getbits(n+1);
+        *sample++ = getbits(mp,n+1);
 
     ba = balloc;
     for (sample=smpb,i=0;i<jsbound;i++) {
@@ -118,7 +118,7 @@ void I_step_two(real fraction[2][SBLIMIT],unsigned int balloc[2*SBLIMIT],
     ba = balloc;
     for (sample=smpb,i=0;i<SBLIMIT;i++)
       if ((n = *ba++))
-        *sample++ = getbits(n+1);
+        *sample++ = getbits(mp,n+1);
     ba = balloc;
     for (sample=smpb,i=0;i<SBLIMIT;i++) {
       if((n=*ba++))
@@ -132,7 +132,9 @@ void I_step_two(real fraction[2][SBLIMIT],unsigned int balloc[2*SBLIMIT],
 }
 
 /*int do_layer1(struct frame *fr,int outmode,struct audio_info_struct *ai) */
-int do_layer1(PMPSTR mp, unsigned char *pcm_sample,int *pcm_point)
+int do_layer1(PMPSTR mp, unsigned char *pcm_sample,int *pcm_point,
+                int (*synth_1to1_mono_ptr)(PMPSTR,real *,unsigned char *,int *),
+                int (*synth_1to1_ptr)(PMPSTR,real *,int,unsigned char *, int *) )
 {
   int clip=0;
   unsigned int balloc[2*SBLIMIT];
@@ -147,20 +149,20 @@ int do_layer1(PMPSTR mp, unsigned char *pcm_sample,int *pcm_point)
   if (stereo == 1 || single == 3)
     single = 0;
 
-  I_step_one(balloc,scale_index,fr);
+  I_step_one(mp,balloc,scale_index,fr);
 
   for (i=0;i<SCALE_BLOCK;i++)
   {
-    I_step_two(fraction,balloc,scale_index,fr);
+    I_step_two(mp,fraction,balloc,scale_index,fr);
 
     if(single >= 0)
     {
-      clip += synth_1to1_mono( mp, (real *) fraction[single],pcm_sample,pcm_point);
+      clip += (*synth_1to1_mono_ptr)( mp, (real *) fraction[single],pcm_sample,pcm_point);
     }
     else {
         int p1 = *pcm_point;
-        clip += synth_1to1( mp, (real *) fraction[0],0,pcm_sample,&p1);
-        clip += synth_1to1( mp, (real *) fraction[1],1,pcm_sample,pcm_point);
+        clip += (*synth_1to1_ptr)( mp, (real *) fraction[0],0,pcm_sample,&p1);
+        clip += (*synth_1to1_ptr)( mp, (real *) fraction[1],1,pcm_sample,pcm_point);
     }
   }
 
@@ -19,7 +19,9 @@
 #ifndef LAYER1_H_INCLUDED
 #define LAYER1_H_INCLUDED
 
-int do_layer1(PMPSTR mp, unsigned char *pcm_sample,int *pcm_point);
+int do_layer1(PMPSTR mp, unsigned char *pcm_sample,int *pcm_point,
+                int (*synth_1to1_mono_ptr)(PMPSTR,real *,unsigned char *,int *),
+                int (*synth_1to1_ptr)(PMPSTR,real *,int,unsigned char *, int *) );
 
 #endif
 
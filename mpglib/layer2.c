@@ -70,7 +70,7 @@ void init_layer2(void)
 }
 
 
-void II_step_one(unsigned int *bit_alloc,int *scale,struct frame *fr)
+void II_step_one(PMPSTR mp,unsigned int *bit_alloc,int *scale,struct frame *fr)
 {
     int stereo = fr->stereo-1;
     int sblimit = fr->II_sblimit;
@@ -78,7 +78,7 @@ void II_step_one(unsigned int *bit_alloc,int *scale,struct frame *fr)
     int sblimit2 = fr->II_sblimit<<stereo;
     struct al_table2 *alloc1 = fr->alloc;
     int i;
-    static unsigned int scfsi_buf[64];
+    unsigned int scfsi_buf[64];
     unsigned int *scfsi,*bita;
     int sc,step;
 
@@ -87,12 +87,12 @@ void II_step_one(unsigned int *bit_alloc,int *scale,struct frame *fr)
     {
       for (i=jsbound;i;i--,alloc1+=(1<<step))
       {
-        *bita++ = (char) getbits(step=alloc1->bits);
-        *bita++ = (char) getbits(step);
+        *bita++ = (char) getbits(mp,step=alloc1->bits);
+        *bita++ = (char) getbits(mp,step);
       }
       for (i=sblimit-jsbound;i;i--,alloc1+=(1<<step))
       {
-        bita[0] = (char) getbits(step=alloc1->bits);
+        bita[0] = (char) getbits(mp,step=alloc1->bits);
         bita[1] = bita[0];
         bita+=2;
       }
@@ -100,17 +100,17 @@ void II_step_one(unsigned int *bit_alloc,int *scale,struct frame *fr)
       scfsi=scfsi_buf;
       for (i=sblimit2;i;i--)
         if (*bita++)
-          *scfsi++ = (char) getbits_fast(2);
+          *scfsi++ = (char) getbits_fast(mp,2);
     }
     else /* mono */
     {
       for (i=sblimit;i;i--,alloc1+=(1<<step))
-        *bita++ = (char) getbits(step=alloc1->bits);
+        *bita++ = (char) getbits(mp,step=alloc1->bits);
       bita = bit_alloc;
       scfsi=scfsi_buf;
       for (i=sblimit;i;i--)
         if (*bita++)
-          *scfsi++ = (char) getbits_fast(2);
+          *scfsi++ = (char) getbits_fast(mp,2);
     }
 
     bita = bit_alloc;
@@ -120,30 +120,30 @@ void II_step_one(unsigned int *bit_alloc,int *scale,struct frame *fr)
         switch (*scfsi++) 
         {
           case 0: 
-                *scale++ = getbits_fast(6);
-                *scale++ = getbits_fast(6);
-                *scale++ = getbits_fast(6);
+                *scale++ = getbits_fast(mp,6);
+                *scale++ = getbits_fast(mp,6);
+                *scale++ = getbits_fast(mp,6);
                 break;
           case 1 : 
-                *scale++ = sc = getbits_fast(6);
+                *scale++ = sc = getbits_fast(mp,6);
                 *scale++ = sc;
-                *scale++ = getbits_fast(6);
+                *scale++ = getbits_fast(mp,6);
                 break;
           case 2: 
-                *scale++ = sc = getbits_fast(6);
+                *scale++ = sc = getbits_fast(mp,6);
                 *scale++ = sc;
                 *scale++ = sc;
                 break;
           default:              /* case 3 */
-                *scale++ = getbits_fast(6);
-                *scale++ = sc = getbits_fast(6);
+                *scale++ = getbits_fast(mp,6);
+                *scale++ = sc = getbits_fast(mp,6);
                 *scale++ = sc;
                 break;
         }
 
 }
 
-void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int *scale,struct frame *fr,int x1)
+void II_step_two(PMPSTR mp,unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int *scale,struct frame *fr,int x1)
 {
     int i,j,k,ba;
     int stereo = fr->stereo;
@@ -164,15 +164,15 @@ void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int *scale
           if( (d1=alloc2->d) < 0) 
           {
             real cm=muls[k][scale[x1]];
-            fraction[j][0][i] = ((real) ((int)getbits(k) + d1)) * cm;
-            fraction[j][1][i] = ((real) ((int)getbits(k) + d1)) * cm;
-            fraction[j][2][i] = ((real) ((int)getbits(k) + d1)) * cm;
+            fraction[j][0][i] = ((real) ((int)getbits(mp,k) + d1)) * cm;
+            fraction[j][1][i] = ((real) ((int)getbits(mp,k) + d1)) * cm;
+            fraction[j][2][i] = ((real) ((int)getbits(mp,k) + d1)) * cm;
           }        
           else 
           {
             static int *table[] = { 0,0,0,grp_3tab,0,grp_5tab,0,0,0,grp_9tab };
             unsigned int idx,*tab,m=scale[x1];
-            idx = (unsigned int) getbits(k);
+            idx = (unsigned int) getbits(mp,k);
             tab = (unsigned int *) (table[d1] + idx + idx + idx);
             fraction[j][0][i] = muls[*tab++][m];
             fraction[j][1][i] = muls[*tab++][m];
@@ -196,9 +196,9 @@ void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int *scale
         {
           real cm;
           cm=muls[k][scale[x1+3]];
-          fraction[1][0][i] = (fraction[0][0][i] = (real) ((int)getbits(k) + d1) ) * cm;
-          fraction[1][1][i] = (fraction[0][1][i] = (real) ((int)getbits(k) + d1) ) * cm;
-          fraction[1][2][i] = (fraction[0][2][i] = (real) ((int)getbits(k) + d1) ) * cm;
+          fraction[1][0][i] = (fraction[0][0][i] = (real) ((int)getbits(mp,k) + d1) ) * cm;
+          fraction[1][1][i] = (fraction[0][1][i] = (real) ((int)getbits(mp,k) + d1) ) * cm;
+          fraction[1][2][i] = (fraction[0][2][i] = (real) ((int)getbits(mp,k) + d1) ) * cm;
           cm=muls[k][scale[x1]];
           fraction[0][0][i] *= cm; fraction[0][1][i] *= cm; fraction[0][2][i] *= cm;
         }
@@ -207,7 +207,7 @@ void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int *scale
           static int *table[] = { 0,0,0,grp_3tab,0,grp_5tab,0,0,0,grp_9tab };
           unsigned int idx,*tab,m1,m2;
           m1 = scale[x1]; m2 = scale[x1+3];
-          idx = (unsigned int) getbits(k);
+          idx = (unsigned int) getbits(mp,k);
           tab = (unsigned int *) (table[d1] + idx + idx + idx);
           fraction[0][0][i] = muls[*tab][m1]; fraction[1][0][i] = muls[*tab++][m2];
           fraction[0][1][i] = muls[*tab][m1]; fraction[1][1][i] = muls[*tab++][m2];
@@ -229,8 +229,8 @@ void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int *scale
 */
     }
 
-/*  if(sblimit > (fr->down_sample_sblimit) ) */
-/*    sblimit = fr->down_sample_sblimit; */
+  if(sblimit > (fr->down_sample_sblimit) )
+    sblimit = fr->down_sample_sblimit;
 
   for(i=sblimit;i<SBLIMIT;i++)
     for (j=0;j<stereo;j++)
@@ -264,7 +264,9 @@ static void II_select_table(struct frame *fr)
 }
 
 
-int do_layer2( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point)
+int do_layer2( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
+                int (*synth_1to1_mono_ptr)(PMPSTR,real *,unsigned char *,int *),
+                int (*synth_1to1_ptr)(PMPSTR,real *,int,unsigned char *, int *) )
 /*int do_layer2(struct frame *fr,int outmode,struct audio_info_struct *ai) */
 {
   int clip=0;
@@ -283,21 +285,21 @@ int do_layer2( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point)
   if(stereo == 1 || single == 3)
     single = 0;
 
-  II_step_one(bit_alloc, scale, fr);
+  II_step_one(mp,bit_alloc, scale, fr);
 
   for (i=0;i<SCALE_BLOCK;i++) 
   {
-    II_step_two(bit_alloc,fraction,scale,fr,i>>2);
+    II_step_two(mp,bit_alloc,fraction,scale,fr,i>>2);
     for (j=0;j<3;j++) 
     {
       if(single >= 0)
       {
-        clip += synth_1to1_mono(mp, fraction[single][j],pcm_sample,pcm_point);
+        clip += (*synth_1to1_mono_ptr)(mp, fraction[single][j],pcm_sample,pcm_point);
       }
       else {
           int p1 = *pcm_point;
-          clip += synth_1to1(mp, fraction[0][j],0,pcm_sample,&p1);
-          clip += synth_1to1(mp, fraction[1][j],1,pcm_sample,pcm_point);
+          clip += (*synth_1to1_ptr)(mp, fraction[0][j],0,pcm_sample,&p1);
+          clip += (*synth_1to1_ptr)(mp, fraction[1][j],1,pcm_sample,pcm_point);
       }
     }
   }
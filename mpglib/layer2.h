@@ -31,9 +31,11 @@ struct al_table2
 
 
 void init_layer2(void);
-void II_step_one(unsigned int *bit_alloc,int *scale,struct frame *fr);
-void II_step_two(unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int *scale,struct frame *fr,int x1);
-int  do_layer2( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point);
+void II_step_one(PMPSTR mp,unsigned int *bit_alloc,int *scale,struct frame *fr);
+void II_step_two(PMPSTR mp,unsigned int *bit_alloc,real fraction[2][4][SBLIMIT],int *scale,struct frame *fr,int x1);
+int  do_layer2( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
+                int (*synth_1to1_mono_ptr)(PMPSTR,real *,unsigned char *,int *),
+                int (*synth_1to1_ptr)(PMPSTR,real *,int,unsigned char *, int *) );
 
 #endif
 
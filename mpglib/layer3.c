@@ -12,6 +12,14 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
+#if HAVE_INTTYPES_H
+# include <inttypes.h>
+#else
+# if HAVE_STDINT_H
+#  include <stdint.h>
+# endif
+#endif
 #include "common.h"
 #include "huffman.h"
 #include "lame-analysis.h"
@@ -105,19 +113,174 @@ static unsigned int i_slen2[256]; /* MPEG 2.0 slen for intensity stereo */
 static real tan1_1[16],tan2_1[16],tan1_2[16],tan2_2[16];
 static real pow1_1[2][16],pow2_1[2][16],pow1_2[2][16],pow2_2[2][16];
 
-static unsigned int get1bit(void)
+static unsigned int get1bit(PMPSTR mp)
 {
   unsigned char rval;
-  rval = *wordpointer << bitindex;
+  rval = *mp->wordpointer << mp->bitindex;
 
-  bitindex++;
-  wordpointer += (bitindex>>3);
-  bitindex &= 7;
+  mp->bitindex++;
+  mp->wordpointer += (mp->bitindex>>3);
+  mp->bitindex &= 7;
 
   return rval>>7;
 }
 
 
+/*
+ * bit cache for the Huffman decoder: the next bits of the stream
+ * are kept msb first in a 64 bit word and refilled a byte at a time.
+ * A refill may load up to 8 bytes beyond the last bit that is really
+ * consumed, bsspace[] is padded for this.
+ */
+struct bitcache {
+  uint64_t cache;       /* next bits of the stream, msb first */
+  int bits;             /* number of valid bits in cache */
+  unsigned char *ptr;   /* next byte to load into cache */
+};
+
+static void bc_refill(struct bitcache *bc)
+{
+  while(bc->bits <= 56) {
+    bc->cache |= (uint64_t) *bc->ptr++ << (56 - bc->bits);
+    bc->bits += 8;
+  }
+}
+
+/* 1 <= n <= 32 */
+#define bc_peek(bc,n)   ((unsigned int) ((bc)->cache >> (64 - (n))))
+
+static void bc_skip(struct bitcache *bc,int n)
+{
+  bc->cache <<= n;
+  bc->bits -= n;
+}
+
+static unsigned int bc_get(struct bitcache *bc,int n)
+{
+  unsigned int rval;
+  if(n <= 0)
+    return 0;
+  rval = bc_peek(bc,n);
+  bc_skip(bc,n);
+  return rval;
+}
+
+static unsigned int bc_get1bit(struct bitcache *bc)
+{
+  unsigned int rval = (unsigned int) (bc->cache >> 63);
+  bc_skip(bc,1);
+  return rval;
+}
+
+/* start reading at mp->wordpointer/bitindex */
+static void bc_init(PMPSTR mp,struct bitcache *bc)
+{
+  bc->cache = 0;
+  bc->bits = 0;
+  bc->ptr = mp->wordpointer;
+  bc_refill(bc);
+  bc_skip(bc,mp->bitindex);
+}
+
+/* move mp->wordpointer/bitindex to the first bit not consumed from the cache */
+static void bc_sync(PMPSTR mp,struct bitcache *bc)
+{
+  mp->wordpointer = bc->ptr - ((bc->bits + 7) >> 3);
+  mp->bitindex = (8 - (bc->bits & 7)) & 7;
+}
+
+
+/*
+ * multi bit lookup tables for the Huffman trees in huffman.h:
+ * an entry >= 0 is a leaf, (code length << 8) | value.
+ * an entry < 0 links to a subtable, -((pool offset << 4) | index bits)
+ * and consumes all index bits of the current table.
+ */
+#define HUFF_LOOKUP_BITS 8      /* index bits of the first level tables */
+#define HUFF_SUBTABLE_BITS 6    /* max. index bits of the subtables */
+#define HUFF_POOL_SIZE 4608     /* 4506 are used for the trees in huffman.h */
+
+struct huff_lookup {
+  const int *tab;
+  int bits;
+};
+
+static int huff_pool[HUFF_POOL_SIZE];
+static int huff_pool_used;
+static struct huff_lookup hl[32];
+static struct huff_lookup hlc[2];
+
+static int huff_depth(const short *val)
+{
+  int y = *val++;
+  int d0,d1;
+  if(y >= 0)
+    return 0;
+  d0 = huff_depth(val);
+  d1 = huff_depth(val - y);
+  return 1 + (d0 > d1 ? d0 : d1);
+}
+
+static int huff_build(const short *node,int bits)
+{
+  int i,base = huff_pool_used;
+
+  huff_pool_used += 1 << bits;
+  for(i=0;i<(1<<bits);i++) {
+    const short *val = node;
+    int len = 0;
+    while(*val < 0 && len < bits) {
+      int y = *val++;
+      if((i >> (bits-1-len)) & 1)
+        val -= y;
+      len++;
+    }
+    if(*val >= 0)
+      huff_pool[base+i] = *val | (len << 8);
+    else {
+      int d = huff_depth(val);
+      int sub = d < HUFF_SUBTABLE_BITS ? d : HUFF_SUBTABLE_BITS;
+      huff_pool[base+i] = -((huff_build(val,sub) << 4) | sub);
+    }
+  }
+  return base;
+}
+
+static void huff_lookup_init(struct huff_lookup *l,const struct newhuff *h,
+   const struct huff_lookup *done,const struct newhuff *done_h,int ndone)
+{
+  int i,d;
+  for(i=0;i<ndone;i++) {
+    if(done_h[i].table == h->table) {
+      *l = done[i];
+      return;
+    }
+  }
+  d = huff_depth(h->table);
+  l->bits = d < 1 ? 1 : (d < HUFF_LOOKUP_BITS ? d : HUFF_LOOKUP_BITS);
+  l->tab = huff_pool + huff_build(h->table,l->bits);
+}
+
+/* decode one codeword of lookup table l */
+static int huff_decode(struct bitcache *bc,const struct huff_lookup *l,int *part2remain)
+{
+  const int *tab = l->tab;
+  int bits = l->bits;
+  int e = tab[bc_peek(bc,bits)];
+
+  while(e < 0) {
+    bc_skip(bc,bits);
+    *part2remain -= bits;
+    bits = (-e) & 0xf;
+    tab = huff_pool + ((-e) >> 4);
+    e = tab[bc_peek(bc,bits)];
+  }
+  bc_skip(bc,e >> 8);
+  *part2remain -= e >> 8;
+  return e & 0xff;
+}
+
+
 
 
 /* 
@@ -127,6 +290,12 @@ void init_layer3(int down_sample_sblimit)
 {
   int i,j,k;
 
+  huff_pool_used = 0;
+  for(i=0;i<32;i++)
+    huff_lookup_init(&hl[i],&ht[i],hl,ht,i);
+  for(i=0;i<2;i++)
+    huff_lookup_init(&hlc[i],&htc[i],hlc,htc,i);
+
   for(i=-256;i<118+4;i++)
     gainpow2[i+256] = pow((double)2.0,-0.25 * (double) (i+210) );
 
@@ -319,21 +488,21 @@ void init_layer3(int down_sample_sblimit)
  * read additional side information
  */
 #ifdef MPEG1 
-static void III_get_side_info_1(struct III_sideinfo *si,int stereo,
+static void III_get_side_info_1(PMPSTR mp,struct III_sideinfo *si,int stereo,
  int ms_stereo,long sfreq,int single)
 {
    int ch, gr;
    int powdiff = (single == 3) ? 4 : 0;
 
-   si->main_data_begin = getbits(9);
+   si->main_data_begin = getbits(mp,9);
    if (stereo == 1)
-     si->private_bits = getbits_fast(5);
+     si->private_bits = getbits_fast(mp,5);
    else 
-     si->private_bits = getbits_fast(3);
+     si->private_bits = getbits_fast(mp,3);
 
    for (ch=0; ch<stereo; ch++) {
        si->ch[ch].gr[0].scfsi = -1;
-       si->ch[ch].gr[1].scfsi = getbits_fast(4);
+       si->ch[ch].gr[1].scfsi = getbits_fast(mp,4);
    }
 
    for (gr=0; gr<2; gr++) 
@@ -342,15 +511,16 @@ static void III_get_side_info_1(struct III_sideinfo *si,int stereo,
      {
        register struct gr_info_s *gr_infos = &(si->ch[ch].gr[gr]);
 
-       gr_infos->part2_3_length = getbits(12);
-       gr_infos->big_values = getbits_fast(9);
+       gr_infos->part2_3_length = getbits(mp,12);
+       gr_infos->big_values = getbits_fast(mp,9);
        if(gr_infos->big_values > 288) {
           fprintf(stderr,"big_values too large! %i\n",gr_infos->big_values);
           gr_infos->big_values = 288;
        }
        {
-	 unsigned int qss = getbits_fast(8);
+	 unsigned int qss = getbits_fast(mp,8);
 	 gr_infos->pow2gain = gainpow2+256 - qss + powdiff;
+	 gr_infos->global_gain = qss;
 #ifndef NOANALYSIS
 	 if (mpg123_pinfo != NULL) {
 	   mpg123_pinfo->qss[gr][ch]=qss;
@@ -359,15 +529,15 @@ static void III_get_side_info_1(struct III_sideinfo *si,int stereo,
        }
        if(ms_stereo)
          gr_infos->pow2gain += 2;
-       gr_infos->scalefac_compress = getbits_fast(4);
+       gr_infos->scalefac_compress = getbits_fast(mp,4);
 /* window-switching flag == 1 for block_Type != 0 .. and block-type == 0 -> win-sw-flag = 0 */
-       if(get1bit()) 
+       if(get1bit(mp)) 
        {
          int i;
-         gr_infos->block_type = getbits_fast(2);
-         gr_infos->mixed_block_flag = get1bit();
-         gr_infos->table_select[0] = getbits_fast(5);
-         gr_infos->table_select[1] = getbits_fast(5);
+         gr_infos->block_type = getbits_fast(mp,2);
+         gr_infos->mixed_block_flag = get1bit(mp);
+         gr_infos->table_select[0] = getbits_fast(mp,5);
+         gr_infos->table_select[1] = getbits_fast(mp,5);
 
 
          /*
@@ -376,7 +546,7 @@ static void III_get_side_info_1(struct III_sideinfo *si,int stereo,
           */
          gr_infos->table_select[2] = 0;
          for(i=0;i<3;i++) {
-	   unsigned int sbg = (getbits_fast(3)<<3);
+	   unsigned int sbg = (getbits_fast(mp,3)<<3);
            gr_infos->full_gain[i] = gr_infos->pow2gain + sbg;
 #ifndef NOANALYSIS
 	   if (mpg123_pinfo != NULL)
@@ -397,17 +567,17 @@ static void III_get_side_info_1(struct III_sideinfo *si,int stereo,
        {
          int i,r0c,r1c;
          for (i=0; i<3; i++)
-           gr_infos->table_select[i] = getbits_fast(5);
-         r0c = getbits_fast(4);
-         r1c = getbits_fast(3);
+           gr_infos->table_select[i] = getbits_fast(mp,5);
+         r0c = getbits_fast(mp,4);
+         r1c = getbits_fast(mp,3);
          gr_infos->region1start = bandInfo[sfreq].longIdx[r0c+1] >> 1 ;
          gr_infos->region2start = bandInfo[sfreq].longIdx[r0c+1+r1c+1] >> 1;
          gr_infos->block_type = 0;
          gr_infos->mixed_block_flag = 0;
        }
-       gr_infos->preflag = get1bit();
-       gr_infos->scalefac_scale = get1bit();
-       gr_infos->count1table_select = get1bit();
+       gr_infos->preflag = get1bit(mp);
+       gr_infos->scalefac_scale = get1bit(mp);
+       gr_infos->count1table_select = get1bit(mp);
      }
    }
 }
@@ -416,32 +586,33 @@ static void III_get_side_info_1(struct III_sideinfo *si,int stereo,
 /*
  * Side Info for MPEG 2.0 / LSF
  */
-static void III_get_side_info_2(struct III_sideinfo *si,int stereo,
+static void III_get_side_info_2(PMPSTR mp,struct III_sideinfo *si,int stereo,
  int ms_stereo,long sfreq,int single)
 {
    int ch;
    int powdiff = (single == 3) ? 4 : 0;
 
-   si->main_data_begin = getbits(8);
+   si->main_data_begin = getbits(mp,8);
 
    if (stereo == 1)
-     si->private_bits = get1bit();
+     si->private_bits = get1bit(mp);
    else 
-     si->private_bits = getbits_fast(2);
+     si->private_bits = getbits_fast(mp,2);
 
    for (ch=0; ch<stereo; ch++) 
    {
        register struct gr_info_s *gr_infos = &(si->ch[ch].gr[0]);
        unsigned int qss;
 
-       gr_infos->part2_3_length = getbits(12);
-       gr_infos->big_values = getbits_fast(9);
+       gr_infos->part2_3_length = getbits(mp,12);
+       gr_infos->big_values = getbits_fast(mp,9);
        if(gr_infos->big_values > 288) {
          fprintf(stderr,"big_values too large! %i\n",gr_infos->big_values);
          gr_infos->big_values = 288;
        }
-       qss=getbits_fast(8);
+       qss=getbits_fast(mp,8);
        gr_infos->pow2gain = gainpow2+256 - qss + powdiff;
+       gr_infos->global_gain = qss;
 #ifndef NOANALYSIS
        if (mpg123_pinfo!=NULL) {
 	   mpg123_pinfo->qss[0][ch]=qss;
@@ -451,22 +622,22 @@ static void III_get_side_info_2(struct III_sideinfo *si,int stereo,
 
        if(ms_stereo)
          gr_infos->pow2gain += 2;
-       gr_infos->scalefac_compress = getbits(9);
+       gr_infos->scalefac_compress = getbits(mp,9);
 /* window-switching flag == 1 for block_Type != 0 .. and block-type == 0 -> win-sw-flag = 0 */
-       if(get1bit()) 
+       if(get1bit(mp)) 
        {
          int i;
-         gr_infos->block_type = getbits_fast(2);
-         gr_infos->mixed_block_flag = get1bit();
-         gr_infos->table_select[0] = getbits_fast(5);
-         gr_infos->table_select[1] = getbits_fast(5);
+         gr_infos->block_type = getbits_fast(mp,2);
+         gr_infos->mixed_block_flag = get1bit(mp);
+         gr_infos->table_select[0] = getbits_fast(mp,5);
+         gr_infos->table_select[1] = getbits_fast(mp,5);
          /*
           * table_select[2] not needed, because there is no region2,
           * but to satisfy some verifications tools we set it either.
           */
          gr_infos->table_select[2] = 0;
          for(i=0;i<3;i++) {
-	   unsigned int sbg = (getbits_fast(3)<<3);
+	   unsigned int sbg = (getbits_fast(mp,3)<<3);
            gr_infos->full_gain[i] = gr_infos->pow2gain + sbg;
 #ifndef NOANALYSIS
 	   if (mpg123_pinfo!=NULL)
@@ -499,16 +670,16 @@ static void III_get_side_info_2(struct III_sideinfo *si,int stereo,
        {
          int i,r0c,r1c;
          for (i=0; i<3; i++)
-           gr_infos->table_select[i] = getbits_fast(5);
-         r0c = getbits_fast(4);
-         r1c = getbits_fast(3);
+           gr_infos->table_select[i] = getbits_fast(mp,5);
+         r0c = getbits_fast(mp,4);
+         r1c = getbits_fast(mp,3);
          gr_infos->region1start = bandInfo[sfreq].longIdx[r0c+1] >> 1 ;
          gr_infos->region2start = bandInfo[sfreq].longIdx[r0c+1+r1c+1] >> 1;
          gr_infos->block_type = 0;
          gr_infos->mixed_block_flag = 0;
        }
-       gr_infos->scalefac_scale = get1bit();
-       gr_infos->count1table_select = get1bit();
+       gr_infos->scalefac_scale = get1bit(mp);
+       gr_infos->count1table_select = get1bit(mp);
    }
 }
 
@@ -516,7 +687,7 @@ static void III_get_side_info_2(struct III_sideinfo *si,int stereo,
  * read scalefactors
  */
 #ifdef MPEG1
-static int III_get_scale_factors_1(int *scf,struct gr_info_s *gr_infos)
+static int III_get_scale_factors_1(PMPSTR mp,int *scf,struct gr_info_s *gr_infos)
 {
    static const unsigned char slen[2][16] = {
      {0, 0, 0, 0, 3, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4},
@@ -533,15 +704,15 @@ static int III_get_scale_factors_1(int *scf,struct gr_info_s *gr_infos)
 
       if (gr_infos->mixed_block_flag) {
          for (i=8;i;i--)
-           *scf++ = getbits_fast(num0);
+           *scf++ = getbits_fast(mp,num0);
          i = 9;
          numbits -= num0; /* num0 * 17 + num1 * 18 */
       }
 
       for (;i;i--)
-        *scf++ = getbits_fast(num0);
+        *scf++ = getbits_fast(mp,num0);
       for (i = 18; i; i--)
-        *scf++ = getbits_fast(num1);
+        *scf++ = getbits_fast(mp,num1);
       *scf++ = 0; *scf++ = 0; *scf++ = 0; /* short[13][0..2] = 0 */
     }
     else 
@@ -551,16 +722,16 @@ static int III_get_scale_factors_1(int *scf,struct gr_info_s *gr_infos)
 
       if(scfsi < 0) { /* scfsi < 0 => granule == 0 */
          for(i=11;i;i--)
-           *scf++ = getbits_fast(num0);
+           *scf++ = getbits_fast(mp,num0);
          for(i=10;i;i--)
-           *scf++ = getbits_fast(num1);
+           *scf++ = getbits_fast(mp,num1);
          numbits = (num0 + num1) * 10 + num0;
       }
       else {
         numbits = 0;
         if(!(scfsi & 0x8)) {
           for (i=6;i;i--)
-            *scf++ = getbits_fast(num0);
+            *scf++ = getbits_fast(mp,num0);
           numbits += num0 * 6;
         }
         else {
@@ -569,7 +740,7 @@ static int III_get_scale_factors_1(int *scf,struct gr_info_s *gr_infos)
 
         if(!(scfsi & 0x4)) {
           for (i=5;i;i--)
-            *scf++ = getbits_fast(num0);
+            *scf++ = getbits_fast(mp,num0);
           numbits += num0 * 5;
         }
         else {
@@ -578,7 +749,7 @@ static int III_get_scale_factors_1(int *scf,struct gr_info_s *gr_infos)
 
         if(!(scfsi & 0x2)) {
           for(i=5;i;i--)
-            *scf++ = getbits_fast(num1);
+            *scf++ = getbits_fast(mp,num1);
           numbits += num1 * 5;
         }
         else {
@@ -587,7 +758,7 @@ static int III_get_scale_factors_1(int *scf,struct gr_info_s *gr_infos)
 
         if(!(scfsi & 0x1)) {
           for (i=5;i;i--)
-            *scf++ = getbits_fast(num1);
+            *scf++ = getbits_fast(mp,num1);
           numbits += num1 * 5;
         }
         else {
@@ -601,7 +772,7 @@ static int III_get_scale_factors_1(int *scf,struct gr_info_s *gr_infos)
 }
 #endif
 
-static int III_get_scale_factors_2(int *scf,struct gr_info_s *gr_infos,int i_stereo)
+static int III_get_scale_factors_2(PMPSTR mp,int *scf,struct gr_info_s *gr_infos,int i_stereo)
 {
   unsigned char *pnt;
   int i,j;
@@ -638,7 +809,7 @@ static int III_get_scale_factors_2(int *scf,struct gr_info_s *gr_infos,int i_ste
     slen >>= 3;
     if(num) {
       for(j=0;j<(int)(pnt[i]);j++)
-        *scf++ = getbits_fast(num);
+        *scf++ = getbits_fast(mp,num);
       numbits += pnt[i] * num;
     }
     else {
@@ -660,7 +831,7 @@ static const int pretab2 [22] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
 /*
  * don't forget to apply the same changes to III_dequantize_sample_ms() !!! 
  */
-static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
+static int III_dequantize_sample(PMPSTR mp,real xr[SBLIMIT][SSLIMIT],int *scf,
    struct gr_info_s *gr_infos,int sfreq,int part2bits)
 {
   int shift = 1 + gr_infos->scalefac_scale;
@@ -668,6 +839,7 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
   int l[3],l3;
   int part2remain = gr_infos->part2_3_length - part2bits;
   int *me;
+  struct bitcache bc;
 
   {
     int i;
@@ -715,6 +887,8 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
   }
   /* end MDH crash fix */
 
+  bc_init(mp,&bc);
+
   if(gr_infos->block_type == 2) {
     /*
      * decoding with short or mixed mode BandIndex table 
@@ -740,7 +914,8 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
     mc = 0;
     for(i=0;i<2;i++) {
       int lp = l[i];
-      struct newhuff *h = (struct newhuff *)(ht+gr_infos->table_select[i]);
+      const struct huff_lookup *h = hl + gr_infos->table_select[i];
+      int linbits = (int) ht[gr_infos->table_select[i]].linbits;
       for(;lp;lp--,mc--) {
         register int x,y;
         if( (!mc) ) {
@@ -757,31 +932,20 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
             step = 3;
           }
         }
-        {
-          register short *val = (short *)h->table;
-          while((y=*val++)<0) {
-            if (get1bit())
-              val -= y;
-            part2remain--;
-          }
-          x = y >> 4;
-          y &= 0xf;
-        }
+        /* one refill covers codeword, linbits and signs of the pair */
+        bc_refill(&bc);
+        y = huff_decode(&bc,h,&part2remain);
+        x = y >> 4;
+        y &= 0xf;
         if(x == 15) {
           max[lwin] = cb;
-          part2remain -= h->linbits+1;
-          x += getbits((int)h->linbits);
-          if(get1bit())
-            *xrpnt = -ispow[x] * v;
-          else
-            *xrpnt =  ispow[x] * v;
+          part2remain -= linbits+1;
+          x += bc_get(&bc,linbits);
+          *xrpnt = bc_get1bit(&bc) ? -ispow[x] * v : ispow[x] * v;
         }
         else if(x) {
           max[lwin] = cb;
-          if(get1bit())
-            *xrpnt = -ispow[x] * v;
-          else
-            *xrpnt =  ispow[x] * v;
+          *xrpnt = bc_get1bit(&bc) ? -ispow[x] * v : ispow[x] * v;
           part2remain--;
         }
         else
@@ -789,19 +953,13 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
         xrpnt += step;
         if(y == 15) {
           max[lwin] = cb;
-          part2remain -= h->linbits+1;
-          y += getbits((int)h->linbits);
-          if(get1bit())
-            *xrpnt = -ispow[y] * v;
-          else
-            *xrpnt =  ispow[y] * v;
+          part2remain -= linbits+1;
+          y += bc_get(&bc,linbits);
+          *xrpnt = bc_get1bit(&bc) ? -ispow[y] * v : ispow[y] * v;
         }
         else if(y) {
           max[lwin] = cb;
-          if(get1bit())
-            *xrpnt = -ispow[y] * v;
-          else
-            *xrpnt =  ispow[y] * v;
+          *xrpnt = bc_get1bit(&bc) ? -ispow[y] * v : ispow[y] * v;
           part2remain--;
         }
         else
@@ -810,18 +968,21 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
       }
     }
     for(;l3 && (part2remain > 0);l3--) {
-      struct newhuff *h = (struct newhuff *)(htc+gr_infos->count1table_select);
-      register short *val = (short *)h->table,a;
-
-      while((a=*val++)<0) {
-        part2remain--;
-        if(part2remain < 0) {
-          part2remain++;
-          a = 0;
-          break;
-        }
-        if (get1bit())
-          val -= a;
+      const struct huff_lookup *h = hlc + gr_infos->count1table_select;
+      int e,a;
+
+      bc_refill(&bc);
+      e = h->tab[bc_peek(&bc,h->bits)];
+      if((e >> 8) > part2remain) {
+        /* codeword truncated by the end of part 3 */
+        bc_skip(&bc,part2remain);
+        part2remain = 0;
+        a = 0;
+      }
+      else {
+        bc_skip(&bc,e >> 8);
+        part2remain -= e >> 8;
+        a = e & 0xf;
       }
       for(i=0;i<4;i++) {
         if(!(i & 1)) {
@@ -848,7 +1009,7 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
             part2remain++;
             break;
           }
-          if(get1bit()) 
+          if(bc_get1bit(&bc)) 
             *xrpnt = -v;
           else
             *xrpnt = v;
@@ -912,7 +1073,8 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
      */
     for(i=0;i<3;i++) {
       int lp = l[i];
-      struct newhuff *h = (struct newhuff *)(ht+gr_infos->table_select[i]);
+      const struct huff_lookup *h = hl + gr_infos->table_select[i];
+      int linbits = (int) ht[gr_infos->table_select[i]].linbits;
 
       for(;lp;lp--,mc--) {
         int x,y;
@@ -922,31 +1084,20 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
           v = gr_infos->pow2gain[((*scf++) + (*pretab++)) << shift];
           cb = *m++;
         }
-        {
-          register short *val = (short *)h->table;
-          while((y=*val++)<0) {
-            if (get1bit())
-              val -= y;
-            part2remain--;
-          }
-          x = y >> 4;
-          y &= 0xf;
-        }
+        /* one refill covers codeword, linbits and signs of the pair */
+        bc_refill(&bc);
+        y = huff_decode(&bc,h,&part2remain);
+        x = y >> 4;
+        y &= 0xf;
         if (x == 15) {
           max = cb;
-          part2remain -= h->linbits+1;
-          x += getbits((int)h->linbits);
-          if(get1bit())
-            *xrpnt++ = -ispow[x] * v;
-          else
-            *xrpnt++ =  ispow[x] * v;
+          part2remain -= linbits+1;
+          x += bc_get(&bc,linbits);
+          *xrpnt++ = bc_get1bit(&bc) ? -ispow[x] * v : ispow[x] * v;
         }
         else if(x) {
           max = cb;
-          if(get1bit())
-            *xrpnt++ = -ispow[x] * v;
-          else
-            *xrpnt++ =  ispow[x] * v;
+          *xrpnt++ = bc_get1bit(&bc) ? -ispow[x] * v : ispow[x] * v;
           part2remain--;
         }
         else
@@ -954,19 +1105,13 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
 
         if (y == 15) {
           max = cb;
-          part2remain -= h->linbits+1;
-          y += getbits((int)h->linbits);
-          if(get1bit())
-            *xrpnt++ = -ispow[y] * v;
-          else
-            *xrpnt++ =  ispow[y] * v;
+          part2remain -= linbits+1;
+          y += bc_get(&bc,linbits);
+          *xrpnt++ = bc_get1bit(&bc) ? -ispow[y] * v : ispow[y] * v;
         }
         else if(y) {
           max = cb;
-          if(get1bit())
-            *xrpnt++ = -ispow[y] * v;
-          else
-            *xrpnt++ =  ispow[y] * v;
+          *xrpnt++ = bc_get1bit(&bc) ? -ispow[y] * v : ispow[y] * v;
           part2remain--;
         }
         else
@@ -978,18 +1123,21 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
      * short (count1table) values
      */
     for(;l3 && (part2remain > 0);l3--) {
-      struct newhuff *h = (struct newhuff *)(htc+gr_infos->count1table_select);
-      register short *val = (short *)h->table,a;
-
-      while((a=*val++)<0) {
-        part2remain--;
-        if(part2remain < 0) {
-          part2remain++;
-          a = 0;
-          break;
-        }
-        if (get1bit())
-          val -= a;
+      const struct huff_lookup *h = hlc + gr_infos->count1table_select;
+      int e,a;
+
+      bc_refill(&bc);
+      e = h->tab[bc_peek(&bc,h->bits)];
+      if((e >> 8) > part2remain) {
+        /* codeword truncated by the end of part 3 */
+        bc_skip(&bc,part2remain);
+        part2remain = 0;
+        a = 0;
+      }
+      else {
+        bc_skip(&bc,e >> 8);
+        part2remain -= e >> 8;
+        a = e & 0xf;
       }
       for(i=0;i<4;i++) {
         if(!(i & 1)) {
@@ -1007,7 +1155,7 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
             part2remain++;
             break;
           }
-          if(get1bit())
+          if(bc_get1bit(&bc))
             *xrpnt++ = -v;
           else
             *xrpnt++ = v;
@@ -1029,14 +1177,21 @@ static int III_dequantize_sample(real xr[SBLIMIT][SSLIMIT],int *scf,
     gr_infos->maxb = longLimit[sfreq][gr_infos->maxbandl];
   }
 
+  /* no antialias and IMDCT for the subbands a reduced rate drops */
+  if(gr_infos->maxb > (unsigned) mp->fr.down_sample_sblimit)
+    gr_infos->maxb = mp->fr.down_sample_sblimit;
+
+  bc_sync(mp,&bc);
+
   while( part2remain > 16 ) {
-    getbits(16); /* Dismiss stuffing Bits */
+    getbits(mp,16); /* Dismiss stuffing Bits */
     part2remain -= 16;
   }
   if(part2remain > 0)
-    getbits(part2remain);
+    getbits(mp,part2remain);
   else if(part2remain < 0) {
-    fprintf(stderr,"mpg123: Can't rewind stream by %d bits!\n",-part2remain);
+    if (!mp->preroll)
+      fprintf(stderr,"mpg123: Can't rewind stream by %d bits!\n",-part2remain);
     return 1; /* -> error */
   }
   return 0;
@@ -1524,7 +1679,7 @@ static void III_hybrid( PMPSTR mp, real fsIn[SBLIMIT][SSLIMIT],real tsOut[SSLIMI
      }
    }
 
-   for(;sb<SBLIMIT;sb++,tspnt++) {
+   for(;sb<mp->fr.down_sample_sblimit;sb++,tspnt++) {
      int i;
      for(i=0;i<SSLIMIT;i++) {
        tspnt[i*SBLIMIT] = *rawout1++;
@@ -1536,10 +1691,10 @@ static void III_hybrid( PMPSTR mp, real fsIn[SBLIMIT][SSLIMIT],real tsOut[SSLIMI
 /*
  * main layer3 handler
  */
-struct III_sideinfo sideinfo;
 
-int do_layer3_sideinfo(struct frame *fr)
+int do_layer3_sideinfo(PMPSTR mp)
 {
+  struct frame *fr=&(mp->fr);
   int stereo = fr->stereo;
   int single = fr->single;
   int ms_stereo;
@@ -1560,12 +1715,12 @@ int do_layer3_sideinfo(struct frame *fr)
 
   if(fr->lsf) {
     granules = 1;
-    III_get_side_info_2(&sideinfo,stereo,ms_stereo,sfreq,single);
+    III_get_side_info_2(mp,&mp->sideinfo,stereo,ms_stereo,sfreq,single);
   }
   else {
     granules = 2;
 #ifdef MPEG1
-    III_get_side_info_1(&sideinfo,stereo,ms_stereo,sfreq,single);
+    III_get_side_info_1(mp,&mp->sideinfo,stereo,ms_stereo,sfreq,single);
 #else
     fprintf(stderr,"Not supported\n");
 #endif
@@ -1574,11 +1729,11 @@ int do_layer3_sideinfo(struct frame *fr)
   databits=0;
   for (gr=0 ; gr < granules ; ++gr) {
     for (ch=0; ch < stereo ; ++ch) {
-      struct gr_info_s *gr_infos = &(sideinfo.ch[ch].gr[gr]);
+      struct gr_info_s *gr_infos = &(mp->sideinfo.ch[ch].gr[gr]);
       databits += gr_infos->part2_3_length;
     }
   }
-  return databits-8*sideinfo.main_data_begin;
+  return databits-8*mp->sideinfo.main_data_begin;
 }
 
 
@@ -1597,7 +1752,8 @@ int  do_layer3( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
   int sfreq = fr->sampling_frequency;
   int stereo1,granules;
 
-  if(set_pointer(mp, (int)sideinfo.main_data_begin) == MP3_ERR)
+  mp->spec_granules = 0;
+  if(set_pointer(mp, (int)mp->sideinfo.main_data_begin) == MP3_ERR)
     return 0;
 
   if(stereo == 1) { /* stream is mono */
@@ -1627,18 +1783,20 @@ int  do_layer3( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
 
   for (gr=0;gr<granules;gr++) 
   {
-    static real hybridIn[2][SBLIMIT][SSLIMIT];
-    static real hybridOut[2][SSLIMIT][SBLIMIT];
+    real hybridInBuf[2][SBLIMIT][SSLIMIT];
+    real hybridOut[2][SSLIMIT][SBLIMIT];
+    /* the spectral mode leaves the granule in mp->spec_xr */
+    real (*hybridIn)[SBLIMIT][SSLIMIT] = mp->spectral ? mp->spec_xr[gr] : hybridInBuf;
 
     {
-      struct gr_info_s *gr_infos = &(sideinfo.ch[0].gr[gr]);
+      struct gr_info_s *gr_infos = &(mp->sideinfo.ch[0].gr[gr]);
       long part2bits;
 
       if(fr->lsf)
-        part2bits = III_get_scale_factors_2(scalefacs[0],gr_infos,0);
+        part2bits = III_get_scale_factors_2(mp,scalefacs[0],gr_infos,0);
       else {
 #ifdef MPEG1
-        part2bits = III_get_scale_factors_1(scalefacs[0],gr_infos);
+        part2bits = III_get_scale_factors_1(mp,scalefacs[0],gr_infos);
 #else
 	fprintf(stderr,"Not supported\n");
 #endif
@@ -1653,17 +1811,17 @@ int  do_layer3( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
       }
 #endif
 
-      if(III_dequantize_sample(hybridIn[0], scalefacs[0],gr_infos,sfreq,part2bits))
+      if(III_dequantize_sample(mp,hybridIn[0], scalefacs[0],gr_infos,sfreq,part2bits))
         return clip;
     }
     if(stereo == 2) {
-      struct gr_info_s *gr_infos = &(sideinfo.ch[1].gr[gr]);
+      struct gr_info_s *gr_infos = &(mp->sideinfo.ch[1].gr[gr]);
       long part2bits;
       if(fr->lsf) 
-        part2bits = III_get_scale_factors_2(scalefacs[1],gr_infos,i_stereo);
+        part2bits = III_get_scale_factors_2(mp,scalefacs[1],gr_infos,i_stereo);
       else {
 #ifdef MPEG1
-        part2bits = III_get_scale_factors_1(scalefacs[1],gr_infos);
+        part2bits = III_get_scale_factors_1(mp,scalefacs[1],gr_infos);
 #else
 	fprintf(stderr,"Not supported\n");
 #endif
@@ -1677,12 +1835,12 @@ int  do_layer3( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
       }
 #endif
 
-      if(III_dequantize_sample(hybridIn[1],scalefacs[1],gr_infos,sfreq,part2bits))
+      if(III_dequantize_sample(mp,hybridIn[1],scalefacs[1],gr_infos,sfreq,part2bits))
           return clip;
 
       if(ms_stereo) {
         int i;
-        for(i=0;i<SBLIMIT*SSLIMIT;i++) {
+        for(i=0;i<mp->fr.down_sample_sblimit*SSLIMIT;i++) {
           real tmp0,tmp1;
           tmp0 = ((real *) hybridIn[0])[i];
           tmp1 = ((real *) hybridIn[1])[i];
@@ -1695,10 +1853,10 @@ int  do_layer3( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
         III_i_stereo(hybridIn,scalefacs[1],gr_infos,sfreq,ms_stereo,fr->lsf);
 
       if(ms_stereo || i_stereo || (single == 3) ) {
-        if(gr_infos->maxb > sideinfo.ch[0].gr[gr].maxb) 
-          sideinfo.ch[0].gr[gr].maxb = gr_infos->maxb;
+        if(gr_infos->maxb > mp->sideinfo.ch[0].gr[gr].maxb) 
+          mp->sideinfo.ch[0].gr[gr].maxb = gr_infos->maxb;
         else
-          gr_infos->maxb = sideinfo.ch[0].gr[gr].maxb;
+          gr_infos->maxb = mp->sideinfo.ch[0].gr[gr].maxb;
       }
 
       switch(single) {
@@ -1736,10 +1894,10 @@ int  do_layer3( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
     mpg123_pinfo->js =   (fr->mode == MPG_MD_JOINT_STEREO);
     mpg123_pinfo->ms_stereo = ms_stereo;
     mpg123_pinfo->i_stereo = i_stereo;
-    mpg123_pinfo->maindata = sideinfo.main_data_begin;
+    mpg123_pinfo->maindata = mp->sideinfo.main_data_begin;
 
     for(ch=0;ch<stereo1;ch++) {
-      struct gr_info_s *gr_infos = &(sideinfo.ch[ch].gr[gr]);
+      struct gr_info_s *gr_infos = &(mp->sideinfo.ch[ch].gr[gr]);
       mpg123_pinfo->big_values[gr][ch]=gr_infos->big_values;
       mpg123_pinfo->scalefac_scale[gr][ch]=gr_infos->scalefac_scale;
       mpg123_pinfo->mixed[gr][ch] = gr_infos->mixed_block_flag;
@@ -1751,7 +1909,7 @@ int  do_layer3( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
 
 
     for (ch=0;ch<stereo1;ch++) {
-      struct gr_info_s *gr_infos = &(sideinfo.ch[ch].gr[gr]);
+      struct gr_info_s *gr_infos = &(mp->sideinfo.ch[ch].gr[gr]);
       ifqstep = ( mpg123_pinfo->scalefac_scale[gr][ch] == 0 ) ? .5 : 1.0;
       if (2==gr_infos->block_type) {
 	for (i=0; i<3; i++) {
@@ -1788,9 +1946,14 @@ int  do_layer3( PMPSTR mp,unsigned char *pcm_sample,int *pcm_point,
   }
 #endif
 
+    if(mp->spectral) {
+      memcpy(mp->spec_scalefac[gr],scalefacs,sizeof(scalefacs));
+      mp->spec_granules++;
+      continue;
+    }
 
     for(ch=0;ch<stereo1;ch++) {
-      struct gr_info_s *gr_infos = &(sideinfo.ch[ch].gr[gr]);
+      struct gr_info_s *gr_infos = &(mp->sideinfo.ch[ch].gr[gr]);
       III_antialias(hybridIn[ch],gr_infos);
       III_hybrid(mp, hybridIn[ch], hybridOut[ch], ch,gr_infos);
     }
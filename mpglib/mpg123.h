@@ -104,6 +104,7 @@ struct gr_info_s {
       int scfsi;
       unsigned part2_3_length;
       unsigned big_values;
+      unsigned global_gain;
       unsigned scalefac_compress;
       unsigned block_type;
       unsigned mixed_block_flag;
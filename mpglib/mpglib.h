@@ -37,7 +37,7 @@ typedef struct mpstr_tag {
         int fsizeold;
         int fsizeold_nopadding;
 	struct frame fr;
-        unsigned char bsspace[2][MAXFRAMESIZE+512]; /* MAXFRAMESIZE */
+        unsigned char bsspace[2][MAXFRAMESIZE+512+8]; /* MAXFRAMESIZE, +8 for the read ahead of the layer3 bit cache */
 	real hybrid_block[2][2][SBLIMIT*SSLIMIT];
 	int hybrid_blc[2];
 	unsigned long header;
@@ -45,6 +45,15 @@ typedef struct mpstr_tag {
 	real synth_buffs[2][2][0x110];
         int  synth_bo;
         int  sync_bitstream;
+        unsigned char *wordpointer;  /* bit reader */
+        int  bitindex;
+        struct III_sideinfo sideinfo;
+        int  preroll;                /* output is dropped, no complaints */
+        int  down_sample;            /* 0, 1, 2: output at 1, 1/2, 1/4 rate */
+        int  spectral;               /* Layer III: no synthesis, see spec_xr */
+        int  spec_granules;          /* granules of the last frame in spec_xr */
+        real spec_xr[2][2][SBLIMIT][SSLIMIT]; /* [gr][ch], after the stereo processing */
+        int  spec_scalefac[2][2][39];
 	
 } MPSTR, *PMPSTR;
 